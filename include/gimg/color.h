@@ -25,6 +25,7 @@ USA.
 #define __gimg_color_h_
 
 #include <gimg/config.h>
+#include <gimg/format.h>
 
 namespace gimg {
   
@@ -90,6 +91,41 @@ namespace gimg {
       Color grade(const Color &black, const Color &white, const Color &lift, const Color &gain);
       
   };
+  
+  // Batch versions of the Color operations over count pixels
+  //
+  // desc must be PF_RGB or PF_RGBA with PT_INT_8 or PT_FLOAT_32 channels
+  // (8 bits channels are normalized to [0, 1], HSV and HSL components
+  // included), alpha is left untouched
+  //
+  // Pixels are converted to structure of arrays blocks processed 4 at a time
+  // with SSE2 when available, results match the Color methods
+  //
+  // src and dst may be the same buffer, false is returned for unsupported
+  // pixel descriptions
+  GIMG_API bool RGBToHSV(const void *src, void *dst, const PixelDesc &desc, size_t count);
+  GIMG_API bool HSVToRGB(const void *src, void *dst, const PixelDesc &desc, size_t count);
+  GIMG_API bool RGBToHSL(const void *src, void *dst, const PixelDesc &desc, size_t count);
+  GIMG_API bool HSLToRGB(const void *src, void *dst, const PixelDesc &desc, size_t count);
+  
+  // mul * rgb + add (operator*= then operator+=), 8 bits results are clamped
+  GIMG_API bool MultiplyAdd(const void *src, void *dst, const PixelDesc &desc, size_t count,
+                            const Color &mul, const Color &add);
+  
+  // Color::luminance of each pixel, one float per pixel in lum
+  GIMG_API bool ComputeLuminance(const void *src, const PixelDesc &desc, size_t count, float *lum);
+  
+  // Color::premult and Color::unpremult over count pixels of any plain type
+  // with PF_RGBA or PF_LUMINANCE_ALPHA format
+  //
+  // Integer channels are rounded to nearest (8 bits divisions through an
+  // exact reciprocal table), alpha 0 leaves colors untouched
+  // RGBA8 and RGBA float pixels are processed with SSE2 when available
+  //
+  // src and dst may be the same buffer, false is returned for unsupported
+  // pixel descriptions
+  GIMG_API bool Premultiply(const void *src, void *dst, const PixelDesc &desc, size_t count);
+  GIMG_API bool Unpremultiply(const void *src, void *dst, const PixelDesc &desc, size_t count);
 }
 
 inline gimg::Color operator+(const gimg::Color &c0, const gimg::Color &c1) {
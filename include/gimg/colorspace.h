@@ -0,0 +1,77 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+
+#ifndef __gimg_colorspace_h_
+#define __gimg_colorspace_h_
+
+#include <gimg/format.h>
+
+namespace gimg {
+  
+  enum TransferFunction {
+    TRANSFER_LINEAR = 0,
+    // IEC 61966-2-1, 12.92 v up to 0.0031308, 1.055 v^(1/2.4) - 0.055 above
+    TRANSFER_SRGB,
+    // ITU-R BT.709 and BT.2020 OETF, 4.5 v up to 0.018054,
+    // 1.099297 v^0.45 - 0.099297 above
+    TRANSFER_BT709
+  };
+  
+  // RGB primaries, white point and transfer function
+  enum ColorSpace {
+    // ITU-R BT.709 primaries, D65 white
+    COLORSPACE_LINEAR_REC709 = 0,
+    COLORSPACE_SRGB,
+    COLORSPACE_REC709,
+    // ITU-R BT.2020 primaries, D65 white
+    COLORSPACE_LINEAR_REC2020,
+    COLORSPACE_REC2020,
+    // ACES AP1 primaries, ACES white (close to D60), linear
+    COLORSPACE_ACESCG,
+    // CIE 1931 XYZ, R, G and B channels hold X, Y and Z
+    COLORSPACE_XYZ,
+    COLORSPACE_MAX
+  };
+  
+  GIMG_API TransferFunction GetTransferFunction(ColorSpace cs);
+  
+  // Row major 3x3 matrix taking linear src RGB to linear dst RGB
+  // (out = m * in), computed in double precision from the primaries
+  // Different white points are adapted with the Bradford transform, XYZ
+  // values are not adapted (RGB to XYZ matrices use the space white)
+  GIMG_API bool GetColorSpaceMatrix(ColorSpace src, ColorSpace dst, float m[9]);
+  
+  // Y row of the RGB to XYZ matrix (Color::luminance keeps Rec.601 weights)
+  GIMG_API bool GetLuminanceWeights(ColorSpace cs, float w[3]);
+  
+  // Decode src transfer, apply the primaries matrix and encode dst transfer
+  // in a single PixelPipeline pass (see gimg/pipeline.h) over count pixels
+  // of any plain or packed type, alpha is left untouched
+  // src and dst may be the same buffer
+  GIMG_API bool ConvertColorSpace(const void *src, void *dst, const PixelDesc &desc, size_t count,
+                                  ColorSpace from, ColorSpace to);
+  
+}
+
+#endif
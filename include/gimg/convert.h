@@ -0,0 +1,92 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_convert_h_
+#define __gimg_convert_h_
+
+#include <gimg/format.h>
+
+namespace gimg {
+
+  enum ConvertFlags {
+    CONVERT_DEFAULT = 0x00,
+    // ordered dithering (4x4 Bayer matrix) when packing to fewer bits and
+    // when quantizing float to 8 or 16 bits integer channels
+    CONVERT_DITHER  = 0x01,
+    // slower and better endpoint search when compressing to DXT/3DC types
+    CONVERT_HIGH_QUALITY = 0x02,
+    // RGB source is a [0, 1] encoded normal map when compressing to 3DC,
+    // vectors are renormalized before X and Y are kept
+    CONVERT_NORMAL_MAP = 0x04,
+    // 8 and 16 bits integer color channels hold sRGB encoded values: integer
+    // to float decodes them, float to integer encodes (alpha stays linear,
+    // other type pairs are not affected)
+    CONVERT_SRGB = 0x08,
+    // same as CONVERT_DITHER with a 64x64 blue noise pattern (no visible
+    // cross hatching, the noise is pushed to high frequencies)
+    CONVERT_DITHER_BLUE_NOISE = 0x10
+  };
+
+  // Convert count pixels from srcDesc to dstDesc (plain and packed types)
+  //
+  // Channels:
+  //   missing color channels are set to 0, missing alpha to opaque
+  //   luminance expands to R, G and B
+  //   R, G and B collapse to luminance using Color::luminance weights
+  //
+  // Values:
+  //   integer channels are normalized, [0, max] maps to [0, 1] float
+  //   float to integer clamps to [0, 1] and rounds to nearest, or adds the
+  //   dither pattern threshold of the pixel before truncating (alpha is
+  //   never dithered)
+  //   integer to integer rescales with rounding (8 bits 255 -> 16 bits 65535)
+  //   with CONVERT_SRGB, decoding uses exact tables and encoding a vectorized
+  //   polynomial (8 bits values round trip, rounding ties may differ by one)
+  //
+  // Packed types are unpacked to 8 bits channels (16 bits for 10_10_10_2)
+  // with rounding and packed from them, the first channel of the format
+  // using the most significant bits (GL convention)
+  //
+  // srcOrder gives, for each channel of srcDesc format, its position in
+  // the source pixel ({2, 1, 0, 3} reads BGRA data as PF_RGBA)
+  // null means channels are stored in format order
+  //
+  // x and y are the image position of the first pixel (the run must lie in
+  // a single row), only used to index dither patterns
+  //
+  // src and dst must not overlap
+  GIMG_API bool ConvertPixels(const void *src, const PixelDesc &srcDesc,
+                              void *dst, const PixelDesc &dstDesc,
+                              size_t count, const int *srcOrder=0,
+                              int flags=CONVERT_DEFAULT, int x=0, int y=0);
+
+  // Ordered dither pattern used by flags: size x size ranks in
+  // [0, size * size), row major, tiled over the image from (0, 0)
+  // CONVERT_DITHER_BLUE_NOISE takes precedence over CONVERT_DITHER, the blue
+  // noise pattern is built on first use (void and cluster method)
+  // Returns null when flags do not dither
+  GIMG_API const unsigned int* GetDitherPattern(int flags, int *size);
+
+}
+
+#endif
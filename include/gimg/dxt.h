@@ -0,0 +1,71 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_dxt_h_
+#define __gimg_dxt_h_
+
+#include <gimg/convert.h>
+
+namespace gimg {
+
+  // Compress a width x height pixel rectangle to DXT1, DXT3, DXT5 or 3DC blocks
+  //
+  // src is read through ConvertPixels so any plain or packed srcDesc is
+  // accepted, RGBA8 rows are used in place (CONVERT_SRGB encodes float sources)
+  //
+  // blocks are stored row by row, ((width+3)/4) * ((height+3)/4) of them,
+  // partial blocks on the right and bottom edges repeat the last column/row
+  //
+  // DXT1 with PF_RGBA keeps 1 bit alpha (alpha < 128 is transparent)
+  //
+  // 3DC encodes red and green, CONVERT_NORMAL_MAP derives them from a RGB(A)
+  // normal map (normals shortened by mip filtering are renormalized)
+  //
+  // the default uses bounding box endpoints, CONVERT_HIGH_QUALITY fits them
+  // along the principal axis of the block colors with least squares refinement
+  // (and searches both alpha and 3DC block modes)
+  //
+  // block rows are compressed in parallel when built with OpenMP
+  GIMG_API bool CompressBlocks(const void *src, const PixelDesc &srcDesc,
+                               int width, int height,
+                               void *dst, const PixelDesc &dstDesc,
+                               int flags=CONVERT_DEFAULT);
+
+  // Decompress DXT1, DXT3, DXT5 or 3DC blocks laid out as above to a
+  // width x height pixel rectangle
+  //
+  // blocks decode to 8 bits RGBA (RG for 3DC), written in place when dstDesc
+  // matches and converted through ConvertPixels otherwise (flags are passed
+  // on, CONVERT_DITHER included)
+  //
+  // DXT1 with PF_RGB decodes its three colors mode black as opaque
+  //
+  // block rows are decompressed in parallel when built with OpenMP
+  GIMG_API bool DecompressBlocks(const void *src, const PixelDesc &srcDesc,
+                                 int width, int height,
+                                 void *dst, const PixelDesc &dstDesc,
+                                 int flags=CONVERT_DEFAULT);
+
+}
+
+#endif
@@ -37,6 +37,7 @@ namespace gimg {
     PF_LUMINANCE_ALPHA,
     PF_RGB,
     PF_RGBA,
+    PF_RG,
     PF_MAX
   };
   
@@ -70,6 +71,13 @@ namespace gimg {
       
       PixelDesc& operator=(const PixelDesc &rhs);
       
+      inline bool operator==(const PixelDesc &rhs) const {
+        return (mFormat == rhs.mFormat && mType == rhs.mType);
+      }
+      inline bool operator!=(const PixelDesc &rhs) const {
+        return !operator==(rhs);
+      }
+      
       inline PixelType getType() const {return mType;}
       inline PixelFormat getFormat() const {return mFormat;}
 
@@ -95,7 +103,7 @@ namespace gimg {
       // compressed only
       size_t getBytesPerBlock() const;
       
-      size_t getBytesSizeFor(int w, int h, int d, int firstMipmap=0, int nMipmap=-1);
+      size_t getBytesSizeFor(int w, int h, int d, int firstMipmap=0, int nMipmap=-1) const;
   
     protected:
       
@@ -104,6 +112,59 @@ namespace gimg {
   
   };
   
+  // Per level dimensions and byte sizes of an image shape, computed once so
+  // that allocation, I/O and upload code can look them up in constant time
+  //
+  // w, h, d and numMipmaps follow the Image constructor conventions
+  // (d <= 0 is a cube map, numMipmaps < 0 goes down to 1x1x1)
+  //
+  // Sizes are per face, offsets are those of a single buffer holding all
+  // levels of face 0, then all levels of face 1, ... (DDS order)
+  // Compressed rows are block rows
+  class GIMG_API MipLayout {
+    
+    public:
+      
+      enum {
+        MAX_LEVELS = 32
+      };
+      
+    public:
+      
+      MipLayout();
+      MipLayout(const PixelDesc &desc, int w, int h, int d=1, int numMipmaps=-1);
+      ~MipLayout();
+      
+      void reset(const PixelDesc &desc, int w, int h, int d=1, int numMipmaps=-1);
+      
+      inline int getNumLevels() const {return mNumLevels;}
+      inline int getNumFaces() const {return mNumFaces;}
+      inline int getWidth(int level) const {return mLevels[level].width;}
+      inline int getHeight(int level) const {return mLevels[level].height;}
+      inline int getDepth(int level) const {return mLevels[level].depth;}
+      inline size_t getRowBytes(int level) const {return mLevels[level].rowBytes;}
+      inline size_t getBytesSize(int level) const {return mLevels[level].size;}
+      inline size_t getOffset(int level, int face=0) const {return face * mFaceSize + mLevels[level].offset;}
+      inline size_t getFaceBytesSize() const {return mFaceSize;}
+      inline size_t getTotalBytesSize() const {return mNumFaces * mFaceSize;}
+      
+    protected:
+      
+      struct Level {
+        int width;
+        int height;
+        int depth;
+        size_t rowBytes;
+        size_t size;
+        size_t offset;
+      };
+      
+      int mNumLevels;
+      int mNumFaces;
+      size_t mFaceSize;
+      Level mLevels[MAX_LEVELS];
+  };
+  
   
   
 }
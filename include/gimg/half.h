@@ -0,0 +1,50 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_half_h_
+#define __gimg_half_h_
+
+#include <gimg/config.h>
+
+namespace gimg {
+
+  // PT_FLOAT_16 channels are stored as IEEE 754 binary16 bit patterns
+  typedef unsigned short Half;
+
+  GIMG_API float HalfToFloat(Half h);
+
+  // round to nearest even, overflow to infinity
+  GIMG_API Half FloatToHalf(float f);
+  
+  // Array versions, use the CPU conversion instructions (F16C) when
+  // available and the same lookup tables as the functions above otherwise
+  // (results are identical except for NaN payloads)
+  GIMG_API void HalfToFloat(const Half *src, float *dst, size_t n);
+  GIMG_API void FloatToHalf(const float *src, Half *dst, size_t n);
+  
+  // true if the array versions use F16C instructions
+  GIMG_API bool HasHalfInstructions();
+
+}
+
+#endif
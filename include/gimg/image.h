@@ -25,12 +25,20 @@ USA.
 #define __gimg_image_h_
 
 #include <gimg/format.h>
+#include <gimg/color.h>
+#include <gimg/colorspace.h>
 #include <gcore/dmodule.h>
 #include <gcore/functor.h>
 #include <gcore/path.h>
 
 namespace gimg {
   
+  class Lut3D;
+  class PixelPipeline;
+  struct ToneMapSettings;
+  class Histogram;
+  struct ImageStats;
+  
   class GIMG_API Image {
     
     public:
@@ -57,6 +65,16 @@ namespace gimg {
         LANCZOS
       };
       
+      // How stored pixels map to the displayed image (row 0 at the top):
+      // stored pixels are transposed first, then flipped horizontally and
+      // vertically
+      enum Orientation {
+        ORIENT_NORMAL    = 0x00,
+        ORIENT_FLIP_X    = 0x01,
+        ORIENT_FLIP_Y    = 0x02,
+        ORIENT_TRANSPOSE = 0x04
+      };
+      
     public:
       
       GCORE_BEGIN_MODULE_INTERFACE ( Plugin )
@@ -64,7 +82,7 @@ namespace gimg {
         GCORE_DEFINE_MODULE_SYMBOL1R ( const char*, getExtension, int )
         GCORE_DEFINE_MODULE_SYMBOL0R ( bool, canRead )
         GCORE_DEFINE_MODULE_SYMBOL0R ( bool, canWrite )
-        GCORE_DEFINE_MODULE_SYMBOL1R ( Image*, readImage, const char* )
+        GCORE_DEFINE_MODULE_SYMBOL3R ( Image*, readImage, const char*, const PixelDesc*, int )
         GCORE_DEFINE_MODULE_SYMBOL2R ( bool, writeImage, Image*, const char* )
       GCORE_END_MODULE_INTERFACE
       
@@ -72,7 +90,12 @@ namespace gimg {
       static void UnloadPlugins();
       static bool RegisterPlugin(Plugin *);
       static bool UnregisterPlugin(Plugin *);
-      static Image* Read(const gcore::Path &filepath, int numMips=-1);
+      // desc requests the pixel description of the returned image (0 keeps
+      // the file one), flags are ConvertFlags (see gimg/convert.h)
+      // Readers decode plain (and packed, without mipmaps) requests directly
+      // in their single pass, other requests are converted after reading
+      static Image* Read(const gcore::Path &filepath, int numMips=-1,
+                         const PixelDesc *desc=0, int flags=0);
       static bool Write(Image *img, const gcore::Path &filepath);
       
     public:
@@ -89,14 +112,100 @@ namespace gimg {
       virtual ~Image();
       
       void* getPixels(int mipLevel=0, int face=0);
+      // Contiguous width x height x depth plane of a channel, planar images only
+      void* getPlane(int channel, int mipLevel=0, int face=0);
       int getWidth(int mipLevel=0, int face=0) const;
       int getHeight(int mipLevel=0, int face=0) const;
       int getDepth(int mipLevel=0, int face=0) const;
       
+      // Store each mip level as one plane per channel (plain formats only)
+      // or back as interleaved pixels, all faces and levels are re-ordered
+      // Mipmaps, scaling and orientation operations keep the layout,
+      // convert returns interleaved images and Write saves an interleaved copy
+      bool setPlanar(bool planar);
+      
       void clearMipmaps();
-      void buildMipmaps(int numMipmaps);
+      // premultAlpha: straight alpha RGBA and luminance alpha images are
+      // filtered premultiplied so that transparent pixels do not bleed
+      // their color (see premultiply), the base level is left untouched
+      void buildMipmaps(int numMipmaps, bool premultAlpha=false);
+      
+      // w and h are the displayed dimensions (swapped if ORIENT_TRANSPOSE is set)
+      // 3D images keep their depth
+      // premultAlpha: as for buildMipmaps, the image is premultiplied before
+      // filtering and unpremultiplied after
+      void scale(int w, int h, ScaleMethod method, bool premultAlpha=false);
+      // 3D images only (separable X, Y and Z passes), mipmap levels are
+      // rebuilt from the scaled base level with a box filter
+      void scale(int w, int h, int d, ScaleMethod method, bool premultAlpha=false);
+      
+      // Resample the [x, x+rw[ x [y, y+rh[ region of given mip level and face
+      // (sub-pixel origin and size allowed) into a new w x h image
+      // Only the source pixels under the filters footprint are read
+      // The image orientation is normalized first
+      Image* scaleRegion(double x, double y, double rw, double rh,
+                         int w, int h, ScaleMethod method,
+                         int mipLevel=0, int face=0);
+      
+      // Returns a new image with all faces and mip levels converted to desc
+      // (plain and packed types, see ConvertPixels in gimg/convert.h)
+      // Compressed types are supported for 2D and cube images: compressed
+      // targets are encoded (see CompressBlocks in gimg/dxt.h,
+      // CONVERT_HIGH_QUALITY selects the slower encoder) and compressed
+      // images are decompressed (see DecompressBlocks)
+      // CONVERT_SRGB decodes or encodes 8 and 16 bits color channels
+      // CONVERT_DITHER and CONVERT_DITHER_BLUE_NOISE convert rows in parallel
+      Image* convert(const PixelDesc &desc, int flags=0);
+      
+      // Returns a new 8 bits RGB or RGBA image with all faces and mip levels
+      // tone mapped (see ToneMapPixels in gimg/tonemap.h), rows are
+      // processed in parallel
+      Image* toneMap(const PixelDesc &desc, const ToneMapSettings &settings);
+      
+      // Color::grade applied to all faces and mip levels (plain types)
+      // R, G and B channels use the matching color components, luminance
+      // their Color::luminance, alpha is left untouched
+      // Integer results are clamped to the channel range
+      void grade(const Color &black, const Color &white, const Color &lift, const Color &gain);
+      
+      // Lut3D::lookup applied to all faces and mip levels (plain RGB and
+      // RGBA types, planar images included), rows are processed in parallel
+      void applyLut(const Lut3D &lut);
+      
+      // PixelPipeline operations applied in place to all faces and mip levels
+      // (plain and packed types, planar images included), in a single pass
+      // over rows processed in parallel
+      void applyPipeline(const PixelPipeline &pipeline);
       
-      void scale(int w, int h, ScaleMethod method);
+      // In place ConvertColorSpace of all faces and mip levels (see
+      // gimg/colorspace.h), integer channels are clamped to their range
+      void convertColorSpace(ColorSpace from, ColorSpace to);
+      
+      // Multiply (divide) color channels by alpha in all faces and mip
+      // levels (plain RGBA and luminance alpha types, see Premultiply in
+      // gimg/color.h), rows are processed in parallel
+      void premultiply();
+      void unpremultiply();
+      
+      // Statistics of all faces (and slices) of a mip level, see gimg/stats.h
+      // Coarser levels give fast approximations (box filtered values, min
+      // and max are narrowed), rows are reduced in parallel
+      bool computeStats(ImageStats &stats, int mipLevel=0);
+      // channel < 0 bins pixels luminance (Color::luminance weights),
+      // previous counts are cleared
+      bool computeHistogram(Histogram &hist, int channel=-1, int mipLevel=0);
+      
+      // Orientation operations apply to all faces and mip levels
+      // 3D images are processed slice by slice
+      // They move stored pixels and ignore the orientation flags
+      void flipHorizontally();
+      void flipVertically();
+      void transpose();
+      void rotateCW();
+      void rotateCCW();
+      
+      // Physically re-order pixels so that orientation becomes ORIENT_NORMAL
+      void normalizeOrientation();
       
       inline bool is1D() const {
         return mMaxHeight==1 && mMaxDepth==1;
@@ -116,14 +225,36 @@ namespace gimg {
       inline int getNumMipmaps() const {
         return mNumMipmaps;
       }
+      // Dimensions and byte sizes of the allocated levels
+      inline const MipLayout& getLayout() const {
+        return mLayout;
+      }
+      inline bool isPlanar() const {
+        return mPlanar;
+      }
+      inline int getOrientation() const {
+        return mOrientation;
+      }
+      // Readers set this instead of re-ordering decoded pixels
+      inline void setOrientation(int orient) {
+        mOrientation = orient;
+      }
     
+    protected:
+      
+      void rotate(int rot);
+      void premultLevels(bool unpremult, int firstLevel);
+      
     protected:
       
       int mMaxWidth;
       int mMaxHeight;
       int mMaxDepth;
       int mNumMipmaps;
+      int mOrientation;
+      bool mPlanar;
       PixelDesc mDesc;
+      MipLayout mLayout;
       
       struct MipLevel {
         void* data;
@@ -0,0 +1,140 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_lut_h_
+#define __gimg_lut_h_
+
+#include <gimg/color.h>
+#include <gcore/path.h>
+#include <vector>
+
+namespace gimg {
+  
+  // Per pixel color transform sampled by Lut3D
+  // apply may be called concurrently and must be thread safe
+  class GIMG_API ColorTransform {
+    public:
+      
+      ColorTransform();
+      virtual ~ColorTransform();
+      
+      virtual Color apply(const Color &c) const = 0;
+  };
+  
+  // Transforms applied in insertion order (not owned)
+  class GIMG_API ColorTransformChain : public ColorTransform {
+    public:
+      
+      ColorTransformChain();
+      virtual ~ColorTransformChain();
+      
+      void append(const ColorTransform *xf);
+      void clear();
+      
+      inline size_t size() const {
+        return mTransforms.size();
+      }
+      
+      virtual Color apply(const Color &c) const;
+      
+    protected:
+      
+      std::vector<const ColorTransform*> mTransforms;
+  };
+  
+  // size^3 RGB lattice over the [min, max] input domain ([0, 1] by default)
+  // Common sizes are 17, 33 and 65, 2 to 256 are accepted
+  //
+  // Lookups use tetrahedral interpolation, inputs are clamped to the domain
+  // Alpha goes through unchanged
+  class GIMG_API Lut3D {
+    public:
+      
+      enum {
+        MIN_SIZE = 2,
+        MAX_SIZE = 256
+      };
+      
+    public:
+      
+      // identity lattice
+      Lut3D(int size=33);
+      Lut3D(const Lut3D &rhs);
+      ~Lut3D();
+      
+      Lut3D& operator=(const Lut3D &rhs);
+      
+      // resets to identity
+      bool resize(int size);
+      void setIdentity();
+      
+      // domain changes keep the lattice values
+      void setDomain(const Color &domainMin, const Color &domainMax);
+      
+      // evaluate xf at every lattice point (in parallel when built with OpenMP)
+      void sample(const ColorTransform &xf);
+      
+      Color getEntry(int r, int g, int b) const;
+      void setEntry(int r, int g, int b, const Color &c);
+      
+      Color lookup(const Color &c) const;
+      
+      // In place lookup of count colors stored as separate R, G and B arrays
+      // (4 at a time with SSE2, no threading)
+      void lookup(float *r, float *g, float *b, size_t count) const;
+      
+      // Transform count PF_RGB or PF_RGBA pixels of any plain type
+      // src and dst may be the same buffer
+      // Pixels are processed 4 at a time with SSE2 when available, in
+      // parallel chunks when built with OpenMP
+      bool apply(const void *src, void *dst, const PixelDesc &desc, size_t count) const;
+      
+      // Adobe/Resolve .cube text format (LUT_3D_SIZE, DOMAIN_MIN, DOMAIN_MAX)
+      bool read(const gcore::Path &filepath);
+      bool write(const gcore::Path &filepath, const char *title=0) const;
+      
+      inline int getSize() const {
+        return mSize;
+      }
+      inline const Color& getDomainMin() const {
+        return mDomainMin;
+      }
+      inline const Color& getDomainMax() const {
+        return mDomainMax;
+      }
+      // size^3 RGBA float entries (A unused), red index varying fastest
+      inline const float* getTable() const {
+        return mTable;
+      }
+      
+    protected:
+      
+      int mSize;
+      float *mTable;
+      Color mDomainMin;
+      Color mDomainMax;
+  };
+  
+}
+
+#endif
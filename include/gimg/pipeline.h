@@ -0,0 +1,138 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+
+#ifndef __gimg_pipeline_h_
+#define __gimg_pipeline_h_
+
+#include <gimg/lut.h>
+#include <gimg/colorspace.h>
+#include <vector>
+
+namespace gimg {
+  
+  // Chain of per pixel color operations run in a single pass
+  //
+  // Pixels are loaded by blocks of 256 as float R, G, B and A arrays, every
+  // operation runs on the block while it stays in cache before it is stored
+  // back, so that a chain of N operations costs one traversal of the pixels
+  // Operations work on 4 values at a time with SSE2 when available
+  //
+  // Operations follow Color semantics: they transform R, G and B, alpha is
+  // left untouched (ColorTransform excepted)
+  // Consecutive linear operations (exposure, multiplyAdd, grade) are folded
+  // into a single multiply-add when appended
+  //
+  // Lookup tables and transforms are not owned and must outlive the pipeline
+  class GIMG_API PixelPipeline : public ColorTransform {
+    public:
+      
+      PixelPipeline();
+      virtual ~PixelPipeline();
+      
+      // colors scaled by 2^stops
+      void exposure(float stops);
+      // mul * rgb + add (see MultiplyAdd in gimg/color.h)
+      void multiplyAdd(const Color &mul, const Color &add);
+      // Color::grade (as a multiply-add, equal up to rounding)
+      void grade(const Color &black, const Color &white, const Color &lift, const Color &gain);
+      // lerp from Color::luminance (0) to the color (1), > 1 saturates
+      void saturation(float s);
+      // positive values raised to 1 / g (relative error below 2e-6,
+      // infinity is read as the largest float), others are unchanged
+      void gamma(float g);
+      // NaNs clamp to minValue
+      void clamp(float minValue=0.0f, float maxValue=1.0f);
+      // Lut3D::lookup
+      void lut(const Lut3D *table);
+      // evaluated per pixel, alpha included
+      void transform(const ColorTransform *xf);
+      // rgb = m * rgb, m is row major (consecutive matrices are folded)
+      void matrix(const float m[9]);
+      // transfer function to linear values, and back (same pow accuracy as
+      // gamma), values below the linear segment end follow its line
+      void decode(TransferFunction tf);
+      void encode(TransferFunction tf);
+      // decode, primaries matrix and encode (see ConvertColorSpace)
+      bool colorSpace(ColorSpace from, ColorSpace to);
+      
+      void clear();
+      
+      inline size_t size() const {
+        return mOps.size();
+      }
+      
+      // Run the operations on a single color (same results as the pixel
+      // version), allows baking a pipeline in a Lut3D (see Lut3D::sample)
+      virtual Color apply(const Color &c) const;
+      
+      // Run the operations on count pixels of any plain or packed type
+      // (integer channels are normalized, see ConvertPixels)
+      // Luminance is processed as gray RGB and stored back with
+      // Color::luminance weights, integer results are clamped
+      // src and dst may be the same buffer
+      // Chunks of pixels are processed in parallel when built with OpenMP
+      bool apply(const void *src, void *dst, const PixelDesc &desc, size_t count) const;
+      
+    public:
+      
+      enum OpType {
+        OP_MULTIPLY_ADD = 0,
+        OP_SATURATION,
+        OP_GAMMA,
+        OP_CLAMP,
+        OP_LUT,
+        OP_TRANSFORM,
+        OP_MATRIX,
+        OP_DECODE,
+        OP_ENCODE
+      };
+      
+      struct Op {
+        OpType type;
+        // multiply-add per RGB channel, saturation in mul[0],
+        // 1 / gamma in mul[0], clamp range in mul[0] and add[0]
+        float mul[3];
+        float add[3];
+        float matrix[9];
+        TransferFunction transfer;
+        const Lut3D *lut;
+        const ColorTransform *xf;
+      };
+      
+      inline const std::vector<Op>& getOps() const {
+        return mOps;
+      }
+      
+    protected:
+      
+      void append(const Op &op);
+      
+    protected:
+      
+      std::vector<Op> mOps;
+  };
+  
+}
+
+#endif
@@ -0,0 +1,301 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_pixeltraits_h_
+#define __gimg_pixeltraits_h_
+
+#include <gimg/format.h>
+#include <gimg/half.h>
+#include <cmath>
+
+namespace gimg {
+
+  // Compile time description of plain channel types
+  //
+  //   Type       C type of a channel (Half and 16 bits integers share it)
+  //   Size       bytes per channel
+  //   Float      1 for PT_FLOAT_16 and PT_FLOAT_32
+  //   Native     1 if Type arithmetic gives channel values (0 for half)
+  //   One()      normalized 1 (max integer value)
+  //   Luminance  0.3 R + 0.59 G + 0.11 B in channel units
+  //   Average    2x2 box average used by mipmapping
+  //   ToDouble   channel units, integers are not normalized
+  //   FromDouble rounds and clamps to the integer range
+
+  template <PixelType T>
+  struct ChannelTraits;
+
+  template <>
+  struct ChannelTraits<PT_INT_8> {
+    typedef unsigned char Type;
+    enum {
+      Size = 1,
+      Float = 0,
+      Native = 1
+    };
+    static inline Type One() {
+      return 0xFF;
+    }
+    static inline Type Luminance(Type r, Type g, Type b) {
+      // 8 bits fixed point weights (sum to 256)
+      return (Type)((77u * r + 151u * g + 28u * b + 128u) >> 8);
+    }
+    static inline Type Average(Type a, Type b, Type c, Type d) {
+      return (Type)((((unsigned int)a + b) / 2 + ((unsigned int)c + d) / 2) / 2);
+    }
+    static inline double ToDouble(Type v) {
+      return double(v);
+    }
+    static inline Type FromDouble(double v) {
+      v = floor(v + 0.5);
+      return (Type)(v > 255.0 ? 255.0 : (v < 0.0 ? 0.0 : v));
+    }
+  };
+
+  template <>
+  struct ChannelTraits<PT_INT_16> {
+    typedef unsigned short Type;
+    enum {
+      Size = 2,
+      Float = 0,
+      Native = 1
+    };
+    static inline Type One() {
+      return 0xFFFF;
+    }
+    static inline Type Luminance(Type r, Type g, Type b) {
+      // 16 bits fixed point weights (sum to 65536)
+      return (Type)((19661u * r + 38666u * g + 7209u * b + 32768u) >> 16);
+    }
+    static inline Type Average(Type a, Type b, Type c, Type d) {
+      return (Type)((((unsigned int)a + b) / 2 + ((unsigned int)c + d) / 2) / 2);
+    }
+    static inline double ToDouble(Type v) {
+      return double(v);
+    }
+    static inline Type FromDouble(double v) {
+      v = floor(v + 0.5);
+      return (Type)(v > 65535.0 ? 65535.0 : (v < 0.0 ? 0.0 : v));
+    }
+  };
+
+  template <>
+  struct ChannelTraits<PT_INT_32> {
+    typedef unsigned int Type;
+    enum {
+      Size = 4,
+      Float = 0,
+      Native = 1
+    };
+    static inline Type One() {
+      return 0xFFFFFFFF;
+    }
+    static inline Type Luminance(Type r, Type g, Type b) {
+      double l = 0.3 * r + 0.59 * g + 0.11 * b + 0.5;
+      return (l >= 4294967295.0 ? 0xFFFFFFFF : (Type)l);
+    }
+    static inline Type Average(Type a, Type b, Type c, Type d) {
+      return (Type) floor(((double(a) + double(b)) / 2.0 + (double(c) + double(d)) / 2.0) / 2.0);
+    }
+    static inline double ToDouble(Type v) {
+      return double(v);
+    }
+    static inline Type FromDouble(double v) {
+      v = floor(v + 0.5);
+      return (Type)(v > 4294967295.0 ? 4294967295.0 : (v < 0.0 ? 0.0 : v));
+    }
+  };
+
+  template <>
+  struct ChannelTraits<PT_FLOAT_16> {
+    typedef Half Type;
+    enum {
+      Size = 2,
+      Float = 1,
+      Native = 0
+    };
+    static inline Type One() {
+      return 0x3C00;
+    }
+    static inline Type Luminance(Type r, Type g, Type b) {
+      return FloatToHalf(0.3f * HalfToFloat(r) + 0.59f * HalfToFloat(g) + 0.11f * HalfToFloat(b));
+    }
+    static inline Type Average(Type a, Type b, Type c, Type d) {
+      return FloatToHalf(((HalfToFloat(a) + HalfToFloat(b)) / 2.0f +
+                          (HalfToFloat(c) + HalfToFloat(d)) / 2.0f) / 2.0f);
+    }
+    static inline double ToDouble(Type v) {
+      return double(HalfToFloat(v));
+    }
+    static inline Type FromDouble(double v) {
+      return FloatToHalf(float(v));
+    }
+  };
+
+  template <>
+  struct ChannelTraits<PT_FLOAT_32> {
+    typedef float Type;
+    enum {
+      Size = 4,
+      Float = 1,
+      Native = 1
+    };
+    static inline Type One() {
+      return 1.0f;
+    }
+    static inline Type Luminance(Type r, Type g, Type b) {
+      return (0.3f * r + 0.59f * g + 0.11f * b);
+    }
+    static inline Type Average(Type a, Type b, Type c, Type d) {
+      return ((a + b) / 2.0f + (c + d) / 2.0f) / 2.0f;
+    }
+    static inline double ToDouble(Type v) {
+      return double(v);
+    }
+    static inline Type FromDouble(double v) {
+      return Type(v);
+    }
+  };
+
+  // Compile time description of pixel formats
+  //
+  //   NumChannels  channels per pixel
+  //   Alpha        index of the alpha channel, -1 if none
+
+  template <PixelFormat F>
+  struct FormatTraits {
+    enum {
+      NumChannels = 1,
+      Alpha = -1
+    };
+  };
+
+  template <>
+  struct FormatTraits<PF_A> {
+    enum {
+      NumChannels = 1,
+      Alpha = 0
+    };
+  };
+
+  template <>
+  struct FormatTraits<PF_LUMINANCE_ALPHA> {
+    enum {
+      NumChannels = 2,
+      Alpha = 1
+    };
+  };
+
+  template <>
+  struct FormatTraits<PF_RGB> {
+    enum {
+      NumChannels = 3,
+      Alpha = -1
+    };
+  };
+
+  template <>
+  struct FormatTraits<PF_RGBA> {
+    enum {
+      NumChannels = 4,
+      Alpha = 3
+    };
+  };
+
+  template <>
+  struct FormatTraits<PF_RG> {
+    enum {
+      NumChannels = 2,
+      Alpha = -1
+    };
+  };
+
+  // Plain pixel (format, type) pair
+
+  template <PixelFormat F, PixelType T>
+  struct PixelTraits {
+    typedef ChannelTraits<T> Channel;
+    typedef typename Channel::Type Type;
+    enum {
+      NumChannels = FormatTraits<F>::NumChannels,
+      Alpha = FormatTraits<F>::Alpha,
+      Size = NumChannels * Channel::Size
+    };
+  };
+
+  // Call K<F, T>::Run(args) with the format and type of a plain PixelDesc,
+  // instantiating K for every plain pair
+  // Returns false for packed and compressed types
+
+  template <template <PixelFormat, PixelType> class K, PixelFormat F, typename A>
+  inline bool DispatchPlainType(PixelType type, A &args) {
+    switch (type) {
+    case PT_INT_8:
+      K<F, PT_INT_8>::Run(args);
+      return true;
+    case PT_INT_16:
+      K<F, PT_INT_16>::Run(args);
+      return true;
+    case PT_INT_32:
+      K<F, PT_INT_32>::Run(args);
+      return true;
+    case PT_FLOAT_16:
+      K<F, PT_FLOAT_16>::Run(args);
+      return true;
+    case PT_FLOAT_32:
+      K<F, PT_FLOAT_32>::Run(args);
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  template <template <PixelFormat, PixelType> class K, typename A>
+  inline bool DispatchPlain(const PixelDesc &desc, A &args) {
+    switch (desc.getFormat()) {
+    case PF_LUMINANCE:
+      return DispatchPlainType<K, PF_LUMINANCE>(desc.getType(), args);
+    case PF_R:
+      return DispatchPlainType<K, PF_R>(desc.getType(), args);
+    case PF_G:
+      return DispatchPlainType<K, PF_G>(desc.getType(), args);
+    case PF_B:
+      return DispatchPlainType<K, PF_B>(desc.getType(), args);
+    case PF_A:
+      return DispatchPlainType<K, PF_A>(desc.getType(), args);
+    case PF_LUMINANCE_ALPHA:
+      return DispatchPlainType<K, PF_LUMINANCE_ALPHA>(desc.getType(), args);
+    case PF_RGB:
+      return DispatchPlainType<K, PF_RGB>(desc.getType(), args);
+    case PF_RGBA:
+      return DispatchPlainType<K, PF_RGBA>(desc.getType(), args);
+    case PF_RG:
+      return DispatchPlainType<K, PF_RG>(desc.getType(), args);
+    default:
+      return false;
+    }
+  }
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_stats_h_
+#define __gimg_stats_h_
+
+#include <gimg/config.h>
+#include <vector>
+#include <cstddef>
+
+namespace gimg {
+  
+  // Per channel statistics of normalized values (integer channels map to
+  // [0, 1], see ConvertPixels), channels in pixel format order
+  // variance is the population variance
+  struct GIMG_API ImageStats {
+    int numChannels;
+    size_t count;
+    float min[4];
+    float max[4];
+    double mean[4];
+    double variance[4];
+    
+    ImageStats();
+  };
+  
+  // numBins bins evenly spread over [minValue, maxValue], or over
+  // [log2(minValue), log2(maxValue)] with logScale (minValue must be > 0)
+  // Values out of range (and NaNs) are counted in the first or last bin
+  class GIMG_API Histogram {
+    public:
+      
+      Histogram(int numBins=256, float minValue=0.0f, float maxValue=1.0f, bool logScale=false);
+      Histogram(const Histogram &rhs);
+      ~Histogram();
+      
+      Histogram& operator=(const Histogram &rhs);
+      
+      // also clears counts
+      bool reset(int numBins, float minValue, float maxValue, bool logScale=false);
+      void clear();
+      
+      // count values[0], values[stride], ... (count values)
+      // linear histograms bin 4 values at a time with SSE2 when available
+      void add(const float *values, size_t count, size_t stride=1);
+      // rhs must have the same bins
+      bool merge(const Histogram &rhs);
+      
+      // value below which a fraction p of the counted values fall,
+      // interpolated linearly (logarithmically with logScale) in its bin
+      float percentile(float p) const;
+      
+      // lower edge of a bin (numBins gives maxValue)
+      float getBinValue(int bin) const;
+      
+      inline int getNumBins() const {
+        return int(mCounts.size());
+      }
+      inline size_t getCount(int bin) const {
+        return mCounts[bin];
+      }
+      inline size_t getTotal() const {
+        return mTotal;
+      }
+      inline float getMinValue() const {
+        return mMinValue;
+      }
+      inline float getMaxValue() const {
+        return mMaxValue;
+      }
+      inline bool isLogScale() const {
+        return mLogScale;
+      }
+      
+    protected:
+      
+      std::vector<size_t> mCounts;
+      size_t mTotal;
+      float mMinValue;
+      float mMaxValue;
+      bool mLogScale;
+      // bin space: (value - mOffset) * mScale, logs for log scale
+      float mOffset;
+      float mScale;
+  };
+  
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_tonemap_h_
+#define __gimg_tonemap_h_
+
+#include <gimg/format.h>
+
+namespace gimg {
+  
+  enum ToneMapOperator {
+    // clamp to [0, 1]
+    TONEMAP_CLAMP = 0,
+    // Reinhard L / (1 + L) on luminance (Color::luminance weights),
+    // extended with L (1 + L / white^2) / (1 + L) when whitePoint > 0
+    TONEMAP_REINHARD,
+    // Hable filmic curve per channel, normalized so that whitePoint maps
+    // to 1 (11.2 when whitePoint <= 0)
+    TONEMAP_FILMIC
+  };
+  
+  struct GIMG_API ToneMapSettings {
+    ToneMapOperator op;
+    // in stops, colors are scaled by 2^exposure before the operator
+    float exposure;
+    // display gamma, values are raised to 1 / gamma after the operator
+    float gamma;
+    float whitePoint;
+    // CONVERT_DITHER or CONVERT_DITHER_BLUE_NOISE (gimg/convert.h) dither
+    // the 8 bits quantization of colors, 0 rounds to nearest
+    int dither;
+    
+    ToneMapSettings(ToneMapOperator op=TONEMAP_CLAMP, float exposure=0.0f,
+                    float gamma=2.2f, float whitePoint=0.0f, int dither=0);
+  };
+  
+  // Tone map count pixels of any plain or packed srcDesc (integer channels
+  // are normalized first) to PF_RGB or PF_RGBA 8 bits pixels
+  //
+  // Missing source channels follow ConvertPixels rules, alpha is clamped
+  // and not tone mapped, negative and NaN colors map to 0
+  // The operators run on 4 values at a time with SSE2 when available, the
+  // gamma encoding goes through a 16 bits table (results within one code of
+  // pow), chunks of pixels are processed in parallel when built with OpenMP
+  //
+  // Dithering adds the pattern threshold to the encoded value (interpolated
+  // between codes) before truncation, x and y are the image position of the
+  // first pixel as in ConvertPixels
+  GIMG_API bool ToneMapPixels(const void *src, const PixelDesc &srcDesc,
+                              void *dst, const PixelDesc &dstDesc,
+                              size_t count, const ToneMapSettings &settings,
+                              int x=0, int y=0);
+  
+}
+
+#endif
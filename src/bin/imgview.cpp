@@ -33,7 +33,8 @@ GLenum GLformats[gimg::PF_MAX] = {
   GL_ALPHA,            // PF_A
   GL_LUMINANCE_ALPHA,  // PF_LUMINANCE_ALPHA
   GL_RGB,              // PF_RGB
-  GL_RGBA              // PF_RGBA
+  GL_RGBA,             // PF_RGBA
+  GL_RG                // PF_RG
 };
 
 GLenum GLinternalFormats[gimg::PF_MAX][gimg::PT_MAX] = {
@@ -172,6 +173,23 @@ GLenum GLinternalFormats[gimg::PF_MAX][gimg::PT_MAX] = {
     0,
     0,
     0
+  },
+  { // PF_RG
+    GL_RG8,       // PT_INT_8
+    GL_RG16,      // PT_INT_16
+    GL_RG32UI,    // PT_INT_32
+    GL_RG16F,     // PT_FLOAT_16
+    GL_RG32F,     // PT_FLOAT_32
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0,
+    0
   }
 };
 
@@ -659,6 +677,11 @@ int main(int argc, char **argv) {
     ApplicationData data;
     gData = &data;
     
+    // flips are handled with texture coordinates, GL cannot transpose for us
+    if ((img->getOrientation() & gimg::Image::ORIENT_TRANSPOSE) != 0) {
+      img->normalizeOrientation();
+    }
+    
     // some size get not display properly... 1323x1052
     
     if (scale < 1 || scale > 1 || w != 0 || h != 0) {
@@ -702,14 +725,24 @@ int main(int argc, char **argv) {
     data.quad[3].x = 0.0f;
     data.quad[3].y = data.height;
     data.quad[3].z = 0.0f;  
-    data.quad[0].u = 0.0f;
-    data.quad[0].v = 1.0f;
-    data.quad[1].u = 1.0f;
-    data.quad[1].v = 1.0f;
-    data.quad[2].u = 1.0f;
-    data.quad[2].v = 0.0f;
-    data.quad[3].u = 0.0f;
-    data.quad[3].v = 0.0f;
+    float u0 = 0.0f, u1 = 1.0f;
+    float v0 = 0.0f, v1 = 1.0f;
+    if ((img->getOrientation() & gimg::Image::ORIENT_FLIP_X) != 0) {
+      u0 = 1.0f;
+      u1 = 0.0f;
+    }
+    if ((img->getOrientation() & gimg::Image::ORIENT_FLIP_Y) != 0) {
+      v0 = 1.0f;
+      v1 = 0.0f;
+    }
+    data.quad[0].u = u0;
+    data.quad[0].v = v1;
+    data.quad[1].u = u1;
+    data.quad[1].v = v1;
+    data.quad[2].u = u1;
+    data.quad[2].v = v0;
+    data.quad[3].u = u0;
+    data.quad[3].v = v0;
   
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_RGBA|GLUT_DEPTH|GLUT_DOUBLE);
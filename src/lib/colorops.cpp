@@ -0,0 +1,387 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/color.h>
+
+#include "simd.h"
+
+// Pixels are processed in blocks of BlockSize, their R, G and B channels
+// converted to float arrays (structure of arrays), so that the kernels run
+// on 4 pixels at a time without gathers
+// Kernels mirror the Color methods operation for operation, partial groups
+// (and builds without SSE2) go through the Color methods themselves
+
+namespace gimg {
+
+  enum {
+    BlockSize = 256
+  };
+
+  struct ColorBlock {
+    float r[BlockSize];
+    float g[BlockSize];
+    float b[BlockSize];
+  };
+
+  static const float Inv255 = 1.0f / 255.0f;
+
+  static bool CheckDesc(const PixelDesc &desc) {
+    return ((desc.getFormat() == PF_RGB || desc.getFormat() == PF_RGBA) &&
+            (desc.getType() == PT_INT_8 || desc.getType() == PT_FLOAT_32));
+  }
+
+  static void LoadBlock(const void *src, const PixelDesc &desc, size_t n, ColorBlock &blk) {
+    size_t nc = desc.getNumChannels();
+
+    if (desc.getType() == PT_INT_8) {
+      const unsigned char *p = (const unsigned char*) src;
+      for (size_t i=0; i<n; ++i, p+=nc) {
+        blk.r[i] = float(p[0]) * Inv255;
+        blk.g[i] = float(p[1]) * Inv255;
+        blk.b[i] = float(p[2]) * Inv255;
+      }
+    } else {
+      const float *p = (const float*) src;
+      for (size_t i=0; i<n; ++i, p+=nc) {
+        blk.r[i] = p[0];
+        blk.g[i] = p[1];
+        blk.b[i] = p[2];
+      }
+    }
+  }
+
+  static inline unsigned char ToInt8(float v) {
+    v = v * 255.0f + 0.5f;
+    return (unsigned char)(v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v));
+  }
+
+  // alpha is copied from src when writing to another buffer
+  static void StoreBlock(const ColorBlock &blk, size_t n, const PixelDesc &desc,
+                         const void *src, void *dst) {
+    size_t nc = desc.getNumChannels();
+    bool alpha = (nc == 4 && src != dst);
+
+    if (desc.getType() == PT_INT_8) {
+      const unsigned char *s = (const unsigned char*) src;
+      unsigned char *p = (unsigned char*) dst;
+      for (size_t i=0; i<n; ++i, p+=nc, s+=nc) {
+        p[0] = ToInt8(blk.r[i]);
+        p[1] = ToInt8(blk.g[i]);
+        p[2] = ToInt8(blk.b[i]);
+        if (alpha) {
+          p[3] = s[3];
+        }
+      }
+    } else {
+      const float *s = (const float*) src;
+      float *p = (float*) dst;
+      for (size_t i=0; i<n; ++i, p+=nc, s+=nc) {
+        p[0] = blk.r[i];
+        p[1] = blk.g[i];
+        p[2] = blk.b[i];
+        if (alpha) {
+          p[3] = s[3];
+        }
+      }
+    }
+  }
+
+  typedef void (*BlockFunc)(ColorBlock &blk, size_t n, const void *data);
+
+  static bool RunBlocks(const void *src, void *dst, const PixelDesc &desc, size_t count,
+                        BlockFunc func, const void *data=0) {
+    if (!CheckDesc(desc)) {
+      return false;
+    }
+
+    size_t pixSize = desc.getBytesPerPixel();
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned char *d = (unsigned char*) dst;
+    ColorBlock blk;
+
+    for (size_t i=0; i<count; i+=BlockSize) {
+      size_t n = (count - i < size_t(BlockSize) ? count - i : size_t(BlockSize));
+      LoadBlock(s, desc, n, blk);
+      func(blk, n, data);
+      StoreBlock(blk, n, desc, s, d);
+      s += n * pixSize;
+      d += n * pixSize;
+    }
+
+    return true;
+  }
+
+  // --- Color method fallbacks
+
+  static inline Color GetColor(const ColorBlock &blk, size_t i) {
+    return Color(blk.r[i], blk.g[i], blk.b[i]);
+  }
+
+  static inline void SetColor(ColorBlock &blk, size_t i, const Color &c) {
+    blk.r[i] = c.r;
+    blk.g[i] = c.g;
+    blk.b[i] = c.b;
+  }
+
+  static void ToHSVScalar(ColorBlock &blk, size_t first, size_t n) {
+    for (size_t i=first; i<n; ++i) {
+      SetColor(blk, i, GetColor(blk, i).toHSV());
+    }
+  }
+
+  static void FromHSVScalar(ColorBlock &blk, size_t first, size_t n) {
+    Color c;
+    for (size_t i=first; i<n; ++i) {
+      SetColor(blk, i, c.fromHSV(GetColor(blk, i)));
+    }
+  }
+
+  static void ToHSLScalar(ColorBlock &blk, size_t first, size_t n) {
+    for (size_t i=first; i<n; ++i) {
+      SetColor(blk, i, GetColor(blk, i).toHSL());
+    }
+  }
+
+  static void FromHSLScalar(ColorBlock &blk, size_t first, size_t n) {
+    Color c;
+    for (size_t i=first; i<n; ++i) {
+      SetColor(blk, i, c.fromHSL(GetColor(blk, i)));
+    }
+  }
+
+#ifdef GIMG_SSE2
+
+  static inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+
+  // hue shared by toHSV and toHSL, only meaningful where C > 0
+  static inline __m128 Hue(__m128 r, __m128 g, __m128 b, __m128 M, __m128 C) {
+    __m128 hr = _mm_div_ps(_mm_sub_ps(g, b), C);
+    __m128 hg = _mm_add_ps(_mm_div_ps(_mm_sub_ps(b, r), C), _mm_set1_ps(2.0f));
+    __m128 hb = _mm_add_ps(_mm_div_ps(_mm_sub_ps(r, g), C), _mm_set1_ps(4.0f));
+    __m128 h = Select(_mm_cmpeq_ps(M, r), hr, Select(_mm_cmpeq_ps(M, g), hg, hb));
+    h = _mm_mul_ps(h, _mm_set1_ps(60.0f / 360.0f));
+    return _mm_add_ps(h, _mm_and_ps(_mm_cmplt_ps(h, _mm_setzero_ps()), _mm_set1_ps(1.0f)));
+  }
+
+  // sector selection of fromHSV and fromHSL
+  static inline void HueToRGB(__m128 h, __m128 C, __m128 m, float *r, float *g, float *b) {
+    h = _mm_mul_ps(h, _mm_set1_ps(6.0f));
+
+    // fmodf(h, 2) - 1, truncated quotient
+    __m128 q = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(h, _mm_set1_ps(0.5f))));
+    __m128 f = _mm_sub_ps(_mm_sub_ps(h, _mm_add_ps(q, q)), _mm_set1_ps(1.0f));
+    f = _mm_andnot_ps(_mm_set1_ps(-0.0f), f);
+    __m128 X = _mm_mul_ps(C, _mm_sub_ps(_mm_set1_ps(1.0f), f));
+
+    __m128 zero = _mm_setzero_ps();
+    __m128 lt1 = _mm_cmplt_ps(h, _mm_set1_ps(1.0f));
+    __m128 lt2 = _mm_cmplt_ps(h, _mm_set1_ps(2.0f));
+    __m128 lt3 = _mm_cmplt_ps(h, _mm_set1_ps(3.0f));
+    __m128 lt4 = _mm_cmplt_ps(h, _mm_set1_ps(4.0f));
+    __m128 lt5 = _mm_cmplt_ps(h, _mm_set1_ps(5.0f));
+
+    __m128 vr = Select(lt1, C, Select(lt2, X, Select(lt4, zero, Select(lt5, X, C))));
+    __m128 vg = Select(lt1, X, Select(lt3, C, Select(lt4, X, zero)));
+    __m128 vb = Select(lt2, zero, Select(lt3, X, Select(lt5, C, X)));
+
+    _mm_storeu_ps(r, _mm_add_ps(vr, m));
+    _mm_storeu_ps(g, _mm_add_ps(vg, m));
+    _mm_storeu_ps(b, _mm_add_ps(vb, m));
+  }
+
+  static void ToHSVBlock(ColorBlock &blk, size_t n, const void *) {
+    __m128 eps = _mm_set1_ps(0.000001f);
+    size_t i = 0;
+
+    for (; i+4<=n; i+=4) {
+      __m128 r = _mm_loadu_ps(blk.r + i);
+      __m128 g = _mm_loadu_ps(blk.g + i);
+      __m128 b = _mm_loadu_ps(blk.b + i);
+
+      __m128 M = _mm_max_ps(r, _mm_max_ps(g, b));
+      __m128 m = _mm_min_ps(r, _mm_min_ps(g, b));
+      __m128 C = _mm_sub_ps(M, m);
+
+      __m128 s = _mm_and_ps(_mm_cmpge_ps(M, eps), _mm_div_ps(C, M));
+      __m128 h = _mm_and_ps(_mm_cmpge_ps(s, eps), Hue(r, g, b, M, C));
+
+      _mm_storeu_ps(blk.r + i, h);
+      _mm_storeu_ps(blk.g + i, s);
+      _mm_storeu_ps(blk.b + i, M);
+    }
+
+    ToHSVScalar(blk, i, n);
+  }
+
+  static void FromHSVBlock(ColorBlock &blk, size_t n, const void *) {
+    size_t i = 0;
+
+    for (; i+4<=n; i+=4) {
+      __m128 h = _mm_loadu_ps(blk.r + i);
+      __m128 s = _mm_loadu_ps(blk.g + i);
+      __m128 v = _mm_loadu_ps(blk.b + i);
+
+      __m128 C = _mm_mul_ps(v, s);
+
+      HueToRGB(h, C, _mm_sub_ps(v, C), blk.r + i, blk.g + i, blk.b + i);
+    }
+
+    FromHSVScalar(blk, i, n);
+  }
+
+  static void ToHSLBlock(ColorBlock &blk, size_t n, const void *) {
+    __m128 eps = _mm_set1_ps(0.000001f);
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 two = _mm_set1_ps(2.0f);
+    size_t i = 0;
+
+    for (; i+4<=n; i+=4) {
+      __m128 r = _mm_loadu_ps(blk.r + i);
+      __m128 g = _mm_loadu_ps(blk.g + i);
+      __m128 b = _mm_loadu_ps(blk.b + i);
+
+      __m128 M = _mm_max_ps(r, _mm_max_ps(g, b));
+      __m128 m = _mm_min_ps(r, _mm_min_ps(g, b));
+      __m128 C = _mm_sub_ps(M, m);
+      __m128 l = _mm_mul_ps(half, _mm_add_ps(m, M));
+
+      __m128 valid = _mm_cmpge_ps(C, eps);
+      __m128 dark = _mm_div_ps(C, _mm_mul_ps(two, l));
+      __m128 light = _mm_div_ps(C, _mm_mul_ps(two, _mm_sub_ps(_mm_set1_ps(1.0f), l)));
+      __m128 s = _mm_and_ps(valid, Select(_mm_cmple_ps(l, half), dark, light));
+      __m128 h = _mm_and_ps(valid, Hue(r, g, b, M, C));
+
+      _mm_storeu_ps(blk.r + i, h);
+      _mm_storeu_ps(blk.g + i, s);
+      _mm_storeu_ps(blk.b + i, l);
+    }
+
+    ToHSLScalar(blk, i, n);
+  }
+
+  static void FromHSLBlock(ColorBlock &blk, size_t n, const void *) {
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 two = _mm_set1_ps(2.0f);
+    size_t i = 0;
+
+    for (; i+4<=n; i+=4) {
+      __m128 h = _mm_loadu_ps(blk.r + i);
+      __m128 s = _mm_loadu_ps(blk.g + i);
+      __m128 l = _mm_loadu_ps(blk.b + i);
+
+      __m128 dark = _mm_mul_ps(_mm_mul_ps(two, l), s);
+      __m128 light = _mm_mul_ps(_mm_sub_ps(two, _mm_mul_ps(two, l)), s);
+      __m128 C = Select(_mm_cmple_ps(l, half), dark, light);
+
+      HueToRGB(h, C, _mm_sub_ps(l, _mm_mul_ps(half, C)), blk.r + i, blk.g + i, blk.b + i);
+    }
+
+    FromHSLScalar(blk, i, n);
+  }
+
+#else
+
+  static void ToHSVBlock(ColorBlock &blk, size_t n, const void *) {
+    ToHSVScalar(blk, 0, n);
+  }
+
+  static void FromHSVBlock(ColorBlock &blk, size_t n, const void *) {
+    FromHSVScalar(blk, 0, n);
+  }
+
+  static void ToHSLBlock(ColorBlock &blk, size_t n, const void *) {
+    ToHSLScalar(blk, 0, n);
+  }
+
+  static void FromHSLBlock(ColorBlock &blk, size_t n, const void *) {
+    FromHSLScalar(blk, 0, n);
+  }
+
+#endif
+
+  // plain loops on the arrays, left to the compiler to vectorize
+
+  static void MultiplyAddBlock(ColorBlock &blk, size_t n, const void *data) {
+    const Color *c = (const Color*) data;
+    const Color &mul = c[0];
+    const Color &add = c[1];
+
+    for (size_t i=0; i<n; ++i) {
+      blk.r[i] = blk.r[i] * mul.r + add.r;
+    }
+    for (size_t i=0; i<n; ++i) {
+      blk.g[i] = blk.g[i] * mul.g + add.g;
+    }
+    for (size_t i=0; i<n; ++i) {
+      blk.b[i] = blk.b[i] * mul.b + add.b;
+    }
+  }
+
+  // ---
+
+  bool RGBToHSV(const void *src, void *dst, const PixelDesc &desc, size_t count) {
+    return RunBlocks(src, dst, desc, count, ToHSVBlock);
+  }
+
+  bool HSVToRGB(const void *src, void *dst, const PixelDesc &desc, size_t count) {
+    return RunBlocks(src, dst, desc, count, FromHSVBlock);
+  }
+
+  bool RGBToHSL(const void *src, void *dst, const PixelDesc &desc, size_t count) {
+    return RunBlocks(src, dst, desc, count, ToHSLBlock);
+  }
+
+  bool HSLToRGB(const void *src, void *dst, const PixelDesc &desc, size_t count) {
+    return RunBlocks(src, dst, desc, count, FromHSLBlock);
+  }
+
+  bool MultiplyAdd(const void *src, void *dst, const PixelDesc &desc, size_t count,
+                   const Color &mul, const Color &add) {
+    Color c[2] = {mul, add};
+    return RunBlocks(src, dst, desc, count, MultiplyAddBlock, c);
+  }
+
+  bool ComputeLuminance(const void *src, const PixelDesc &desc, size_t count, float *lum) {
+    if (!CheckDesc(desc)) {
+      return false;
+    }
+
+    size_t pixSize = desc.getBytesPerPixel();
+    const unsigned char *s = (const unsigned char*) src;
+    ColorBlock blk;
+
+    for (size_t i=0; i<count; i+=BlockSize) {
+      size_t n = (count - i < size_t(BlockSize) ? count - i : size_t(BlockSize));
+      LoadBlock(s, desc, n, blk);
+      for (size_t j=0; j<n; ++j) {
+        lum[i+j] = 0.3f * blk.r[j] + 0.59f * blk.g[j] + 0.11f * blk.b[j];
+      }
+      s += n * pixSize;
+    }
+
+    return true;
+  }
+
+}
@@ -0,0 +1,234 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+
+#include <gimg/colorspace.h>
+#include <gimg/pipeline.h>
+#include <gimg/image.h>
+#include <iostream>
+
+// RGB to XYZ matrices are derived from the primaries and white chromaticities
+// in double precision: columns are the primaries XYZ (Y = 1) scaled so that
+// RGB (1, 1, 1) maps to the white point
+
+namespace gimg {
+
+  struct ColorSpaceDef {
+    // xy chromaticities of R, G, B and white
+    double primaries[4][2];
+    TransferFunction transfer;
+    bool xyz;
+  };
+
+#define GIMG_REC709_PRIMARIES {{0.64, 0.33}, {0.30, 0.60}, {0.15, 0.06}, {0.3127, 0.3290}}
+#define GIMG_REC2020_PRIMARIES {{0.708, 0.292}, {0.170, 0.797}, {0.131, 0.046}, {0.3127, 0.3290}}
+#define GIMG_AP1_PRIMARIES {{0.713, 0.293}, {0.165, 0.830}, {0.128, 0.044}, {0.32168, 0.33767}}
+
+  static const ColorSpaceDef ColorSpaceDefs[COLORSPACE_MAX] = {
+    {GIMG_REC709_PRIMARIES, TRANSFER_LINEAR, false},
+    {GIMG_REC709_PRIMARIES, TRANSFER_SRGB, false},
+    {GIMG_REC709_PRIMARIES, TRANSFER_BT709, false},
+    {GIMG_REC2020_PRIMARIES, TRANSFER_LINEAR, false},
+    {GIMG_REC2020_PRIMARIES, TRANSFER_BT709, false},
+    {GIMG_AP1_PRIMARIES, TRANSFER_LINEAR, false},
+    {GIMG_REC709_PRIMARIES, TRANSFER_LINEAR, true}
+  };
+
+#undef GIMG_REC709_PRIMARIES
+#undef GIMG_REC2020_PRIMARIES
+#undef GIMG_AP1_PRIMARIES
+
+  // --- 3x3 double matrices, row major
+
+  static void MulMatrix(const double a[9], const double b[9], double out[9]) {
+    double m[9];
+    for (int r=0; r<3; ++r) {
+      for (int c=0; c<3; ++c) {
+        m[3 * r + c] = a[3 * r] * b[c] + a[3 * r + 1] * b[3 + c] + a[3 * r + 2] * b[6 + c];
+      }
+    }
+    for (int i=0; i<9; ++i) {
+      out[i] = m[i];
+    }
+  }
+
+  static void MulVector(const double m[9], const double v[3], double out[3]) {
+    double t[3];
+    for (int r=0; r<3; ++r) {
+      t[r] = m[3 * r] * v[0] + m[3 * r + 1] * v[1] + m[3 * r + 2] * v[2];
+    }
+    out[0] = t[0];
+    out[1] = t[1];
+    out[2] = t[2];
+  }
+
+  static void InvertMatrix(const double m[9], double out[9]) {
+    double c[9] = {
+      m[4] * m[8] - m[5] * m[7], m[2] * m[7] - m[1] * m[8], m[1] * m[5] - m[2] * m[4],
+      m[5] * m[6] - m[3] * m[8], m[0] * m[8] - m[2] * m[6], m[2] * m[3] - m[0] * m[5],
+      m[3] * m[7] - m[4] * m[6], m[1] * m[6] - m[0] * m[7], m[0] * m[4] - m[1] * m[3]
+    };
+    double det = m[0] * c[0] + m[1] * c[3] + m[2] * c[6];
+    for (int i=0; i<9; ++i) {
+      out[i] = c[i] / det;
+    }
+  }
+
+  static void ChromaticityToXYZ(const double xy[2], double out[3]) {
+    out[0] = xy[0] / xy[1];
+    out[1] = 1.0;
+    out[2] = (1.0 - xy[0] - xy[1]) / xy[1];
+  }
+
+  static void RGBToXYZMatrix(const ColorSpaceDef &def, double m[9]) {
+    if (def.xyz) {
+      for (int i=0; i<9; ++i) {
+        m[i] = (i % 4 == 0 ? 1.0 : 0.0);
+      }
+      return;
+    }
+
+    double p[9];
+    for (int c=0; c<3; ++c) {
+      double xyz[3];
+      ChromaticityToXYZ(def.primaries[c], xyz);
+      p[c] = xyz[0];
+      p[3 + c] = xyz[1];
+      p[6 + c] = xyz[2];
+    }
+
+    double w[3];
+    double s[3];
+    double ip[9];
+    ChromaticityToXYZ(def.primaries[3], w);
+    InvertMatrix(p, ip);
+    MulVector(ip, w, s);
+
+    for (int r=0; r<3; ++r) {
+      for (int c=0; c<3; ++c) {
+        m[3 * r + c] = p[3 * r + c] * s[c];
+      }
+    }
+  }
+
+  // Bradford adaptation of XYZ values from white src to white dst
+  static void AdaptationMatrix(const double src[2], const double dst[2], double m[9]) {
+    static const double bradford[9] = {
+       0.8951,  0.2664, -0.1614,
+      -0.7502,  1.7135,  0.0367,
+       0.0389, -0.0685,  1.0296
+    };
+    double ws[3];
+    double wd[3];
+    ChromaticityToXYZ(src, ws);
+    ChromaticityToXYZ(dst, wd);
+    MulVector(bradford, ws, ws);
+    MulVector(bradford, wd, wd);
+
+    double scale[9] = {wd[0] / ws[0], 0.0, 0.0,
+                       0.0, wd[1] / ws[1], 0.0,
+                       0.0, 0.0, wd[2] / ws[2]};
+    double inv[9];
+    InvertMatrix(bradford, inv);
+    MulMatrix(scale, bradford, m);
+    MulMatrix(inv, m, m);
+  }
+
+  static bool CheckColorSpace(ColorSpace cs) {
+    if (cs < COLORSPACE_LINEAR_REC709 || cs >= COLORSPACE_MAX) {
+      std::cerr << "Invalid color space " << int(cs) << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // ---
+
+  TransferFunction GetTransferFunction(ColorSpace cs) {
+    return (CheckColorSpace(cs) ? ColorSpaceDefs[cs].transfer : TRANSFER_LINEAR);
+  }
+
+  bool GetColorSpaceMatrix(ColorSpace src, ColorSpace dst, float m[9]) {
+    if (!CheckColorSpace(src) || !CheckColorSpace(dst)) {
+      return false;
+    }
+
+    const ColorSpaceDef &sdef = ColorSpaceDefs[src];
+    const ColorSpaceDef &ddef = ColorSpaceDefs[dst];
+
+    double toXYZ[9];
+    double fromXYZ[9];
+    double out[9];
+
+    RGBToXYZMatrix(sdef, toXYZ);
+    RGBToXYZMatrix(ddef, out);
+    InvertMatrix(out, fromXYZ);
+
+    bool adapt = (!sdef.xyz && !ddef.xyz &&
+                  (sdef.primaries[3][0] != ddef.primaries[3][0] ||
+                   sdef.primaries[3][1] != ddef.primaries[3][1]));
+
+    if (adapt) {
+      double cat[9];
+      AdaptationMatrix(sdef.primaries[3], ddef.primaries[3], cat);
+      MulMatrix(cat, toXYZ, toXYZ);
+    }
+
+    MulMatrix(fromXYZ, toXYZ, out);
+
+    for (int i=0; i<9; ++i) {
+      m[i] = float(out[i]);
+    }
+
+    return true;
+  }
+
+  bool GetLuminanceWeights(ColorSpace cs, float w[3]) {
+    if (!CheckColorSpace(cs)) {
+      return false;
+    }
+    double m[9];
+    RGBToXYZMatrix(ColorSpaceDefs[cs], m);
+    for (int c=0; c<3; ++c) {
+      w[c] = float(m[3 + c]);
+    }
+    return true;
+  }
+
+  bool ConvertColorSpace(const void *src, void *dst, const PixelDesc &desc, size_t count,
+                         ColorSpace from, ColorSpace to) {
+    PixelPipeline pipeline;
+    if (!pipeline.colorSpace(from, to)) {
+      return false;
+    }
+    return pipeline.apply(src, dst, desc, count);
+  }
+
+  void Image::convertColorSpace(ColorSpace from, ColorSpace to) {
+    PixelPipeline pipeline;
+    if (pipeline.colorSpace(from, to)) {
+      applyPipeline(pipeline);
+    }
+  }
+
+}
@@ -0,0 +1,1526 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/convert.h>
+#include <gimg/half.h>
+#include <gimg/pixeltraits.h>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include "simd.h"
+#include "tables.h"
+
+namespace gimg {
+
+  // --- Channel values
+
+  // static members so they can be used as template arguments
+  struct ChannelValue {
+
+    static inline unsigned short U8ToU16(unsigned char v) {
+      return (unsigned short)(v * 257);
+    }
+
+    static inline unsigned int U8ToU32(unsigned char v) {
+      return (unsigned int)v * 16843009u;
+    }
+
+    static inline float U8ToF32(unsigned char v) {
+      return v * (1.0f / 255.0f);
+    }
+
+    static inline unsigned char U16ToU8(unsigned short v) {
+      return (unsigned char)((v + 128u) / 257u);
+    }
+
+    static inline unsigned int U16ToU32(unsigned short v) {
+      return (unsigned int)v * 65537u;
+    }
+
+    static inline float U16ToF32(unsigned short v) {
+      return v * (1.0f / 65535.0f);
+    }
+
+    static inline unsigned char U32ToU8(unsigned int v) {
+      return (unsigned char)(v / 16843009.0 + 0.5);
+    }
+
+    static inline unsigned short U32ToU16(unsigned int v) {
+      return (unsigned short)(v / 65537.0 + 0.5);
+    }
+
+    static inline float U32ToF32(unsigned int v) {
+      return (float)(v * (1.0 / 4294967295.0));
+    }
+
+    // NaN clamps to 0 (same as the SSE2 min/max sequence)
+    static inline float Clamp01(float v) {
+      return (v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f);
+    }
+
+    static inline unsigned char F32ToU8(float v) {
+      return (unsigned char)(Clamp01(v) * 255.0f + 0.5f);
+    }
+
+    static inline unsigned short F32ToU16(float v) {
+      return (unsigned short)(Clamp01(v) * 65535.0f + 0.5f);
+    }
+
+    static inline unsigned int F32ToU32(float v) {
+      return (unsigned int)(Clamp01(v) * 4294967295.0 + 0.5);
+    }
+  };
+
+  // --- Channel type conversion kernels (n channel values)
+
+  typedef void (*ConvertTypeFunc)(const void *src, void *dst, size_t n);
+
+  template <typename S, typename D, D (*F)(S)>
+  static void convertTypeT(const void *src, void *dst, size_t n) {
+    const S *s = (const S*) src;
+    D *d = (D*) dst;
+    for (size_t i=0; i<n; ++i) {
+      d[i] = F(s[i]);
+    }
+  }
+
+#ifdef GIMG_SSE2
+
+  static void convertU8ToF32(const void *src, void *dst, size_t n) {
+    const unsigned char *s = (const unsigned char*) src;
+    float *d = (float*) dst;
+    __m128i zero = _mm_setzero_si128();
+    __m128 scl = _mm_set1_ps(1.0f / 255.0f);
+    size_t i = 0;
+    for (; i+16<=n; i+=16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+      _mm_storeu_ps(d + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scl));
+      _mm_storeu_ps(d + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scl));
+      _mm_storeu_ps(d + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scl));
+      _mm_storeu_ps(d + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scl));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::U8ToF32(s[i]);
+    }
+  }
+
+  static void convertU16ToF32(const void *src, void *dst, size_t n) {
+    const unsigned short *s = (const unsigned short*) src;
+    float *d = (float*) dst;
+    __m128i zero = _mm_setzero_si128();
+    __m128 scl = _mm_set1_ps(1.0f / 65535.0f);
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+      _mm_storeu_ps(d + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scl));
+      _mm_storeu_ps(d + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scl));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::U16ToF32(s[i]);
+    }
+  }
+
+  // clamp to [0, 1], scale and round (NaN -> 0)
+  static inline __m128i ScaleRound(__m128 v, __m128 scl) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scl), _mm_set1_ps(0.5f)));
+  }
+
+  static inline __m128i ScaleRound(const float *p, __m128 scl) {
+    return ScaleRound(_mm_loadu_ps(p), scl);
+  }
+
+  static void convertF32ToU8(const void *src, void *dst, size_t n) {
+    const float *s = (const float*) src;
+    unsigned char *d = (unsigned char*) dst;
+    __m128 scl = _mm_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i+16<=n; i+=16) {
+      __m128i a = _mm_packs_epi32(ScaleRound(s + i, scl), ScaleRound(s + i + 4, scl));
+      __m128i b = _mm_packs_epi32(ScaleRound(s + i + 8, scl), ScaleRound(s + i + 12, scl));
+      _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(a, b));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::F32ToU8(s[i]);
+    }
+  }
+
+  static void convertF32ToU16(const void *src, void *dst, size_t n) {
+    const float *s = (const float*) src;
+    unsigned short *d = (unsigned short*) dst;
+    __m128 scl = _mm_set1_ps(65535.0f);
+    // no unsigned 32 -> 16 bits pack in SSE2, bias to signed range
+    __m128i bias32 = _mm_set1_epi32(32768);
+    __m128i bias16 = _mm_set1_epi16(-32768);
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+      __m128i a = _mm_sub_epi32(ScaleRound(s + i, scl), bias32);
+      __m128i b = _mm_sub_epi32(ScaleRound(s + i + 4, scl), bias32);
+      _mm_storeu_si128((__m128i*)(d + i), _mm_xor_si128(_mm_packs_epi32(a, b), bias16));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::F32ToU16(s[i]);
+    }
+  }
+
+  static void convertU8ToU16(const void *src, void *dst, size_t n) {
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned short *d = (unsigned short*) dst;
+    size_t i = 0;
+    for (; i+16<=n; i+=16) {
+      // (v << 8) | v == v * 257
+      __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+      _mm_storeu_si128((__m128i*)(d + i), _mm_unpacklo_epi8(v, v));
+      _mm_storeu_si128((__m128i*)(d + i + 8), _mm_unpackhi_epi8(v, v));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::U8ToU16(s[i]);
+    }
+  }
+
+  static inline __m128i Div257(__m128i v) {
+    // (v + 128) / 257 == (t - (t >> 8)) >> 8 with t = v + 128
+    // saturating add is still exact for v > 65407 (result 255)
+    __m128i t = _mm_adds_epu16(v, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_sub_epi16(t, _mm_srli_epi16(t, 8)), 8);
+  }
+
+  static void convertU16ToU8(const void *src, void *dst, size_t n) {
+    const unsigned short *s = (const unsigned short*) src;
+    unsigned char *d = (unsigned char*) dst;
+    size_t i = 0;
+    for (; i+16<=n; i+=16) {
+      __m128i a = Div257(_mm_loadu_si128((const __m128i*)(s + i)));
+      __m128i b = Div257(_mm_loadu_si128((const __m128i*)(s + i + 8)));
+      _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(a, b));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::U16ToU8(s[i]);
+    }
+  }
+
+#else
+
+  static void convertU8ToF32(const void *src, void *dst, size_t n) {
+    convertTypeT<unsigned char, float, ChannelValue::U8ToF32>(src, dst, n);
+  }
+
+  static void convertU16ToF32(const void *src, void *dst, size_t n) {
+    convertTypeT<unsigned short, float, ChannelValue::U16ToF32>(src, dst, n);
+  }
+
+  static void convertF32ToU8(const void *src, void *dst, size_t n) {
+    convertTypeT<float, unsigned char, ChannelValue::F32ToU8>(src, dst, n);
+  }
+
+  static void convertF32ToU16(const void *src, void *dst, size_t n) {
+    convertTypeT<float, unsigned short, ChannelValue::F32ToU16>(src, dst, n);
+  }
+
+  static void convertU8ToU16(const void *src, void *dst, size_t n) {
+    convertTypeT<unsigned char, unsigned short, ChannelValue::U8ToU16>(src, dst, n);
+  }
+
+  static void convertU16ToU8(const void *src, void *dst, size_t n) {
+    convertTypeT<unsigned short, unsigned char, ChannelValue::U16ToU8>(src, dst, n);
+  }
+
+#endif
+
+  // Half conversions go through the array versions in gimg/half.h
+
+  static void convertF16ToF32(const void *src, void *dst, size_t n) {
+    HalfToFloat((const Half*) src, (float*) dst, n);
+  }
+
+  static void convertF32ToF16(const void *src, void *dst, size_t n) {
+    FloatToHalf((const float*) src, (Half*) dst, n);
+  }
+
+  static void convertViaF32(ConvertTypeFunc toFloat, size_t srcChanSize,
+                            ConvertTypeFunc fromFloat, size_t dstChanSize,
+                            const void *src, void *dst, size_t n) {
+    const size_t chunkSize = 1024;
+    float tmp[chunkSize];
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned char *d = (unsigned char*) dst;
+    for (size_t i=0; i<n; i+=chunkSize) {
+      size_t count = (n - i < chunkSize ? n - i : chunkSize);
+      toFloat(s, tmp, count);
+      fromFloat(tmp, d, count);
+      s += count * srcChanSize;
+      d += count * dstChanSize;
+    }
+  }
+
+  static void convertU8ToF16(const void *src, void *dst, size_t n) {
+    convertViaF32(convertU8ToF32, 1, convertF32ToF16, 2, src, dst, n);
+  }
+
+  static void convertU16ToF16(const void *src, void *dst, size_t n) {
+    convertViaF32(convertU16ToF32, 2, convertF32ToF16, 2, src, dst, n);
+  }
+
+  static void convertU32ToF16(const void *src, void *dst, size_t n) {
+    convertViaF32(convertTypeT<unsigned int, float, ChannelValue::U32ToF32>, 4, convertF32ToF16, 2, src, dst, n);
+  }
+
+  static void convertF16ToU8(const void *src, void *dst, size_t n) {
+    convertViaF32(convertF16ToF32, 2, convertF32ToU8, 1, src, dst, n);
+  }
+
+  static void convertF16ToU16(const void *src, void *dst, size_t n) {
+    convertViaF32(convertF16ToF32, 2, convertF32ToU16, 2, src, dst, n);
+  }
+
+  static void convertF16ToU32(const void *src, void *dst, size_t n) {
+    convertViaF32(convertF16ToF32, 2, convertTypeT<float, unsigned int, ChannelValue::F32ToU32>, 4, src, dst, n);
+  }
+
+  // indexed by [srcType][dstType], plain types only (same type is a copy)
+  static ConvertTypeFunc ConvertTypeFuncs[PT_FLOAT_32+1][PT_FLOAT_32+1] = {
+    // from PT_INT_8
+    {0,
+     convertU8ToU16,
+     convertTypeT<unsigned char, unsigned int, ChannelValue::U8ToU32>,
+     convertU8ToF16,
+     convertU8ToF32},
+    // from PT_INT_16
+    {convertU16ToU8,
+     0,
+     convertTypeT<unsigned short, unsigned int, ChannelValue::U16ToU32>,
+     convertU16ToF16,
+     convertU16ToF32},
+    // from PT_INT_32
+    {convertTypeT<unsigned int, unsigned char, ChannelValue::U32ToU8>,
+     convertTypeT<unsigned int, unsigned short, ChannelValue::U32ToU16>,
+     0,
+     convertU32ToF16,
+     convertTypeT<unsigned int, float, ChannelValue::U32ToF32>},
+    // from PT_FLOAT_16
+    {convertF16ToU8,
+     convertF16ToU16,
+     convertF16ToU32,
+     0,
+     convertF16ToF32},
+    // from PT_FLOAT_32
+    {convertF32ToU8,
+     convertF32ToU16,
+     convertTypeT<float, unsigned int, ChannelValue::F32ToU32>,
+     convertF32ToF16,
+     0}
+  };
+
+  // --- sRGB transfer (CONVERT_SRGB)
+
+  static double SrgbToLinear(double v) {
+    return (v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4));
+  }
+
+  // Decoding reads exact tables, built on first use
+  struct SrgbDecodeTables {
+    float u8[256];
+    float u16[65536];
+
+    SrgbDecodeTables() {
+      for (int i=0; i<256; ++i) {
+        u8[i] = float(SrgbToLinear(i / 255.0));
+      }
+      for (int i=0; i<65536; ++i) {
+        u16[i] = float(SrgbToLinear(i / 65535.0));
+      }
+    }
+  };
+
+  static const SrgbDecodeTables& GetSrgbDecodeTables() {
+    static SrgbDecodeTables tables;
+    return tables;
+  }
+
+  // Encoding computes 1.055 v^(1/2.4) - 0.055 (12.92 v up to 0.0031308) as
+  // m^(5/12) 2^(5e/12) for v = m 2^e with m in [1, 2): a degree 7 polynomial
+  // in m - 1.5 (relative error below 2e-7) and a table over the exponents of
+  // the power segment, e in [-9, 0]
+  // The scalar and SSE2 versions run the same float operations
+
+  static const float SrgbThreshold = 0.0031308f;
+
+  static const float SrgbPoly[8] = {
+    1.184053659439087f, 0.3289037048816681f, -0.06395671516656876f, 0.022505613043904305f,
+    -0.009625537320971489f, 0.004580279346555471f, -0.0027445522136986256f, 0.001501889550127089f
+  };
+
+  static const float SrgbExp2[10] = {
+    0.07432544231414795f, 0.09921256452798843f, 0.13243289291858673f, 0.1767766922712326f,
+    0.23596857488155365f, 0.31498026847839355f, 0.4204482138156891f, 0.5612310171127319f,
+    0.7491535544395447f, 1.0f
+  };
+
+  static inline float LinearToSrgb(float v) {
+    v = ChannelValue::Clamp01(v);
+    if (v <= SrgbThreshold) {
+      return v * 12.92f;
+    }
+    unsigned int bits;
+    memcpy(&bits, &v, 4);
+    int e = int(bits >> 23) - 127;
+    bits = (bits & 0x007FFFFF) | 0x3F800000;
+    float m;
+    memcpy(&m, &bits, 4);
+    float t = m - 1.5f;
+    float p = SrgbPoly[7];
+    for (int i=6; i>=0; --i) {
+      p = p * t + SrgbPoly[i];
+    }
+    return 1.055f * (p * SrgbExp2[e + 9]) - 0.055f;
+  }
+
+  static void srgbU8ToF32(const void *src, void *dst, size_t n) {
+    const float *table = GetSrgbDecodeTables().u8;
+    const unsigned char *s = (const unsigned char*) src;
+    float *d = (float*) dst;
+    for (size_t i=0; i<n; ++i) {
+      d[i] = table[s[i]];
+    }
+  }
+
+  static void srgbU16ToF32(const void *src, void *dst, size_t n) {
+    const float *table = GetSrgbDecodeTables().u16;
+    const unsigned short *s = (const unsigned short*) src;
+    float *d = (float*) dst;
+    for (size_t i=0; i<n; ++i) {
+      d[i] = table[s[i]];
+    }
+  }
+
+#ifdef GIMG_SSE2
+
+  static inline __m128 LinearToSrgb(__m128 v) {
+    __m128 thr = _mm_set1_ps(SrgbThreshold);
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128i bits = _mm_castps_si128(_mm_max_ps(v, thr));
+    // exponent table index (e + 9)
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127 - 9));
+    bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000));
+    __m128 t = _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.5f));
+    __m128 p = _mm_set1_ps(SrgbPoly[7]);
+    for (int i=6; i>=0; --i) {
+      p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(SrgbPoly[i]));
+    }
+    int idx[4];
+    _mm_storeu_si128((__m128i*)idx, e);
+    __m128 scl = _mm_set_ps(SrgbExp2[idx[3]], SrgbExp2[idx[2]], SrgbExp2[idx[1]], SrgbExp2[idx[0]]);
+    __m128 y = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.055f), _mm_mul_ps(p, scl)), _mm_set1_ps(0.055f));
+    __m128 low = _mm_cmple_ps(v, thr);
+    return _mm_or_ps(_mm_and_ps(low, _mm_mul_ps(v, _mm_set1_ps(12.92f))), _mm_andnot_ps(low, y));
+  }
+
+  static inline __m128i SrgbScaleRound(const float *p, __m128 scl) {
+    return ScaleRound(LinearToSrgb(_mm_loadu_ps(p)), scl);
+  }
+
+  static void srgbF32ToU8(const void *src, void *dst, size_t n) {
+    const float *s = (const float*) src;
+    unsigned char *d = (unsigned char*) dst;
+    __m128 scl = _mm_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i+16<=n; i+=16) {
+      __m128i a = _mm_packs_epi32(SrgbScaleRound(s + i, scl), SrgbScaleRound(s + i + 4, scl));
+      __m128i b = _mm_packs_epi32(SrgbScaleRound(s + i + 8, scl), SrgbScaleRound(s + i + 12, scl));
+      _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(a, b));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::F32ToU8(LinearToSrgb(s[i]));
+    }
+  }
+
+  static void srgbF32ToU16(const void *src, void *dst, size_t n) {
+    const float *s = (const float*) src;
+    unsigned short *d = (unsigned short*) dst;
+    __m128 scl = _mm_set1_ps(65535.0f);
+    __m128i bias32 = _mm_set1_epi32(32768);
+    __m128i bias16 = _mm_set1_epi16(-32768);
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+      __m128i a = _mm_sub_epi32(SrgbScaleRound(s + i, scl), bias32);
+      __m128i b = _mm_sub_epi32(SrgbScaleRound(s + i + 4, scl), bias32);
+      _mm_storeu_si128((__m128i*)(d + i), _mm_xor_si128(_mm_packs_epi32(a, b), bias16));
+    }
+    for (; i<n; ++i) {
+      d[i] = ChannelValue::F32ToU16(LinearToSrgb(s[i]));
+    }
+  }
+
+#else
+
+  static void srgbF32ToU8(const void *src, void *dst, size_t n) {
+    const float *s = (const float*) src;
+    unsigned char *d = (unsigned char*) dst;
+    for (size_t i=0; i<n; ++i) {
+      d[i] = ChannelValue::F32ToU8(LinearToSrgb(s[i]));
+    }
+  }
+
+  static void srgbF32ToU16(const void *src, void *dst, size_t n) {
+    const float *s = (const float*) src;
+    unsigned short *d = (unsigned short*) dst;
+    for (size_t i=0; i<n; ++i) {
+      d[i] = ChannelValue::F32ToU16(LinearToSrgb(s[i]));
+    }
+  }
+
+#endif
+
+  static void srgbU8ToF16(const void *src, void *dst, size_t n) {
+    convertViaF32(srgbU8ToF32, 1, convertF32ToF16, 2, src, dst, n);
+  }
+
+  static void srgbU16ToF16(const void *src, void *dst, size_t n) {
+    convertViaF32(srgbU16ToF32, 2, convertF32ToF16, 2, src, dst, n);
+  }
+
+  static void srgbF16ToU8(const void *src, void *dst, size_t n) {
+    convertViaF32(convertF16ToF32, 2, srgbF32ToU8, 1, src, dst, n);
+  }
+
+  static void srgbF16ToU16(const void *src, void *dst, size_t n) {
+    convertViaF32(convertF16ToF32, 2, srgbF32ToU16, 2, src, dst, n);
+  }
+
+  // indexed as ConvertTypeFuncs, null where CONVERT_SRGB does not apply
+  static ConvertTypeFunc SrgbTypeFuncs[PT_FLOAT_32+1][PT_FLOAT_32+1] = {
+    {0, 0, 0, srgbU8ToF16, srgbU8ToF32},
+    {0, 0, 0, srgbU16ToF16, srgbU16ToF32},
+    {0, 0, 0, 0, 0},
+    {srgbF16ToU8, srgbF16ToU16, 0, 0, 0},
+    {srgbF32ToU8, srgbF32ToU16, 0, 0, 0}
+  };
+
+  // Converts channel c of n pixels of nc channels with convFunc
+  // (linear alpha of sRGB conversions)
+  static void convertChannel(ConvertTypeFunc convFunc,
+                             const void *src, size_t srcChanSize,
+                             void *dst, size_t dstChanSize,
+                             size_t n, int nc, int c) {
+    const size_t chunkSize = 256;
+    unsigned char in[chunkSize * 4];
+    unsigned char out[chunkSize * 4];
+    size_t srcPixSize = nc * srcChanSize;
+    size_t dstPixSize = nc * dstChanSize;
+    const unsigned char *s = (const unsigned char*) src + c * srcChanSize;
+    unsigned char *d = (unsigned char*) dst + c * dstChanSize;
+    for (size_t i=0; i<n; i+=chunkSize) {
+      size_t count = (n - i < chunkSize ? n - i : chunkSize);
+      for (size_t k=0; k<count; ++k) {
+        memcpy(in + k * srcChanSize, s + k * srcPixSize, srcChanSize);
+      }
+      convFunc(in, out, count);
+      for (size_t k=0; k<count; ++k) {
+        memcpy(d + k * dstPixSize, out + k * dstChanSize, dstChanSize);
+      }
+      s += count * srcPixSize;
+      d += count * dstPixSize;
+    }
+  }
+
+  // --- Ordered dithering
+
+  // Threshold pattern tiled over the image, ranks in [0, size * size)
+  struct DitherPattern {
+    const unsigned int *ranks;
+    int size;
+  };
+
+  // 4x4 Bayer matrix
+  static const unsigned int BayerMatrix[4][4] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5}
+  };
+
+  enum {
+    BlueNoiseSize = 64,
+    // gaussian filter truncated to a (2 * radius + 1)^2 window
+    BlueNoiseRadius = 6
+  };
+
+  // Ulichney's void and cluster method: the energy of a binary pattern
+  // (gaussian filtered, sigma 1.5, wrapping around) locates its tightest
+  // cluster and largest void. The initial pattern is relaxed by moving
+  // cluster pixels to voids, then pixels are ranked as they are removed
+  // from it (clusters first) and added to it (voids first)
+  // Deterministic: fixed seed, the first pixel wins ties
+  struct BlueNoise {
+    unsigned int ranks[BlueNoiseSize * BlueNoiseSize];
+    BlueNoise();
+  };
+
+  static void SplatEnergy(std::vector<double> &energy, const std::vector<double> &kernel, int p, double sign) {
+    const int size = BlueNoiseSize;
+    const int r = BlueNoiseRadius;
+    int px = p % size;
+    int py = p / size;
+    for (int dy=-r; dy<=r; ++dy) {
+      double *row = &energy[((py + dy) & (size - 1)) * size];
+      const double *k = &kernel[(dy + r) * (2 * r + 1) + r];
+      for (int dx=-r; dx<=r; ++dx) {
+        row[(px + dx) & (size - 1)] += sign * k[dx];
+      }
+    }
+  }
+
+  // highest energy set pixel (cluster) or lowest energy unset pixel (void)
+  static int FindExtremum(const std::vector<double> &energy, const std::vector<unsigned char> &bits, bool cluster) {
+    unsigned char state = (cluster ? 1 : 0);
+    int best = -1;
+    for (int i=0; i<int(energy.size()); ++i) {
+      if (bits[i] == state &&
+          (best < 0 || (cluster ? energy[i] > energy[best] : energy[i] < energy[best]))) {
+        best = i;
+      }
+    }
+    return best;
+  }
+
+  BlueNoise::BlueNoise() {
+    const int n = BlueNoiseSize * BlueNoiseSize;
+    const int r = BlueNoiseRadius;
+    const int w = 2 * r + 1;
+    const double sigma = 1.5;
+
+    std::vector<double> kernel(w * w);
+    for (int dy=-r; dy<=r; ++dy) {
+      for (int dx=-r; dx<=r; ++dx) {
+        kernel[(dy + r) * w + dx + r] = exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+      }
+    }
+
+    std::vector<double> energy(n, 0.0);
+    std::vector<unsigned char> bits(n, 0);
+
+    // 10% of the pixels set at random
+    const int ones = n / 10;
+    unsigned int seed = 0x2545F491u;
+    for (int placed=0; placed<ones;) {
+      seed = seed * 1664525u + 1013904223u;
+      int p = int((seed >> 8) % unsigned(n));
+      if (!bits[p]) {
+        bits[p] = 1;
+        SplatEnergy(energy, kernel, p, 1.0);
+        ++placed;
+      }
+    }
+
+    // relax: move the tightest cluster pixel to the largest void until it
+    // is the largest void itself
+    for (int iter=0; iter<n; ++iter) {
+      int c = FindExtremum(energy, bits, true);
+      bits[c] = 0;
+      SplatEnergy(energy, kernel, c, -1.0);
+      int v = FindExtremum(energy, bits, false);
+      bits[v] = 1;
+      SplatEnergy(energy, kernel, v, 1.0);
+      if (v == c) {
+        break;
+      }
+    }
+
+    std::vector<double> initialEnergy(energy);
+    std::vector<unsigned char> initialBits(bits);
+
+    for (int rank=ones-1; rank>=0; --rank) {
+      int c = FindExtremum(energy, bits, true);
+      bits[c] = 0;
+      SplatEnergy(energy, kernel, c, -1.0);
+      ranks[c] = (unsigned int) rank;
+    }
+
+    energy = initialEnergy;
+    bits = initialBits;
+
+    for (int rank=ones; rank<n; ++rank) {
+      int v = FindExtremum(energy, bits, false);
+      bits[v] = 1;
+      SplatEnergy(energy, kernel, v, 1.0);
+      ranks[v] = (unsigned int) rank;
+    }
+  }
+
+  const unsigned int* GetDitherPattern(int flags, int *size) {
+    if ((flags & CONVERT_DITHER_BLUE_NOISE) != 0) {
+      static BlueNoise blueNoise;
+      if (size) {
+        *size = BlueNoiseSize;
+      }
+      return blueNoise.ranks;
+    }
+    if ((flags & CONVERT_DITHER) != 0) {
+      if (size) {
+        *size = 4;
+      }
+      return BayerMatrix[0];
+    }
+    return 0;
+  }
+
+  static bool SelectDitherPattern(int flags, DitherPattern &pattern) {
+    pattern.ranks = GetDitherPattern(flags, &pattern.size);
+    return (pattern.ranks != 0);
+  }
+
+  // Float to 8 and 16 bits with a per value offset in [0, 1) added before
+  // truncation (0.5 rounds to nearest like convertF32ToU8/U16)
+  typedef void (*DitherTypeFunc)(const float *src, const float *offset, void *dst, size_t n);
+
+#ifdef GIMG_SSE2
+
+  static inline __m128i ScaleOffset(const float *p, const float *o, __m128 scl) {
+    __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scl), _mm_loadu_ps(o)));
+  }
+
+  static void ditherF32ToU8(const float *s, const float *o, void *dst, size_t n) {
+    unsigned char *d = (unsigned char*) dst;
+    __m128 scl = _mm_set1_ps(255.0f);
+    size_t i = 0;
+    for (; i+16<=n; i+=16) {
+      __m128i a = _mm_packs_epi32(ScaleOffset(s + i, o + i, scl), ScaleOffset(s + i + 4, o + i + 4, scl));
+      __m128i b = _mm_packs_epi32(ScaleOffset(s + i + 8, o + i + 8, scl), ScaleOffset(s + i + 12, o + i + 12, scl));
+      _mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(a, b));
+    }
+    for (; i<n; ++i) {
+      d[i] = (unsigned char)(ChannelValue::Clamp01(s[i]) * 255.0f + o[i]);
+    }
+  }
+
+  static void ditherF32ToU16(const float *s, const float *o, void *dst, size_t n) {
+    unsigned short *d = (unsigned short*) dst;
+    __m128 scl = _mm_set1_ps(65535.0f);
+    __m128i bias32 = _mm_set1_epi32(32768);
+    __m128i bias16 = _mm_set1_epi16(-32768);
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+      __m128i a = _mm_sub_epi32(ScaleOffset(s + i, o + i, scl), bias32);
+      __m128i b = _mm_sub_epi32(ScaleOffset(s + i + 4, o + i + 4, scl), bias32);
+      _mm_storeu_si128((__m128i*)(d + i), _mm_xor_si128(_mm_packs_epi32(a, b), bias16));
+    }
+    for (; i<n; ++i) {
+      d[i] = (unsigned short)(ChannelValue::Clamp01(s[i]) * 65535.0f + o[i]);
+    }
+  }
+
+  static void srgbEncodeF32(const float *s, float *d, size_t n) {
+    size_t i = 0;
+    for (; i+4<=n; i+=4) {
+      _mm_storeu_ps(d + i, LinearToSrgb(_mm_loadu_ps(s + i)));
+    }
+    for (; i<n; ++i) {
+      d[i] = LinearToSrgb(s[i]);
+    }
+  }
+
+#else
+
+  static void ditherF32ToU8(const float *s, const float *o, void *dst, size_t n) {
+    unsigned char *d = (unsigned char*) dst;
+    for (size_t i=0; i<n; ++i) {
+      d[i] = (unsigned char)(ChannelValue::Clamp01(s[i]) * 255.0f + o[i]);
+    }
+  }
+
+  static void ditherF32ToU16(const float *s, const float *o, void *dst, size_t n) {
+    unsigned short *d = (unsigned short*) dst;
+    for (size_t i=0; i<n; ++i) {
+      d[i] = (unsigned short)(ChannelValue::Clamp01(s[i]) * 65535.0f + o[i]);
+    }
+  }
+
+  static void srgbEncodeF32(const float *s, float *d, size_t n) {
+    for (size_t i=0; i<n; ++i) {
+      d[i] = LinearToSrgb(s[i]);
+    }
+  }
+
+#endif
+
+  // Dithered float (16 or 32 bits) to 8 or 16 bits conversion of n pixels of
+  // nc channels, the first one at (x, y)
+  // alpha (-1 if none) is rounded, srgb encodes the other channels first
+  static void ditherConvert(const void *src, PixelType srcType, void *dst, PixelType dstType,
+                            size_t n, int nc, int alpha, bool srgb,
+                            const DitherPattern &pattern, int x, int y) {
+    const size_t chunkSize = 256;
+    float values[chunkSize * 4];
+    float offsets[chunkSize * 4];
+    float alphas[chunkSize];
+    DitherTypeFunc ditherFunc = (dstType == PT_INT_8 ? ditherF32ToU8 : ditherF32ToU16);
+    size_t srcPixSize = nc * (srcType == PT_FLOAT_16 ? 2 : 4);
+    size_t dstPixSize = nc * (dstType == PT_INT_8 ? 1 : 2);
+    int mask = pattern.size - 1;
+    const unsigned int *row = pattern.ranks + (y & mask) * pattern.size;
+    // threshold at the center of each rank interval
+    float scale = 1.0f / float(pattern.size * pattern.size);
+    // chunkSize is a multiple of the pattern sizes, every chunk uses the
+    // same offsets
+    size_t first = (n < chunkSize ? n : chunkSize);
+    for (size_t k=0; k<first; ++k) {
+      float t = (float(row[(x + int(k)) & mask]) + 0.5f) * scale;
+      float *o = offsets + k * nc;
+      for (int c=0; c<nc; ++c) {
+        o[c] = t;
+      }
+      if (alpha >= 0) {
+        o[alpha] = 0.5f;
+      }
+    }
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned char *d = (unsigned char*) dst;
+    for (size_t i=0; i<n; i+=chunkSize) {
+      size_t count = (n - i < chunkSize ? n - i : chunkSize);
+      const float *v = (const float*) s;
+      if (srcType == PT_FLOAT_16) {
+        HalfToFloat((const Half*) s, values, count * nc);
+        v = values;
+      }
+      if (srgb) {
+        for (size_t k=0; alpha>=0 && k<count; ++k) {
+          alphas[k] = v[k * nc + alpha];
+        }
+        srgbEncodeF32(v, values, count * nc);
+        for (size_t k=0; alpha>=0 && k<count; ++k) {
+          values[k * nc + alpha] = alphas[k];
+        }
+        v = values;
+      }
+      ditherFunc(v, offsets, d, count * nc);
+      s += count * srcPixSize;
+      d += count * dstPixSize;
+    }
+  }
+
+  // --- Channel remapping (values keep their type)
+
+  // Channel types, luminance and one come from ChannelTraits (gimg/pixeltraits.h)
+
+  typedef void (*RemapFunc)(const void *src, void *dst, size_t n, const int *map, const int *lum);
+
+  // map indexes a source pixel extended with [0, one, luminance]
+  // -> SN is zero, SN+1 is one, SN+2 is luminance of source channels lum[0..2]
+  template <typename C, int SN, int DN, bool L>
+  static void remapT(const void *src, void *dst, size_t n, const int *map, const int *lum) {
+    typedef typename C::Type T;
+    const T *s = (const T*) src;
+    T *d = (T*) dst;
+    // local copies, 8 bits stores could otherwise alias the maps
+    int m[DN];
+    int l[3];
+    for (int c=0; c<DN; ++c) {
+      m[c] = map[c];
+    }
+    for (int c=0; c<3; ++c) {
+      l[c] = lum[c];
+    }
+    T ext[SN+3];
+    ext[SN] = 0;
+    ext[SN+1] = C::One();
+    ext[SN+2] = 0;
+    for (size_t i=0; i<n; ++i, s+=SN, d+=DN) {
+      for (int c=0; c<SN; ++c) {
+        ext[c] = s[c];
+      }
+      if (L) {
+        ext[SN+2] = C::Luminance(s[l[0]], s[l[1]], s[l[2]]);
+      }
+      for (int c=0; c<DN; ++c) {
+        d[c] = ext[m[c]];
+      }
+    }
+  }
+
+#define GIMG_REMAP_FUNCS(S) \
+  {{remapT<C, S, 1, false>, remapT<C, S, 1, true>},\
+   {remapT<C, S, 2, false>, remapT<C, S, 2, true>},\
+   {remapT<C, S, 3, false>, remapT<C, S, 3, true>},\
+   {remapT<C, S, 4, false>, remapT<C, S, 4, true>}}
+
+  template <typename C>
+  struct RemapFuncs {
+    static RemapFunc Get(int sn, int dn, bool lum) {
+      static RemapFunc funcs[4][4][2] = {
+        GIMG_REMAP_FUNCS(1),
+        GIMG_REMAP_FUNCS(2),
+        GIMG_REMAP_FUNCS(3),
+        GIMG_REMAP_FUNCS(4)
+      };
+      return funcs[sn-1][dn-1][lum ? 1 : 0];
+    }
+  };
+
+#undef GIMG_REMAP_FUNCS
+
+  // 8 bits RGBA <-> BGRA, the most common swizzle in image files
+  static void swapRB8(const void *src, void *dst, size_t n, const int *, const int *) {
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned char *d = (unsigned char*) dst;
+    size_t i = 0;
+#ifdef GIMG_SSE2
+    __m128i ga = _mm_set1_epi32(0xFF00FF00);
+    __m128i lo = _mm_set1_epi32(0x000000FF);
+    for (; i+4<=n; i+=4, s+=16, d+=16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)s);
+      __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), lo);
+      __m128i b = _mm_slli_epi32(_mm_and_si128(v, lo), 16);
+      _mm_storeu_si128((__m128i*)d, _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(r, b)));
+    }
+#endif
+    for (; i<n; ++i, s+=4, d+=4) {
+      unsigned char r = s[0];
+      d[0] = s[2];
+      d[1] = s[1];
+      d[2] = r;
+      d[3] = s[3];
+    }
+  }
+
+  static RemapFunc GetRemapFunc(PixelType type, int sn, int dn, bool lum) {
+    switch (type) {
+    case PT_INT_8:
+      return RemapFuncs< ChannelTraits<PT_INT_8> >::Get(sn, dn, lum);
+    case PT_INT_16:
+      return RemapFuncs< ChannelTraits<PT_INT_16> >::Get(sn, dn, lum);
+    case PT_INT_32:
+      return RemapFuncs< ChannelTraits<PT_INT_32> >::Get(sn, dn, lum);
+    case PT_FLOAT_16:
+      return RemapFuncs< ChannelTraits<PT_FLOAT_16> >::Get(sn, dn, lum);
+    case PT_FLOAT_32:
+      return RemapFuncs< ChannelTraits<PT_FLOAT_32> >::Get(sn, dn, lum);
+    default:
+      return 0;
+    }
+  }
+
+  // --- Channel mapping
+
+  enum Component {
+    COMP_NONE = -1,
+    COMP_R = 0,
+    COMP_G,
+    COMP_B,
+    COMP_A,
+    COMP_L
+  };
+
+  static const int FormatComponents[PF_MAX][4] = {
+    {COMP_L, COMP_NONE, COMP_NONE, COMP_NONE},
+    {COMP_R, COMP_NONE, COMP_NONE, COMP_NONE},
+    {COMP_G, COMP_NONE, COMP_NONE, COMP_NONE},
+    {COMP_B, COMP_NONE, COMP_NONE, COMP_NONE},
+    {COMP_A, COMP_NONE, COMP_NONE, COMP_NONE},
+    {COMP_L, COMP_A, COMP_NONE, COMP_NONE},
+    {COMP_R, COMP_G, COMP_B, COMP_NONE},
+    {COMP_R, COMP_G, COMP_B, COMP_A},
+    {COMP_R, COMP_G, COMP_NONE, COMP_NONE}
+  };
+
+  static int FindComponent(PixelFormat fmt, int comp) {
+    for (int i=0; i<4; ++i) {
+      if (FormatComponents[fmt][i] == comp) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // Fill map (see remapT) for each destination channel, returns true if
+  // luminance needs to be computed
+  static bool BuildChannelMap(PixelFormat srcFmt, PixelFormat dstFmt, const int *srcOrder,
+                              int *map, int *lum) {
+    int sn = PixelDesc(srcFmt).getNumChannels();
+    int dn = PixelDesc(dstFmt).getNumChannels();
+    bool needLum = false;
+
+    for (int c=0; c<dn; ++c) {
+
+      int comp = FormatComponents[dstFmt][c];
+      int idx = FindComponent(srcFmt, comp);
+
+      if (idx < 0) {
+        if (comp == COMP_A) {
+          map[c] = sn + 1;
+          continue;
+        } else if (comp == COMP_L) {
+          int r = FindComponent(srcFmt, COMP_R);
+          int g = FindComponent(srcFmt, COMP_G);
+          int b = FindComponent(srcFmt, COMP_B);
+          if (r >= 0 && g >= 0 && b >= 0) {
+            lum[0] = (srcOrder ? srcOrder[r] : r);
+            lum[1] = (srcOrder ? srcOrder[g] : g);
+            lum[2] = (srcOrder ? srcOrder[b] : b);
+            map[c] = sn + 2;
+            needLum = true;
+            continue;
+          }
+          // single color channel is used as is
+          idx = (r >= 0 ? r : (g >= 0 ? g : b));
+        } else {
+          idx = FindComponent(srcFmt, COMP_L);
+        }
+      }
+
+      if (idx < 0) {
+        map[c] = sn;
+      } else {
+        map[c] = (srcOrder ? srcOrder[idx] : idx);
+      }
+    }
+
+    return needLum;
+  }
+
+  // --- Packed types
+
+  // Channel sizes and positions, first channel in the most significant bits
+  // Packed values are unpacked to (and packed from) 8 bits RGB(A), or 16 bits
+  // RGBA for 10_10_10_2
+
+  template <typename W, typename C, int N, int B0, int B1, int B2, int B3>
+  struct PackedLayout {
+    typedef W Word;
+    typedef C Chan;
+    enum {
+      NC = N,
+      BITS0 = B0,
+      BITS1 = B1,
+      BITS2 = B2,
+      BITS3 = B3,
+      S3 = 0,
+      S2 = (N == 4 ? B3 : 0),
+      S1 = S2 + B2,
+      S0 = S1 + B1
+    };
+    static inline int Bits(int c) {
+      return (c == 0 ? B0 : (c == 1 ? B1 : (c == 2 ? B2 : B3)));
+    }
+    static inline int Shift(int c) {
+      return (c == 0 ? S0 : (c == 1 ? S1 : (c == 2 ? S2 : S3)));
+    }
+  };
+
+  typedef PackedLayout<unsigned char, unsigned char, 3, 3, 3, 2, 0> Layout332;
+  typedef PackedLayout<unsigned short, unsigned char, 3, 5, 6, 5, 0> Layout565;
+  typedef PackedLayout<unsigned short, unsigned char, 4, 4, 4, 4, 4> Layout4444;
+  typedef PackedLayout<unsigned short, unsigned char, 4, 5, 5, 5, 1> Layout5551;
+  typedef PackedLayout<unsigned int, unsigned char, 4, 8, 8, 8, 8> Layout8888;
+  typedef PackedLayout<unsigned int, unsigned short, 4, 10, 10, 10, 2> Layout1010102;
+
+  // v / 255 and v / 65535 without division (exact for the ranges used below)
+  static inline unsigned int Div255(unsigned int v) {
+    return ((v + 1 + (v >> 8)) >> 8);
+  }
+
+  static inline unsigned int Div65535(unsigned int v) {
+    return ((v + 1 + (v >> 16)) >> 16);
+  }
+
+  template <typename C>
+  static inline unsigned int DivMax(unsigned int v) {
+    return (sizeof(C) == 1 ? Div255(v) : Div65535(v));
+  }
+
+  // Per channel constants, so that divisions below are by constants
+  template <typename L, int C> struct PackedChannel;
+
+  template <typename L> struct PackedChannel<L, 0> {
+    enum { Shift = L::S0, MaxQ = (1 << L::BITS0) - 1 };
+  };
+
+  template <typename L> struct PackedChannel<L, 1> {
+    enum { Shift = L::S1, MaxQ = (1 << L::BITS1) - 1 };
+  };
+
+  template <typename L> struct PackedChannel<L, 2> {
+    enum { Shift = L::S2, MaxQ = (1 << L::BITS2) - 1 };
+  };
+
+  template <typename L> struct PackedChannel<L, 3> {
+    enum { Shift = L::S3, MaxQ = (1 << L::BITS3) - 1 };
+  };
+
+  template <typename L, int C>
+  static inline typename L::Chan UnpackChannel(unsigned int w) {
+    typedef PackedChannel<L, C> PC;
+    const unsigned int maxv = (sizeof(typename L::Chan) == 1 ? 0xFF : 0xFFFF);
+    unsigned int q = (w >> PC::Shift) & PC::MaxQ;
+    // round(q * maxv / maxq)
+    return (typename L::Chan)((q * maxv + PC::MaxQ / 2) / PC::MaxQ);
+  }
+
+  template <typename L, int C>
+  static inline unsigned int PackChannel(unsigned int v, unsigned int t) {
+    typedef PackedChannel<L, C> PC;
+    return (DivMax<typename L::Chan>(v * PC::MaxQ + t) << PC::Shift);
+  }
+
+  template <typename L>
+  static void unpackT(const void *src, void *dst, size_t n) {
+    typedef typename L::Word W;
+    typedef typename L::Chan C;
+    const W *s = (const W*) src;
+    C *d = (C*) dst;
+    for (size_t i=0; i<n; ++i, d+=L::NC) {
+      unsigned int w = s[i];
+      d[0] = UnpackChannel<L, 0>(w);
+      d[1] = UnpackChannel<L, 1>(w);
+      d[2] = UnpackChannel<L, 2>(w);
+      if (L::NC == 4) {
+        d[3] = UnpackChannel<L, 3>(w);
+      }
+    }
+  }
+
+  // Threshold of a rank (see DitherPattern) in channel units of maxv
+  static inline unsigned int DitherThreshold(const DitherPattern &pattern, unsigned int rank, unsigned int maxv) {
+    return ((2 * rank + 1) * maxv) / (2 * unsigned(pattern.size * pattern.size));
+  }
+
+  // x, y: position of the first pixel, used to index the dither pattern
+  // (null when not dithering)
+  // Alpha is never dithered
+  template <typename L>
+  static void packT(const void *src, void *dst, size_t n, int x, int y, const DitherPattern *dither) {
+    typedef typename L::Word W;
+    typedef typename L::Chan C;
+    const C *s = (const C*) src;
+    W *d = (W*) dst;
+    const unsigned int maxv = (sizeof(C) == 1 ? 0xFF : 0xFFFF);
+    int mask = (dither ? dither->size - 1 : 0);
+    const unsigned int *pattern = (dither ? dither->ranks + (y & mask) * dither->size : 0);
+    for (size_t i=0; i<n; ++i, s+=L::NC) {
+      unsigned int t = maxv / 2;
+      if (dither) {
+        t = DitherThreshold(*dither, pattern[(x + int(i)) & mask], maxv);
+      }
+      unsigned int w = PackChannel<L, 0>(s[0], t) | PackChannel<L, 1>(s[1], t) | PackChannel<L, 2>(s[2], t);
+      if (L::NC == 4) {
+        w |= PackChannel<L, 3>(s[3], maxv / 2);
+      }
+      d[i] = (W) w;
+    }
+  }
+
+#ifdef GIMG_SSE2
+
+  // RGBA8 <-> 8_8_8_8 is a byte swap of each 32 bits word
+  static inline __m128i ByteSwap32(__m128i v) {
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+    __m128i m = _mm_set1_epi16(0x00FF);
+    return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, m), 8), _mm_and_si128(_mm_srli_epi16(v, 8), m));
+  }
+
+  static void unpack8888(const void *src, void *dst, size_t n) {
+    const unsigned int *s = (const unsigned int*) src;
+    unsigned int *d = (unsigned int*) dst;
+    size_t i = 0;
+    for (; i+4<=n; i+=4) {
+      _mm_storeu_si128((__m128i*)(d + i), ByteSwap32(_mm_loadu_si128((const __m128i*)(s + i))));
+    }
+    unpackT<Layout8888>(s + i, d + i, n - i);
+  }
+
+  static void pack8888(const void *src, void *dst, size_t n, int, int, const DitherPattern*) {
+    unpack8888(src, dst, n);
+  }
+
+  // 4 channels, 16 bits words layouts (4_4_4_4, 5_5_5_1), 8 pixels at a time
+
+  template <typename L>
+  static void unpack16x4(const void *src, void *dst, size_t n) {
+    const unsigned short *s = (const unsigned short*) src;
+    unsigned char *d = (unsigned char*) dst;
+    __m128i mask[4], mul[4], add[4];
+    for (int c=0; c<4; ++c) {
+      // round(q * 255 / maxq) == (q * mul + add) >> 6 for 1, 4 and 5 bits
+      int bits = L::Bits(c);
+      mask[c] = _mm_set1_epi16((short)((1 << bits) - 1));
+      mul[c] = _mm_set1_epi16((short)(bits == 1 ? 255 * 64 : (bits == 4 ? 17 * 64 : 527)));
+      add[c] = _mm_set1_epi16((short)(bits == 5 ? 23 : 0));
+    }
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+      __m128i w = _mm_loadu_si128((const __m128i*)(s + i));
+      __m128i v[4];
+      for (int c=0; c<4; ++c) {
+        __m128i q = _mm_and_si128(_mm_srli_epi16(w, L::Shift(c)), mask[c]);
+        v[c] = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(q, mul[c]), add[c]), 6);
+      }
+      __m128i rg = _mm_or_si128(v[0], _mm_slli_epi16(v[1], 8));
+      __m128i ba = _mm_or_si128(v[2], _mm_slli_epi16(v[3], 8));
+      _mm_storeu_si128((__m128i*)(d + 4 * i), _mm_unpacklo_epi16(rg, ba));
+      _mm_storeu_si128((__m128i*)(d + 4 * i + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+    unpackT<L>(s + i, d + 4 * i, n - i);
+  }
+
+  template <typename L>
+  static void pack16x4(const void *src, void *dst, size_t n, int x, int y, const DitherPattern *dither) {
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned short *d = (unsigned short*) dst;
+    __m128i zero = _mm_setzero_si128();
+    // per lane (R, G, B, A, R, G, B, A) constants
+    __m128i maxq = _mm_set_epi16((short)((1 << L::Bits(3)) - 1), (short)((1 << L::Bits(2)) - 1),
+                                 (short)((1 << L::Bits(1)) - 1), (short)((1 << L::Bits(0)) - 1),
+                                 (short)((1 << L::Bits(3)) - 1), (short)((1 << L::Bits(2)) - 1),
+                                 (short)((1 << L::Bits(1)) - 1), (short)((1 << L::Bits(0)) - 1));
+    __m128i mul = _mm_set_epi16((short)(1 << L::Shift(3)), (short)(1 << L::Shift(2)),
+                                (short)(1 << L::Shift(1)), (short)(1 << L::Shift(0)),
+                                (short)(1 << L::Shift(3)), (short)(1 << L::Shift(2)),
+                                (short)(1 << L::Shift(1)), (short)(1 << L::Shift(0)));
+    // thresholds for pixels 0-1 and 2-3 of each group of 4, set once when
+    // the pattern repeats every 4 pixels
+    int mask = (dither ? dither->size - 1 : 0);
+    const unsigned int *pattern = (dither ? dither->ranks + (y & mask) * dither->size : 0);
+    bool perGroup = (dither && dither->size > 4);
+    __m128i t01 = _mm_set1_epi16(127);
+    __m128i t23 = t01;
+    __m128i one = _mm_set1_epi16(1);
+    size_t i = 0;
+    for (; i+4<=n; i+=4) {
+      if (dither && (perGroup || i == 0)) {
+        short t[4];
+        for (int k=0; k<4; ++k) {
+          t[k] = (short) DitherThreshold(*dither, pattern[(x + int(i) + k) & mask], 255);
+        }
+        t01 = _mm_set_epi16(127, t[1], t[1], t[1], 127, t[0], t[0], t[0]);
+        t23 = _mm_set_epi16(127, t[3], t[3], t[3], 127, t[2], t[2], t[2]);
+      }
+      __m128i v = _mm_loadu_si128((const __m128i*)(s + 4 * i));
+      __m128i w[2];
+      w[0] = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), maxq), t01);
+      w[1] = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), maxq), t23);
+      for (int k=0; k<2; ++k) {
+        // Div255, then shift each channel to its position (q << s == q * 2^s)
+        __m128i q = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(w[k], one), _mm_srli_epi16(w[k], 8)), 8);
+        q = _mm_mullo_epi16(q, mul);
+        // or the 4 channels of each pixel together in its low 16 bits
+        q = _mm_or_si128(q, _mm_srli_epi64(q, 16));
+        q = _mm_or_si128(q, _mm_srli_epi64(q, 32));
+        w[k] = q;
+      }
+      // gather words 0 and 4 of both vectors
+      __m128i a = _mm_shufflelo_epi16(_mm_shuffle_epi32(w[0], 0x08), 0x08);
+      __m128i b = _mm_shufflelo_epi16(_mm_shuffle_epi32(w[1], 0x08), 0x08);
+      _mm_storel_epi64((__m128i*)(d + i), _mm_unpacklo_epi32(a, b));
+    }
+    packT<L>(s + 4 * i, d + i, n - i, x + (int)i, y, dither);
+  }
+
+#else
+
+  static void unpack8888(const void *src, void *dst, size_t n) {
+    unpackT<Layout8888>(src, dst, n);
+  }
+
+  static void pack8888(const void *src, void *dst, size_t n, int x, int y, const DitherPattern *dither) {
+    packT<Layout8888>(src, dst, n, x, y, dither);
+  }
+
+  template <typename L>
+  static void unpack16x4(const void *src, void *dst, size_t n) {
+    unpackT<L>(src, dst, n);
+  }
+
+  template <typename L>
+  static void pack16x4(const void *src, void *dst, size_t n, int x, int y, const DitherPattern *dither) {
+    packT<L>(src, dst, n, x, y, dither);
+  }
+
+#endif
+
+  typedef void (*UnpackFunc)(const void *src, void *dst, size_t n);
+  typedef void (*PackFunc)(const void *src, void *dst, size_t n, int x, int y, const DitherPattern *dither);
+
+  struct PackedCodec {
+    PixelFormat format;
+    PixelType type;
+    UnpackFunc unpack;
+    PackFunc pack;
+  };
+
+  // indexed by type - PT_INT_3_3_2, format and type describe the unpacked pixels
+  static const PackedCodec PackedCodecs[] = {
+    {PF_RGB, PT_INT_8, unpackT<Layout332>, packT<Layout332>},
+    {PF_RGB, PT_INT_8, unpackT<Layout565>, packT<Layout565>},
+    {PF_RGBA, PT_INT_8, unpack16x4<Layout4444>, pack16x4<Layout4444>},
+    {PF_RGBA, PT_INT_8, unpack16x4<Layout5551>, pack16x4<Layout5551>},
+    {PF_RGBA, PT_INT_8, unpack8888, pack8888},
+    {PF_RGBA, PT_INT_16, unpackT<Layout1010102>, packT<Layout1010102>}
+  };
+
+  static bool ConvertPlain(const void *src, const PixelDesc &srcDesc,
+                           void *dst, const PixelDesc &dstDesc,
+                           size_t count, const int *srcOrder, int flags, int x, int y);
+
+  static bool ConvertPacked(const void *src, const PixelDesc &srcDesc,
+                            void *dst, const PixelDesc &dstDesc,
+                            size_t count, const int *srcOrder, int flags, int x, int y) {
+
+    if (!srcDesc.isValid() || !dstDesc.isValid()) {
+      std::cerr << "Invalid packed pixel format" << std::endl;
+      return false;
+    }
+
+    const PackedCodec *srcCodec = (srcDesc.isPacked() ? &PackedCodecs[srcDesc.getType() - PT_INT_3_3_2] : 0);
+    const PackedCodec *dstCodec = (dstDesc.isPacked() ? &PackedCodecs[dstDesc.getType() - PT_INT_3_3_2] : 0);
+
+    PixelDesc srcPlain = (srcCodec ? PixelDesc(srcCodec->format, srcCodec->type) : srcDesc);
+    PixelDesc dstPlain = (dstCodec ? PixelDesc(dstCodec->format, dstCodec->type) : dstDesc);
+
+    DitherPattern pattern;
+    const DitherPattern *dither = (SelectDitherPattern(flags, pattern) ? &pattern : 0);
+
+    // packed destinations are dithered by pack, float sources round to
+    // the unpacked type first
+    int plainFlags = flags & ~(CONVERT_DITHER | CONVERT_DITHER_BLUE_NOISE);
+
+    bool samePlain = (srcPlain.getFormat() == dstPlain.getFormat() &&
+                      srcPlain.getType() == dstPlain.getType() && srcOrder == 0);
+
+    // unpacked pixels are at most 8 bytes
+    const size_t chunkSize = 256;
+
+    unsigned char unpacked[chunkSize * 8];
+    unsigned char plain[chunkSize * 8];
+
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned char *d = (unsigned char*) dst;
+
+    size_t srcPixSize = srcDesc.getBytesPerPixel();
+    size_t dstPixSize = dstDesc.getBytesPerPixel();
+
+    for (size_t i=0; i<count; i+=chunkSize) {
+
+      size_t n = count - i;
+      if (n > chunkSize) {
+        n = chunkSize;
+      }
+
+      const void *in = s;
+
+      if (srcCodec) {
+        if (!dstCodec && samePlain) {
+          // unpack straight to destination
+          srcCodec->unpack(s, d, n);
+          s += n * srcPixSize;
+          d += n * dstPixSize;
+          continue;
+        }
+        srcCodec->unpack(s, unpacked, n);
+        in = unpacked;
+      }
+
+      if (dstCodec) {
+        const void *out = in;
+        if (!samePlain) {
+          ConvertPlain(in, srcPlain, plain, dstPlain, n, srcOrder, plainFlags, 0, 0);
+          out = plain;
+        }
+        dstCodec->pack(out, d, n, x + (int)i, y, dither);
+      } else {
+        ConvertPlain(in, srcPlain, d, dstPlain, n, srcOrder, plainFlags, 0, 0);
+      }
+
+      s += n * srcPixSize;
+      d += n * dstPixSize;
+    }
+
+    return true;
+  }
+
+  // ---
+
+  // Type conversion step of ConvertPlain: n pixels of nc channels, alpha
+  // (-1 if none) is the alpha position and x the image position of the
+  // first pixel
+  struct TypeConverter {
+    ConvertTypeFunc convFunc;
+    // sRGB conversions keep the linear function for alpha
+    ConvertTypeFunc linearFunc;
+    PixelType srcType;
+    PixelType dstType;
+    size_t srcChanSize;
+    size_t dstChanSize;
+    // float to 8 and 16 bits dithering
+    bool dither;
+    DitherPattern pattern;
+    int y;
+
+    void run(const void *src, void *dst, size_t n, int nc, int alpha, int x) const {
+      if (dither) {
+        ditherConvert(src, srcType, dst, dstType, n, nc, alpha, linearFunc != 0, pattern, x, y);
+        return;
+      }
+      convFunc(src, dst, n * nc);
+      if (linearFunc && alpha >= 0) {
+        convertChannel(linearFunc, src, srcChanSize, dst, dstChanSize, n, nc, alpha);
+      }
+    }
+  };
+
+  static bool ConvertPlain(const void *src, const PixelDesc &srcDesc,
+                           void *dst, const PixelDesc &dstDesc,
+                           size_t count, const int *srcOrder, int flags, int x, int y) {
+
+    PixelType srcType = srcDesc.getType();
+    PixelType dstType = dstDesc.getType();
+    int sn = srcDesc.getNumChannels();
+    int dn = dstDesc.getNumChannels();
+    size_t srcChanSize = srcDesc.getBytesPerChannel();
+    size_t dstChanSize = dstDesc.getBytesPerChannel();
+
+    int map[4];
+    int lum[3] = {0, 0, 0};
+
+    bool needLum = BuildChannelMap(srcDesc.getFormat(), dstDesc.getFormat(), srcOrder, map, lum);
+
+    bool identity = (sn == dn);
+    for (int c=0; identity && c<dn; ++c) {
+      identity = (map[c] == c);
+    }
+
+    TypeConverter conv;
+    conv.convFunc = ConvertTypeFuncs[srcType][dstType];
+    conv.linearFunc = 0;
+    conv.srcType = srcType;
+    conv.dstType = dstType;
+    conv.srcChanSize = srcChanSize;
+    conv.dstChanSize = dstChanSize;
+    conv.dither = ((srcType == PT_FLOAT_16 || srcType == PT_FLOAT_32) &&
+                   (dstType == PT_INT_8 || dstType == PT_INT_16) &&
+                   SelectDitherPattern(flags, conv.pattern));
+    conv.y = y;
+
+    if ((flags & CONVERT_SRGB) != 0 && SrgbTypeFuncs[srcType][dstType] != 0) {
+      conv.linearFunc = conv.convFunc;
+      conv.convFunc = SrgbTypeFuncs[srcType][dstType];
+    }
+
+    if (identity) {
+      if (srcType == dstType) {
+        memcpy(dst, src, count * sn * srcChanSize);
+      } else {
+        conv.run(src, dst, count, sn, FindComponent(dstDesc.getFormat(), COMP_A), x);
+      }
+      return true;
+    }
+
+    if (srcType == dstType) {
+      RemapFunc remapFunc = GetRemapFunc(srcType, sn, dn, needLum);
+      if (srcChanSize == 1 && sn == 4 && dn == 4 &&
+          map[0] == 2 && map[1] == 1 && map[2] == 0 && map[3] == 3) {
+        remapFunc = swapRB8;
+      }
+      remapFunc(src, dst, count, map, lum);
+      return true;
+    }
+
+    // Remap and convert by chunks small enough to stay in cache
+    // Convert the fewest channels: remap first when dropping channels,
+    // convert first when adding some (never needs luminance)
+    // sRGB luminance is computed from decoded values (convert first)
+
+    const size_t chunkSize = 1024;
+
+    float tmp[chunkSize * 4];
+
+    bool remapFirst = (dn <= sn && !(conv.linearFunc && needLum));
+
+    RemapFunc remapFunc = GetRemapFunc(remapFirst ? srcType : dstType, sn, dn, needLum);
+
+    // alpha position in the converted pixels
+    int alpha = -1;
+    if (conv.linearFunc || conv.dither) {
+      if (remapFirst) {
+        alpha = FindComponent(dstDesc.getFormat(), COMP_A);
+      } else {
+        alpha = FindComponent(srcDesc.getFormat(), COMP_A);
+        if (alpha >= 0 && srcOrder) {
+          alpha = srcOrder[alpha];
+        }
+      }
+    }
+
+    const unsigned char *s = (const unsigned char*) src;
+    unsigned char *d = (unsigned char*) dst;
+
+    for (size_t i=0; i<count; i+=chunkSize) {
+
+      size_t n = count - i;
+      if (n > chunkSize) {
+        n = chunkSize;
+      }
+
+      if (remapFirst) {
+        remapFunc(s, tmp, n, map, lum);
+        conv.run(tmp, d, n, dn, alpha, x + (int)i);
+      } else {
+        conv.run(s, tmp, n, sn, alpha, x + (int)i);
+        remapFunc(tmp, d, n, map, lum);
+      }
+
+      s += n * sn * srcChanSize;
+      d += n * dn * dstChanSize;
+    }
+
+    return true;
+  }
+
+  bool ConvertPixels(const void *src, const PixelDesc &srcDesc,
+                     void *dst, const PixelDesc &dstDesc,
+                     size_t count, const int *srcOrder,
+                     int flags, int x, int y) {
+
+    if (srcDesc.isCompressed() || dstDesc.isCompressed()) {
+      std::cerr << "Pixel conversion does not support compressed pixel types" << std::endl;
+      return false;
+    }
+
+    if (srcDesc.isPacked() || dstDesc.isPacked()) {
+      return ConvertPacked(src, srcDesc, dst, dstDesc, count, srcOrder, flags, x, y);
+    }
+
+    return ConvertPlain(src, srcDesc, dst, dstDesc, count, srcOrder, flags, x, y);
+  }
+
+  void WarmConvertTables(int flags) {
+    WarmHalfTables();
+    if ((flags & CONVERT_SRGB) != 0) {
+      GetSrgbDecodeTables();
+    }
+    GetDitherPattern(flags, 0);
+  }
+
+}
@@ -0,0 +1,1143 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/dxt.h>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+
+#include "simd.h"
+#include "tables.h"
+
+// Blocks are 4x4 pixels, read as 16 RGBA8 pixels in row order
+//
+// color block: two 5_6_5 endpoints (little endian) and 16 2 bits indices,
+//   c0 > c1 selects four colors {c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1}
+//   c0 <= c1 selects three colors {c0, c1, 1/2 c0 + 1/2 c1} and transparent
+//   black (DXT1 only, DXT3/DXT5 always decode four colors)
+// DXT3 alpha block: 16 4 bits alpha values
+// DXT5 alpha block: two 8 bits endpoints and 16 3 bits indices,
+//   a0 > a1 selects a0, a1 and 6 interpolated values
+//   a0 <= a1 selects a0, a1, 4 interpolated values, 0 and 255
+// 3DC block: two DXT5 alpha style blocks, red then green (BC5/RGTC2 order)
+
+namespace gimg {
+
+  // --- Color endpoints
+
+  static inline int Expand5(int v) {
+    return ((v << 3) | (v >> 2));
+  }
+
+  static inline int Expand6(int v) {
+    return ((v << 2) | (v >> 4));
+  }
+
+  static inline int Clamp255(int v) {
+    return (v < 0 ? 0 : (v > 255 ? 255 : v));
+  }
+
+  static inline unsigned short Pack565(int r, int g, int b) {
+    return (unsigned short)((((r * 31 + 127) / 255) << 11) |
+                            (((g * 63 + 127) / 255) << 5) |
+                             ((b * 31 + 127) / 255));
+  }
+
+  static inline void Unpack565(unsigned short c, int *rgb) {
+    rgb[0] = Expand5((c >> 11) & 0x1F);
+    rgb[1] = Expand6((c >> 5) & 0x3F);
+    rgb[2] = Expand5(c & 0x1F);
+  }
+
+  static void BuildPalette(unsigned short c0, unsigned short c1, bool four, int pal[4][3]) {
+    Unpack565(c0, pal[0]);
+    Unpack565(c1, pal[1]);
+    for (int i=0; i<3; ++i) {
+      if (four) {
+        pal[2][i] = (2 * pal[0][i] + pal[1][i]) / 3;
+        pal[3][i] = (pal[0][i] + 2 * pal[1][i]) / 3;
+      } else {
+        pal[2][i] = (pal[0][i] + pal[1][i]) / 2;
+        pal[3][i] = 0;
+      }
+    }
+  }
+
+  // best 5 and 6 bits endpoints pairs reproducing a single 8 bits value
+  // through the 2/3 c0 + 1/3 c1 color (index 2)
+  struct SingleColorTables {
+
+    unsigned char match5[256][2];
+    unsigned char match6[256][2];
+
+    SingleColorTables() {
+      build(match5, 31, 5);
+      build(match6, 63, 6);
+    }
+
+    static void build(unsigned char match[256][2], int maxv, int bits) {
+      for (int v=0; v<256; ++v) {
+        int bestErr = 256;
+        for (int hi=0; hi<=maxv; ++hi) {
+          int ehi = (bits == 5 ? Expand5(hi) : Expand6(hi));
+          for (int lo=0; lo<=maxv; ++lo) {
+            int elo = (bits == 5 ? Expand5(lo) : Expand6(lo));
+            int err = abs((2 * ehi + elo) / 3 - v);
+            if (err < bestErr) {
+              bestErr = err;
+              match[v][0] = (unsigned char) hi;
+              match[v][1] = (unsigned char) lo;
+            }
+          }
+        }
+      }
+    }
+  };
+
+  static const SingleColorTables& GetSingleColorTables() {
+    static SingleColorTables tables;
+    return tables;
+  }
+
+  // --- Block bounds
+
+  static void BlockMinMax(const unsigned char *px, unsigned char *mn, unsigned char *mx) {
+#ifdef GIMG_SSE2
+    const __m128i *p = (const __m128i*) px;
+    __m128i v0 = _mm_loadu_si128(p);
+    __m128i v1 = _mm_loadu_si128(p + 1);
+    __m128i v2 = _mm_loadu_si128(p + 2);
+    __m128i v3 = _mm_loadu_si128(p + 3);
+    __m128i lo = _mm_min_epu8(_mm_min_epu8(v0, v1), _mm_min_epu8(v2, v3));
+    __m128i hi = _mm_max_epu8(_mm_max_epu8(v0, v1), _mm_max_epu8(v2, v3));
+    lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, 0x4E));
+    hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, 0x4E));
+    lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, 0xB1));
+    hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, 0xB1));
+    int l = _mm_cvtsi128_si32(lo);
+    int h = _mm_cvtsi128_si32(hi);
+    memcpy(mn, &l, 4);
+    memcpy(mx, &h, 4);
+#else
+    memcpy(mn, px, 4);
+    memcpy(mx, px, 4);
+    for (int i=4; i<64; i+=4) {
+      for (int j=0; j<4; ++j) {
+        if (px[i+j] < mn[j]) mn[j] = px[i+j];
+        if (px[i+j] > mx[j]) mx[j] = px[i+j];
+      }
+    }
+#endif
+  }
+
+  // --- Color indices
+
+  // Four colors lie on the c0-c1 segment: the nearest one is found from the
+  // projection of the pixel on it, compared to the 1/6, 1/2 and 5/6 marks
+  static unsigned int ColorIndicesProjected(const unsigned char *px, unsigned short c0, unsigned short c1) {
+
+    static const unsigned int Order[4] = {1, 3, 2, 0};
+
+    int e0[3], e1[3], dir[3];
+
+    Unpack565(c0, e0);
+    Unpack565(c1, e1);
+
+    dir[0] = e0[0] - e1[0];
+    dir[1] = e0[1] - e1[1];
+    dir[2] = e0[2] - e1[2];
+
+    int d1 = e1[0] * dir[0] + e1[1] * dir[1] + e1[2] * dir[2];
+    int range = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+
+    if (range == 0) {
+      return 0;
+    }
+
+    int steps[16];
+
+#ifdef GIMG_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i vdir = _mm_set_epi16(0, (short)dir[2], (short)dir[1], (short)dir[0],
+                                 0, (short)dir[2], (short)dir[1], (short)dir[0]);
+    __m128i vd1 = _mm_set1_epi32(d1);
+    __m128i r1 = _mm_set1_epi32(range);
+    __m128i r3 = _mm_set1_epi32(3 * range);
+    __m128i r5 = _mm_set1_epi32(5 * range);
+
+    for (int i=0; i<16; i+=4) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(px + 4 * i));
+      // [r*dr + g*dg, b*db] pairs for 2 pixels
+      __m128 a = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(v, zero), vdir));
+      __m128 b = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(v, zero), vdir));
+      __m128i even = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      __m128i odd = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+      __m128i s = _mm_sub_epi32(_mm_add_epi32(even, odd), vd1);
+      s = _mm_add_epi32(_mm_slli_epi32(s, 2), _mm_slli_epi32(s, 1));
+      __m128i n = _mm_add_epi32(_mm_cmpgt_epi32(s, r1), _mm_cmpgt_epi32(s, r3));
+      n = _mm_add_epi32(n, _mm_cmpgt_epi32(s, r5));
+      _mm_storeu_si128((__m128i*)(steps + i), _mm_sub_epi32(zero, n));
+    }
+#else
+    for (int i=0; i<16; ++i) {
+      const unsigned char *p = px + 4 * i;
+      int s = 6 * (p[0] * dir[0] + p[1] * dir[1] + p[2] * dir[2] - d1);
+      steps[i] = (s > range) + (s > 3 * range) + (s > 5 * range);
+    }
+#endif
+
+    unsigned int indices = 0;
+    for (int i=0; i<16; ++i) {
+      indices |= Order[steps[i]] << (2 * i);
+    }
+    return indices;
+  }
+
+  // Nearest palette color, returns the squared error
+  // with punch through alpha, transparent pixels use index 3 and the
+  // others cannot
+  static int ColorIndicesExact(const unsigned char *px, unsigned short c0, unsigned short c1,
+                               bool four, bool punch, unsigned int &indices) {
+    int pal[4][3];
+    int total = 0;
+
+    BuildPalette(c0, c1, four, pal);
+
+    int n = (four || !punch ? 4 : 3);
+
+    indices = 0;
+
+    for (int i=0; i<16; ++i) {
+      const unsigned char *p = px + 4 * i;
+
+      if (punch && p[3] < 128) {
+        indices |= 3u << (2 * i);
+        continue;
+      }
+
+      int best = 0;
+      int bestErr = 0x7FFFFFFF;
+      for (int j=0; j<n; ++j) {
+        int dr = p[0] - pal[j][0];
+        int dg = p[1] - pal[j][1];
+        int db = p[2] - pal[j][2];
+        int err = dr * dr + dg * dg + db * db;
+        if (err < bestErr) {
+          bestErr = err;
+          best = j;
+        }
+      }
+      indices |= (unsigned int)best << (2 * i);
+      total += bestErr;
+    }
+
+    return total;
+  }
+
+  // Least squares endpoints for the given indices
+  static bool RefineEndpoints(const unsigned char *px, unsigned int indices, bool four, bool punch,
+                              unsigned short &c0, unsigned short &c1) {
+
+    static const float Weights4[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    static const float Weights3[4] = {1.0f, 0.0f, 0.5f, 0.0f};
+
+    const float *weights = (four ? Weights4 : Weights3);
+
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+    float ax[3] = {0.0f, 0.0f, 0.0f};
+    float bx[3] = {0.0f, 0.0f, 0.0f};
+
+    for (int i=0; i<16; ++i) {
+      unsigned int idx = (indices >> (2 * i)) & 3;
+      if (!four && idx == 3) {
+        // transparent or black, not interpolated
+        continue;
+      }
+      const unsigned char *p = px + 4 * i;
+      if (punch && p[3] < 128) {
+        continue;
+      }
+      float a = weights[idx];
+      float b = 1.0f - a;
+      aa += a * a;
+      bb += b * b;
+      ab += a * b;
+      for (int j=0; j<3; ++j) {
+        ax[j] += a * p[j];
+        bx[j] += b * p[j];
+      }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabs(det) < 1e-6f) {
+      return false;
+    }
+    float idet = 1.0f / det;
+
+    int e0[3], e1[3];
+    for (int j=0; j<3; ++j) {
+      e0[j] = Clamp255(int(floor((bb * ax[j] - ab * bx[j]) * idet + 0.5f)));
+      e1[j] = Clamp255(int(floor((aa * bx[j] - ab * ax[j]) * idet + 0.5f)));
+    }
+
+    c0 = Pack565(e0[0], e0[1], e0[2]);
+    c1 = Pack565(e1[0], e1[1], e1[2]);
+
+    return true;
+  }
+
+  // --- Color block
+
+  enum ColorMode {
+    COLOR_FOUR = 0,   // DXT3/DXT5, always decoded with four colors
+    COLOR_BLACK,      // DXT1 RGB, three colors mode black is usable
+    COLOR_ALPHA       // DXT1 RGBA, three colors mode black is transparent
+  };
+
+  static void WriteColorBlock(unsigned short c0, unsigned short c1, unsigned int indices,
+                              bool four, unsigned char *out) {
+    if (four) {
+      if (c0 < c1) {
+        unsigned short tmp = c0; c0 = c1; c1 = tmp;
+        indices ^= 0x55555555u;
+      } else if (c0 == c1) {
+        // decoded as three colors, c0 only
+        indices = 0;
+      }
+    } else if (c0 > c1) {
+      unsigned short tmp = c0; c0 = c1; c1 = tmp;
+      // swap indices 0 and 1, keep 2 and 3
+      indices ^= (~(indices >> 1) & 0x55555555u);
+    }
+    out[0] = (unsigned char)(c0 & 0xFF);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xFF);
+    out[3] = (unsigned char)(c1 >> 8);
+    out[4] = (unsigned char)(indices & 0xFF);
+    out[5] = (unsigned char)((indices >> 8) & 0xFF);
+    out[6] = (unsigned char)((indices >> 16) & 0xFF);
+    out[7] = (unsigned char)(indices >> 24);
+  }
+
+  // Bounding box endpoints: the diagonal is picked from the sign of the
+  // red/green and blue/green covariances and inset by 1/16 of the box
+  static void BoxEndpoints(const unsigned char *px, const unsigned char *mn, const unsigned char *mx,
+                           bool punch, unsigned short &c0, unsigned short &c1) {
+    int lo[3], hi[3];
+    int center[3];
+
+    for (int j=0; j<3; ++j) {
+      int inset = (mx[j] - mn[j]) >> 4;
+      lo[j] = mn[j] + inset;
+      hi[j] = mx[j] - inset;
+      center[j] = (mn[j] + mx[j] + 1) >> 1;
+    }
+
+    int covrg = 0;
+    int covbg = 0;
+
+    for (int i=0; i<16; ++i) {
+      const unsigned char *p = px + 4 * i;
+      if (punch && p[3] < 128) {
+        continue;
+      }
+      int dg = p[1] - center[1];
+      covrg += (p[0] - center[0]) * dg;
+      covbg += (p[2] - center[2]) * dg;
+    }
+
+    if (covrg < 0) {
+      int tmp = lo[0]; lo[0] = hi[0]; hi[0] = tmp;
+    }
+    if (covbg < 0) {
+      int tmp = lo[2]; lo[2] = hi[2]; hi[2] = tmp;
+    }
+
+    c0 = Pack565(hi[0], hi[1], hi[2]);
+    c1 = Pack565(lo[0], lo[1], lo[2]);
+  }
+
+  // Endpoints at the extents of the pixels projected on the principal axis
+  static void PrincipalEndpoints(const unsigned char *px, bool punch, unsigned short &c0, unsigned short &c1) {
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    int n = 0;
+
+    for (int i=0; i<16; ++i) {
+      const unsigned char *p = px + 4 * i;
+      if (punch && p[3] < 128) {
+        continue;
+      }
+      mean[0] += p[0];
+      mean[1] += p[1];
+      mean[2] += p[2];
+      ++n;
+    }
+
+    if (n == 0) {
+      c0 = c1 = 0;
+      return;
+    }
+
+    mean[0] /= n;
+    mean[1] /= n;
+    mean[2] /= n;
+
+    for (int i=0; i<16; ++i) {
+      const unsigned char *p = px + 4 * i;
+      if (punch && p[3] < 128) {
+        continue;
+      }
+      float r = p[0] - mean[0];
+      float g = p[1] - mean[1];
+      float b = p[2] - mean[2];
+      cov[0] += r * r;
+      cov[1] += r * g;
+      cov[2] += r * b;
+      cov[3] += g * g;
+      cov[4] += g * b;
+      cov[5] += b * b;
+    }
+
+    // power iteration
+    float axis[3] = {1.0f, 1.0f, 1.0f};
+
+    for (int k=0; k<8; ++k) {
+      float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+      float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+      float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+      float m = fabs(x) > fabs(y) ? fabs(x) : fabs(y);
+      m = fabs(z) > m ? fabs(z) : m;
+      if (m < 1e-6f) {
+        break;
+      }
+      m = 1.0f / m;
+      axis[0] = x * m;
+      axis[1] = y * m;
+      axis[2] = z * m;
+    }
+
+    float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    float tmin = 0.0f;
+    float tmax = 0.0f;
+
+    if (len2 > 1e-6f) {
+      float ilen = 1.0f / sqrtf(len2);
+      axis[0] *= ilen;
+      axis[1] *= ilen;
+      axis[2] *= ilen;
+
+      bool first = true;
+      for (int i=0; i<16; ++i) {
+        const unsigned char *p = px + 4 * i;
+        if (punch && p[3] < 128) {
+          continue;
+        }
+        float t = (p[0] - mean[0]) * axis[0] + (p[1] - mean[1]) * axis[1] + (p[2] - mean[2]) * axis[2];
+        if (first || t < tmin) tmin = t;
+        if (first || t > tmax) tmax = t;
+        first = false;
+      }
+    }
+
+    int e0[3], e1[3];
+    for (int j=0; j<3; ++j) {
+      e0[j] = Clamp255(int(floor(mean[j] + tmax * axis[j] + 0.5f)));
+      e1[j] = Clamp255(int(floor(mean[j] + tmin * axis[j] + 0.5f)));
+    }
+
+    c0 = Pack565(e0[0], e0[1], e0[2]);
+    c1 = Pack565(e1[0], e1[1], e1[2]);
+  }
+
+  static void CompressColorFast(const unsigned char *px, const unsigned char *mn, const unsigned char *mx,
+                                ColorMode mode, unsigned char *out) {
+    unsigned short c0, c1;
+    unsigned int indices;
+
+    if (mode == COLOR_ALPHA && mn[3] < 128) {
+      unsigned char omn[4] = {255, 255, 255, 255};
+      unsigned char omx[4] = {0, 0, 0, 0};
+      for (int i=0; i<16; ++i) {
+        const unsigned char *p = px + 4 * i;
+        if (p[3] < 128) {
+          continue;
+        }
+        for (int j=0; j<3; ++j) {
+          if (p[j] < omn[j]) omn[j] = p[j];
+          if (p[j] > omx[j]) omx[j] = p[j];
+        }
+      }
+      if (omn[0] > omx[0]) {
+        // fully transparent
+        WriteColorBlock(0, 0, 0xFFFFFFFFu, false, out);
+        return;
+      }
+      BoxEndpoints(px, omn, omx, true, c0, c1);
+      ColorIndicesExact(px, c0, c1, false, true, indices);
+      WriteColorBlock(c0, c1, indices, false, out);
+      return;
+    }
+
+    BoxEndpoints(px, mn, mx, false, c0, c1);
+    indices = ColorIndicesProjected(px, c0, c1);
+    WriteColorBlock(c0, c1, indices, true, out);
+  }
+
+  static void CompressColorQuality(const unsigned char *px, const unsigned char *mn, const unsigned char *mx,
+                                   ColorMode mode, unsigned char *out) {
+
+    bool punch = (mode == COLOR_ALPHA);
+    bool transparent = (punch && mn[3] < 128);
+
+    // single color: exact 5_6_5 interpolation match
+    int first = -1;
+    bool single = true;
+
+    for (int i=0; i<16 && single; ++i) {
+      const unsigned char *p = px + 4 * i;
+      if (punch && p[3] < 128) {
+        continue;
+      }
+      if (first < 0) {
+        first = i;
+      } else if (memcmp(p, px + 4 * first, 3) != 0) {
+        single = false;
+      }
+    }
+
+    if (first < 0) {
+      WriteColorBlock(0, 0, 0xFFFFFFFFu, false, out);
+      return;
+    }
+
+    if (single && !transparent) {
+      const unsigned char *p = px + 4 * first;
+      const SingleColorTables &sc = GetSingleColorTables();
+      unsigned short c0 = (unsigned short)((sc.match5[p[0]][0] << 11) |
+                                           (sc.match6[p[1]][0] << 5) |
+                                            sc.match5[p[2]][0]);
+      unsigned short c1 = (unsigned short)((sc.match5[p[0]][1] << 11) |
+                                           (sc.match6[p[1]][1] << 5) |
+                                            sc.match5[p[2]][1]);
+      unsigned int indices;
+      if (c0 == c1) {
+        // any index decodes c0
+        WriteColorBlock(c0, c1, 0, true, out);
+        return;
+      }
+      ColorIndicesExact(px, c0, c1, true, false, indices);
+      WriteColorBlock(c0, c1, indices, true, out);
+      return;
+    }
+
+    unsigned short cand[2][2];
+    int ncand = 2;
+
+    PrincipalEndpoints(px, punch, cand[0][0], cand[0][1]);
+
+    if (transparent) {
+      unsigned char omn[4] = {255, 255, 255, 255};
+      unsigned char omx[4] = {0, 0, 0, 0};
+      for (int i=0; i<16; ++i) {
+        const unsigned char *p = px + 4 * i;
+        if (p[3] < 128) {
+          continue;
+        }
+        for (int j=0; j<3; ++j) {
+          if (p[j] < omn[j]) omn[j] = p[j];
+          if (p[j] > omx[j]) omx[j] = p[j];
+        }
+      }
+      BoxEndpoints(px, omn, omx, true, cand[1][0], cand[1][1]);
+    } else {
+      BoxEndpoints(px, mn, mx, false, cand[1][0], cand[1][1]);
+    }
+
+    int bestErr = 0x7FFFFFFF;
+    unsigned short best0 = 0;
+    unsigned short best1 = 0;
+    unsigned int bestIndices = 0;
+    bool bestFour = true;
+
+    for (int m=0; m<2; ++m) {
+
+      bool four = (m == 0);
+
+      if ((four && transparent) || (!four && mode == COLOR_FOUR)) {
+        continue;
+      }
+
+      for (int c=0; c<ncand; ++c) {
+
+        unsigned short c0 = cand[c][0];
+        unsigned short c1 = cand[c][1];
+        unsigned int indices;
+
+        int err = ColorIndicesExact(px, c0, c1, four, punch, indices);
+
+        for (int k=0; ; ++k) {
+          if (err < bestErr) {
+            bestErr = err;
+            best0 = c0;
+            best1 = c1;
+            bestIndices = indices;
+            bestFour = four;
+          }
+          if (err == 0 || k == 2 || !RefineEndpoints(px, indices, four, punch, c0, c1)) {
+            break;
+          }
+          err = ColorIndicesExact(px, c0, c1, four, punch, indices);
+        }
+      }
+    }
+
+    WriteColorBlock(best0, best1, bestIndices, bestFour, out);
+  }
+
+  // --- Alpha blocks
+
+  static void CompressAlphaExplicit(const unsigned char *px, unsigned char *out) {
+    for (int i=0; i<16; i+=2) {
+      unsigned int a0 = (px[4 * i + 3] * 15u + 127u) / 255u;
+      unsigned int a1 = (px[4 * i + 7] * 15u + 127u) / 255u;
+      out[i >> 1] = (unsigned char)(a0 | (a1 << 4));
+    }
+  }
+
+  static void AlphaPalette(int a0, int a1, int pal[8]) {
+    pal[0] = a0;
+    pal[1] = a1;
+    if (a0 > a1) {
+      for (int i=1; i<7; ++i) {
+        pal[i+1] = ((7 - i) * a0 + i * a1) / 7;
+      }
+    } else {
+      for (int i=1; i<5; ++i) {
+        pal[i+1] = ((5 - i) * a0 + i * a1) / 5;
+      }
+      pal[6] = 0;
+      pal[7] = 255;
+    }
+  }
+
+  static int AlphaIndicesExact(const unsigned char *px, int channel, int a0, int a1, unsigned char *indices) {
+    int pal[8];
+    int total = 0;
+
+    AlphaPalette(a0, a1, pal);
+
+    for (int i=0; i<16; ++i) {
+      int a = px[4 * i + channel];
+      int best = 0;
+      int bestErr = 0x7FFFFFFF;
+      for (int j=0; j<8; ++j) {
+        int err = (a - pal[j]) * (a - pal[j]);
+        if (err < bestErr) {
+          bestErr = err;
+          best = j;
+        }
+      }
+      indices[i] = (unsigned char) best;
+      total += bestErr;
+    }
+
+    return total;
+  }
+
+  static void WriteAlphaBlock(int a0, int a1, const unsigned char *indices, unsigned char *out) {
+    out[0] = (unsigned char) a0;
+    out[1] = (unsigned char) a1;
+    // 2 x 24 bits
+    for (int k=0; k<2; ++k) {
+      unsigned int bits = 0;
+      for (int i=0; i<8; ++i) {
+        bits |= (unsigned int)indices[8 * k + i] << (3 * i);
+      }
+      out[2 + 3 * k] = (unsigned char)(bits & 0xFF);
+      out[3 + 3 * k] = (unsigned char)((bits >> 8) & 0xFF);
+      out[4 + 3 * k] = (unsigned char)(bits >> 16);
+    }
+  }
+
+  // DXT5 alpha style block for one channel of the pixels (alpha, 3DC red or green)
+  static void CompressAlphaFast(const unsigned char *px, int channel, int amin, int amax, unsigned char *out) {
+    unsigned char indices[16];
+
+    if (amin == amax) {
+      memset(indices, 0, 16);
+      WriteAlphaBlock(amax, amin, indices, out);
+      return;
+    }
+
+    // nearest of the 8 steps from amin (0) to amax (7)
+    int range = amax - amin;
+    for (int i=0; i<16; ++i) {
+      int k = ((px[4 * i + channel] - amin) * 14 + range) / (2 * range);
+      indices[i] = (unsigned char)(k == 7 ? 0 : (k == 0 ? 1 : 8 - k));
+    }
+
+    WriteAlphaBlock(amax, amin, indices, out);
+  }
+
+  static void CompressAlphaQuality(const unsigned char *px, int channel, int amin, int amax, unsigned char *out) {
+    unsigned char indices[16];
+    unsigned char other[16];
+
+    if (amin == amax) {
+      memset(indices, 0, 16);
+      WriteAlphaBlock(amax, amin, indices, out);
+      return;
+    }
+
+    int a0 = amax;
+    int a1 = amin;
+    int err = AlphaIndicesExact(px, channel, a0, a1, indices);
+
+    // six interpolated values between the inner extents, 0 and 255 explicit
+    int imin = 255;
+    int imax = 0;
+    for (int i=0; i<16; ++i) {
+      int a = px[4 * i + channel];
+      if (a != 0 && a < imin) imin = a;
+      if (a != 255 && a > imax) imax = a;
+    }
+    if (imin > imax) {
+      // only 0 and 255
+      imin = imax = 0;
+    }
+
+    int err6 = AlphaIndicesExact(px, channel, imin, imax, other);
+    if (err6 < err) {
+      a0 = imin;
+      a1 = imax;
+      memcpy(indices, other, 16);
+    }
+
+    WriteAlphaBlock(a0, a1, indices, out);
+  }
+
+  // --- Block decoding
+
+  static void DecodeColorBlock(const unsigned char *block, bool dxt1, bool alpha, unsigned char *px) {
+    unsigned short c0 = (unsigned short)(block[0] | (block[1] << 8));
+    unsigned short c1 = (unsigned short)(block[2] | (block[3] << 8));
+    unsigned int indices = (unsigned int)block[4] | ((unsigned int)block[5] << 8) |
+                           ((unsigned int)block[6] << 16) | ((unsigned int)block[7] << 24);
+
+    bool four = (!dxt1 || c0 > c1);
+    int pal[4][3];
+    unsigned char colors[4][4];
+
+    BuildPalette(c0, c1, four, pal);
+
+    for (int k=0; k<4; ++k) {
+      colors[k][0] = (unsigned char) pal[k][0];
+      colors[k][1] = (unsigned char) pal[k][1];
+      colors[k][2] = (unsigned char) pal[k][2];
+      colors[k][3] = 255;
+    }
+    if (!four && alpha) {
+      colors[3][3] = 0;
+    }
+
+#ifdef GIMG_SSE2
+    // select the palette color of 4 pixels at once from their 2 bits fields
+    int words[4];
+    memcpy(words, colors, 16);
+
+    __m128i zero = _mm_setzero_si128();
+    __m128i fields = _mm_set_epi32(0xC0, 0x30, 0x0C, 0x03);
+    __m128i k1 = _mm_set_epi32(0x40, 0x10, 0x04, 0x01);
+    __m128i k2 = _mm_add_epi32(k1, k1);
+    __m128i k3 = _mm_add_epi32(k2, k1);
+    __m128i p0 = _mm_set1_epi32(words[0]);
+    __m128i p1 = _mm_set1_epi32(words[1]);
+    __m128i p2 = _mm_set1_epi32(words[2]);
+    __m128i p3 = _mm_set1_epi32(words[3]);
+
+    for (int r=0; r<4; ++r) {
+      __m128i v = _mm_and_si128(_mm_set1_epi32((indices >> (8 * r)) & 0xFF), fields);
+      __m128i c = _mm_and_si128(_mm_cmpeq_epi32(v, zero), p0);
+      c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(v, k1), p1));
+      c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(v, k2), p2));
+      c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(v, k3), p3));
+      _mm_storeu_si128((__m128i*)(px + 16 * r), c);
+    }
+#else
+    for (int i=0; i<16; ++i) {
+      memcpy(px + 4 * i, colors[(indices >> (2 * i)) & 3], 4);
+    }
+#endif
+  }
+
+  static void DecodeAlphaBlock(const unsigned char *block, unsigned char *values) {
+    int pal[8];
+
+    AlphaPalette(block[0], block[1], pal);
+
+    for (int k=0; k<2; ++k) {
+      unsigned int bits = (unsigned int)block[2 + 3 * k] |
+                          ((unsigned int)block[3 + 3 * k] << 8) |
+                          ((unsigned int)block[4 + 3 * k] << 16);
+      for (int i=0; i<8; ++i) {
+        values[8 * k + i] = (unsigned char) pal[(bits >> (3 * i)) & 7];
+      }
+    }
+  }
+
+  static void DecodeAlphaExplicit(const unsigned char *block, unsigned char *values) {
+    for (int i=0; i<16; i+=2) {
+      values[i] = (unsigned char)((block[i >> 1] & 0x0F) * 17);
+      values[i+1] = (unsigned char)((block[i >> 1] >> 4) * 17);
+    }
+  }
+
+  // Replace the alpha channel of 16 RGBA8 pixels
+  static void InsertAlpha(const unsigned char *values, unsigned char *px) {
+#ifdef GIMG_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    __m128i v = _mm_loadu_si128((const __m128i*) values);
+    __m128i lo = _mm_unpacklo_epi8(zero, v);
+    __m128i hi = _mm_unpackhi_epi8(zero, v);
+    __m128i a[4];
+    a[0] = _mm_unpacklo_epi16(zero, lo);
+    a[1] = _mm_unpackhi_epi16(zero, lo);
+    a[2] = _mm_unpacklo_epi16(zero, hi);
+    a[3] = _mm_unpackhi_epi16(zero, hi);
+    for (int r=0; r<4; ++r) {
+      __m128i *p = (__m128i*)(px + 16 * r);
+      _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(p), mask), a[r]));
+    }
+#else
+    for (int i=0; i<16; ++i) {
+      px[4 * i + 3] = values[i];
+    }
+#endif
+  }
+
+  // Interleave two channels to 16 RG8 pixels
+  static void InterleaveRG(const unsigned char *red, const unsigned char *green, unsigned char *px) {
+#ifdef GIMG_SSE2
+    __m128i r = _mm_loadu_si128((const __m128i*) red);
+    __m128i g = _mm_loadu_si128((const __m128i*) green);
+    _mm_storeu_si128((__m128i*) px, _mm_unpacklo_epi8(r, g));
+    _mm_storeu_si128((__m128i*)(px + 16), _mm_unpackhi_epi8(r, g));
+#else
+    for (int i=0; i<16; ++i) {
+      px[2 * i] = red[i];
+      px[2 * i + 1] = green[i];
+    }
+#endif
+  }
+
+  // 16 RGBA8 pixels, RG8 for 3DC
+  static void DecodeBlock(const unsigned char *block, PixelType type, bool alpha, unsigned char *px) {
+    unsigned char values[16];
+
+    switch (type) {
+      case PT_DXT1:
+        DecodeColorBlock(block, true, alpha, px);
+        break;
+      case PT_DXT3:
+        DecodeColorBlock(block + 8, false, true, px);
+        DecodeAlphaExplicit(block, values);
+        InsertAlpha(values, px);
+        break;
+      case PT_DXT5:
+        DecodeColorBlock(block + 8, false, true, px);
+        DecodeAlphaBlock(block, values);
+        InsertAlpha(values, px);
+        break;
+      case PT_3DC: {
+        unsigned char green[16];
+        DecodeAlphaBlock(block, values);
+        DecodeAlphaBlock(block + 8, green);
+        InterleaveRG(values, green, px);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // --- Images
+
+  // [0, 1] encoded normals to unit length, XYZ in RGBA8
+  static void NormalizeRow(const float *src, unsigned char *dst, int n) {
+    for (int i=0; i<n; ++i, src+=3, dst+=4) {
+      float x = 2.0f * src[0] - 1.0f;
+      float y = 2.0f * src[1] - 1.0f;
+      float z = 2.0f * src[2] - 1.0f;
+      float len2 = x * x + y * y + z * z;
+      if (len2 > 1e-12f) {
+        float s = 1.0f / sqrtf(len2);
+        x *= s;
+        y *= s;
+        z *= s;
+      } else {
+        x = y = 0.0f;
+        z = 1.0f;
+      }
+      dst[0] = (unsigned char)(x * 127.5f + 128.0f);
+      dst[1] = (unsigned char)(y * 127.5f + 128.0f);
+      dst[2] = (unsigned char)(z * 127.5f + 128.0f);
+      dst[3] = 255;
+    }
+  }
+
+  static void CompressBlock(const unsigned char *px, PixelType type, bool alpha,
+                            bool quality, unsigned char *out) {
+    unsigned char mn[4], mx[4];
+
+    BlockMinMax(px, mn, mx);
+
+    if (type == PT_3DC) {
+      if (quality) {
+        CompressAlphaQuality(px, 0, mn[0], mx[0], out);
+        CompressAlphaQuality(px, 1, mn[1], mx[1], out + 8);
+      } else {
+        CompressAlphaFast(px, 0, mn[0], mx[0], out);
+        CompressAlphaFast(px, 1, mn[1], mx[1], out + 8);
+      }
+      return;
+    }
+
+    ColorMode mode = COLOR_FOUR;
+
+    if (type == PT_DXT1) {
+      mode = (alpha ? COLOR_ALPHA : COLOR_BLACK);
+    } else {
+      if (type == PT_DXT3) {
+        CompressAlphaExplicit(px, out);
+      } else if (quality) {
+        CompressAlphaQuality(px, 3, mn[3], mx[3], out);
+      } else {
+        CompressAlphaFast(px, 3, mn[3], mx[3], out);
+      }
+      out += 8;
+    }
+
+    if (quality) {
+      CompressColorQuality(px, mn, mx, mode, out);
+    } else {
+      CompressColorFast(px, mn, mx, mode, out);
+    }
+  }
+
+  bool CompressBlocks(const void *src, const PixelDesc &srcDesc,
+                      int width, int height,
+                      void *dst, const PixelDesc &dstDesc,
+                      int flags) {
+
+    PixelType type = dstDesc.getType();
+
+    if (!dstDesc.isCompressed() || !dstDesc.isValid()) {
+      std::cerr << "Unsupported block compression pixel format" << std::endl;
+      return false;
+    }
+
+    if (srcDesc.isCompressed() || !srcDesc.isValid()) {
+      std::cerr << "Cannot compress from compressed or invalid pixel format" << std::endl;
+      return false;
+    }
+
+    if (width <= 0 || height <= 0) {
+      return true;
+    }
+
+    PixelDesc rgba8(PF_RGBA, PT_INT_8);
+    PixelDesc rgbf(PF_RGB, PT_FLOAT_32);
+
+    bool normals = (type == PT_3DC && (flags & CONVERT_NORMAL_MAP) != 0 &&
+                    srcDesc.getNumChannels() >= 3);
+    bool direct = (!normals && srcDesc.getFormat() == PF_RGBA && srcDesc.getType() == PT_INT_8);
+    bool alpha = (dstDesc.getFormat() == PF_RGBA);
+    bool quality = ((flags & CONVERT_HIGH_QUALITY) != 0);
+
+    size_t srcRowSize = size_t(width) * srcDesc.getBytesPerPixel();
+    size_t rowSize = size_t(width) * 4;
+    size_t blockSize = dstDesc.getBytesPerBlock();
+
+    int numBlockCols = (width + 3) / 4;
+    int numBlockRows = (height + 3) / 4;
+
+    const unsigned char *in = (const unsigned char*) src;
+    unsigned char *out = (unsigned char*) dst;
+
+    WarmConvertTables(flags & CONVERT_SRGB);
+    GetSingleColorTables();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      unsigned char *buffer = (direct ? 0 : (unsigned char*) malloc(4 * rowSize));
+      float *normalRow = (normals ? (float*) malloc(width * 3 * sizeof(float)) : 0);
+      unsigned char px[64];
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int by=0; by<numBlockRows; ++by) {
+
+        const unsigned char *rows[4];
+
+        for (int r=0; r<4; ++r) {
+          int y = 4 * by + r;
+          if (y >= height) {
+            rows[r] = rows[r-1];
+          } else if (direct) {
+            rows[r] = in + y * srcRowSize;
+          } else if (normals) {
+            ConvertPixels(in + y * srcRowSize, srcDesc, normalRow, rgbf, width);
+            NormalizeRow(normalRow, buffer + r * rowSize, width);
+            rows[r] = buffer + r * rowSize;
+          } else {
+            ConvertPixels(in + y * srcRowSize, srcDesc, buffer + r * rowSize, rgba8, width,
+                          0, flags & CONVERT_SRGB);
+            rows[r] = buffer + r * rowSize;
+          }
+        }
+
+        unsigned char *block = out + size_t(by) * numBlockCols * blockSize;
+
+        for (int bx=0; bx<numBlockCols; ++bx) {
+
+          int x = 4 * bx;
+
+          if (x + 4 <= width) {
+            for (int r=0; r<4; ++r) {
+              memcpy(px + 16 * r, rows[r] + 4 * x, 16);
+            }
+          } else {
+            for (int r=0; r<4; ++r) {
+              for (int c=0; c<4; ++c) {
+                int xc = (x + c < width ? x + c : width - 1);
+                memcpy(px + 16 * r + 4 * c, rows[r] + 4 * xc, 4);
+              }
+            }
+          }
+
+          CompressBlock(px, type, alpha, quality, block);
+
+          block += blockSize;
+        }
+      }
+
+      free(buffer);
+      free(normalRow);
+    }
+
+    return true;
+  }
+
+  bool DecompressBlocks(const void *src, const PixelDesc &srcDesc,
+                        int width, int height,
+                        void *dst, const PixelDesc &dstDesc,
+                        int flags) {
+
+    PixelType type = srcDesc.getType();
+
+    if (!srcDesc.isCompressed() || !srcDesc.isValid()) {
+      std::cerr << "Unsupported block compression pixel format" << std::endl;
+      return false;
+    }
+
+    if (dstDesc.isCompressed() || !dstDesc.isValid()) {
+      std::cerr << "Cannot decompress to compressed or invalid pixel format" << std::endl;
+      return false;
+    }
+
+    if (width <= 0 || height <= 0) {
+      return true;
+    }
+
+    PixelDesc blockDesc = (type == PT_3DC ? PixelDesc(PF_RG, PT_INT_8) : PixelDesc(PF_RGBA, PT_INT_8));
+
+    bool direct = (dstDesc.getFormat() == blockDesc.getFormat() && dstDesc.getType() == PT_INT_8);
+    bool alpha = (srcDesc.getFormat() == PF_RGBA);
+
+    size_t pixSize = blockDesc.getBytesPerPixel();
+    size_t rowSize = size_t(width) * pixSize;
+    size_t dstRowSize = size_t(width) * dstDesc.getBytesPerPixel();
+    size_t blockSize = srcDesc.getBytesPerBlock();
+
+    int numBlockCols = (width + 3) / 4;
+    int numBlockRows = (height + 3) / 4;
+
+    const unsigned char *in = (const unsigned char*) src;
+    unsigned char *out = (unsigned char*) dst;
+
+    WarmConvertTables(flags);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      unsigned char *buffer = (direct ? 0 : (unsigned char*) malloc(4 * rowSize));
+      unsigned char px[64];
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int by=0; by<numBlockRows; ++by) {
+
+        int y = 4 * by;
+        int numRows = (height - y < 4 ? height - y : 4);
+
+        unsigned char *rows = (direct ? out + y * dstRowSize : buffer);
+
+        const unsigned char *block = in + size_t(by) * numBlockCols * blockSize;
+
+        for (int bx=0; bx<numBlockCols; ++bx) {
+
+          int x = 4 * bx;
+          int numCols = (width - x < 4 ? width - x : 4);
+
+          DecodeBlock(block, type, alpha, px);
+
+          for (int r=0; r<numRows; ++r) {
+            memcpy(rows + r * rowSize + x * pixSize, px + 4 * r * pixSize, numCols * pixSize);
+          }
+
+          block += blockSize;
+        }
+
+        if (!direct) {
+          for (int r=0; r<numRows; ++r) {
+            ConvertPixels(buffer + r * rowSize, blockDesc, out + (y + r) * dstRowSize, dstDesc,
+                          width, 0, flags, 0, y + r);
+          }
+        }
+      }
+
+      free(buffer);
+    }
+
+    return true;
+  }
+
+}
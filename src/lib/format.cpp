@@ -52,6 +52,8 @@ namespace gimg {
     } else if (isCompressed()) {
       if (mType == PT_DXT1) {
         return (mFormat == PF_RGB || mFormat == PF_RGBA);
+      } else if (mType == PT_3DC) {
+        return (mFormat == PF_RG);
       } else {
         return (mFormat == PF_RGBA);
       }
@@ -138,7 +140,7 @@ namespace gimg {
   }
   
   int PixelDesc::getNumChannels() const {
-    static int numChannels[] = {1, 1, 1, 1, 1, 2, 3, 4};
+    static int numChannels[] = {1, 1, 1, 1, 1, 2, 3, 4, 2};
     return numChannels[mFormat];
   }
   
@@ -167,7 +169,7 @@ namespace gimg {
     return (mType == PT_DXT1 ? 8 : 16);
   }
   
-  size_t PixelDesc::getBytesSizeFor(int w, int h, int d, int firstMipmap, int nMipmap) {
+  size_t PixelDesc::getBytesSizeFor(int w, int h, int d, int firstMipmap, int nMipmap) const {
     if (isCompressed()) {
       return (getNumBlocks(w, h, d, firstMipmap, nMipmap) * getBytesPerBlock());
     } else {
@@ -175,5 +177,53 @@ namespace gimg {
     }
   }
   
+  
+  // ---
+  
+  MipLayout::MipLayout()
+    :mNumLevels(0), mNumFaces(0), mFaceSize(0) {
+  }
+  
+  MipLayout::MipLayout(const PixelDesc &desc, int w, int h, int d, int numMipmaps)
+    :mNumLevels(0), mNumFaces(0), mFaceSize(0) {
+    reset(desc, w, h, d, numMipmaps);
+  }
+  
+  MipLayout::~MipLayout() {
+  }
+  
+  void MipLayout::reset(const PixelDesc &desc, int w, int h, int d, int numMipmaps) {
+    int maxMipmaps = desc.getMaxMipmaps(w, h, d);
+    
+    if (numMipmaps < 0 || numMipmaps > maxMipmaps) {
+      numMipmaps = maxMipmaps;
+    }
+    
+    mNumLevels = numMipmaps + 1;
+    mNumFaces = (d <= 0 ? 6 : 1);
+    mFaceSize = 0;
+    
+    bool compressed = desc.isCompressed();
+    size_t unitSize = (compressed ? desc.getBytesPerBlock() : desc.getBytesPerPixel());
+    
+    for (int level=0; level<mNumLevels; ++level) {
+      Level &l = mLevels[level];
+      
+      l.width = desc.getMipmappedDim(w, level);
+      l.height = desc.getMipmappedDim(h, level);
+      l.depth = desc.getMipmappedDim(d <= 0 ? 1 : d, level);
+      
+      if (compressed) {
+        l.rowBytes = size_t((l.width + 3) >> 2) * unitSize;
+        l.size = l.rowBytes * size_t((l.height + 3) >> 2) * size_t(l.depth);
+      } else {
+        l.rowBytes = size_t(l.width) * unitSize;
+        l.size = l.rowBytes * size_t(l.height) * size_t(l.depth);
+      }
+      
+      l.offset = mFaceSize;
+      mFaceSize += l.size;
+    }
+  }
+  
 }
-
@@ -0,0 +1,304 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/image.h>
+#include <gimg/pixeltraits.h>
+#include <cstdlib>
+#include <iostream>
+
+#include "simd.h"
+#include "tables.h"
+#include "rows.h"
+
+// Color::grade is linear per channel: on normalized values it reduces to
+// v * scale + offset, 8 and 16 bits channels (half floats included) go
+// through tables indexed by the channel bits, 32 bits floats through a
+// single multiply-add per value and 32 bits integers through doubles
+//
+// All rows of all levels and faces are graded in parallel
+
+namespace gimg {
+
+  // Color component graded by each channel of a format
+  // 0-2: R, G, B, 3: luminance, -1: alpha (left untouched)
+  static const int GradeComponents[PF_MAX][4] = {
+    { 3, -1, -1, -1}, // PF_LUMINANCE
+    { 0, -1, -1, -1}, // PF_R
+    { 1, -1, -1, -1}, // PF_G
+    { 2, -1, -1, -1}, // PF_B
+    {-1, -1, -1, -1}, // PF_A
+    { 3, -1, -1, -1}, // PF_LUMINANCE_ALPHA
+    { 0,  1,  2, -1}, // PF_RGB
+    { 0,  1,  2, -1}, // PF_RGBA
+    { 0,  1, -1, -1}  // PF_RG
+  };
+
+  static float GradeComponent(const Color &c, int comp) {
+    switch (comp) {
+    case 0:
+      return c.r;
+    case 1:
+      return c.g;
+    case 2:
+      return c.b;
+    default:
+      return c.luminance();
+    }
+  }
+
+  struct GradeArgs {
+    PixelRows rows;
+    // 1 for interleaved images
+    int numPlanes;
+    int numChannels;
+    float scale[4];
+    float offset[4];
+  };
+
+  template <PixelType T>
+  struct GradeRows;
+
+  // --- Tables
+
+  template <PixelType T>
+  static typename ChannelTraits<T>::Type GradeEntry(unsigned int v, float scale, float offset) {
+    typedef ChannelTraits<T> CT;
+    double one = double(CT::One());
+    return CT::FromDouble((double(v) / one * scale + offset) * one);
+  }
+
+  template <>
+  Half GradeEntry<PT_FLOAT_16>(unsigned int v, float scale, float offset) {
+    return FloatToHalf(HalfToFloat(Half(v)) * scale + offset);
+  }
+
+  static inline bool LittleEndian() {
+    static const unsigned int one = 1;
+    return (*((const unsigned char*) &one) == 1);
+  }
+
+  template <PixelType T>
+  struct GradeTables {
+    typedef typename ChannelTraits<T>::Type C;
+
+    enum {
+      Size = 1 << (8 * ChannelTraits<T>::Size)
+    };
+
+    template <unsigned int N>
+    static void Run(GradeArgs &args) {
+      C *tables = (C*) malloc(args.numChannels * Size * sizeof(C));
+
+      for (int c=0; c<args.numChannels; ++c) {
+        C *table = tables + c * Size;
+        bool identity = (args.scale[c] == 1.0f && args.offset[c] == 0.0f);
+        for (unsigned int v=0; v<(unsigned int)Size; ++v) {
+          table[v] = (identity ? C(v) : GradeEntry<T>(v, args.scale[c], args.offset[c]));
+        }
+      }
+
+      int numRows = int(args.rows.rows.size());
+
+      WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = args.rows.rows[y];
+
+        for (int plane=0; plane<args.numPlanes; ++plane) {
+          const C *table = tables + plane * Size;
+
+          if (Size == 256 && N == 4 && LittleEndian()) {
+            // RGBA8 pixels as words, one store per pixel
+            unsigned int *p = (unsigned int*) row.channels[plane];
+            for (size_t i=0; i<row.length; ++i) {
+              unsigned int w = p[i];
+              p[i] = ((unsigned int) table[w & 0xFF] |
+                      ((unsigned int) table[256 + ((w >> 8) & 0xFF)] << 8) |
+                      ((unsigned int) table[512 + ((w >> 16) & 0xFF)] << 16) |
+                      ((unsigned int) table[768 + (w >> 24)] << 24));
+            }
+            continue;
+          }
+
+          C *p = (C*) row.channels[plane];
+
+          for (size_t i=0; i<row.length; ++i, p+=N) {
+            for (unsigned int c=0; c<N; ++c) {
+              p[c] = table[c * Size + p[c]];
+            }
+          }
+        }
+      }
+
+      free(tables);
+    }
+  };
+
+  template <>
+  struct GradeRows<PT_INT_8> : public GradeTables<PT_INT_8> {
+  };
+
+  template <>
+  struct GradeRows<PT_INT_16> : public GradeTables<PT_INT_16> {
+  };
+
+  template <>
+  struct GradeRows<PT_FLOAT_16> : public GradeTables<PT_FLOAT_16> {
+  };
+
+  // --- Multiply-add
+
+  template <>
+  struct GradeRows<PT_FLOAT_32> {
+    template <unsigned int N>
+    static void Run(GradeArgs &args) {
+      int numRows = int(args.rows.rows.size());
+
+      WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = args.rows.rows[y];
+
+        for (int plane=0; plane<args.numPlanes; ++plane) {
+          // coefficients repeated over 12 values, a multiple of any channel count
+          float scale[12];
+          float offset[12];
+
+          for (unsigned int i=0; i<12; ++i) {
+            scale[i] = args.scale[plane + i % N];
+            offset[i] = args.offset[plane + i % N];
+          }
+
+          float *p = (float*) row.channels[plane];
+          size_t n = row.length * N;
+          size_t i = 0;
+
+#ifdef GIMG_SSE2
+          __m128 s0 = _mm_loadu_ps(scale);
+          __m128 s1 = _mm_loadu_ps(scale + 4);
+          __m128 s2 = _mm_loadu_ps(scale + 8);
+          __m128 o0 = _mm_loadu_ps(offset);
+          __m128 o1 = _mm_loadu_ps(offset + 4);
+          __m128 o2 = _mm_loadu_ps(offset + 8);
+
+          for (; i+12<=n; i+=12) {
+            _mm_storeu_ps(p + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p + i), s0), o0));
+            _mm_storeu_ps(p + i + 4, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p + i + 4), s1), o1));
+            _mm_storeu_ps(p + i + 8, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p + i + 8), s2), o2));
+          }
+#endif
+
+          for (; i<n; ++i) {
+            p[i] = p[i] * scale[i % 12] + offset[i % 12];
+          }
+        }
+      }
+    }
+  };
+
+  template <>
+  struct GradeRows<PT_INT_32> {
+    template <unsigned int N>
+    static void Run(GradeArgs &args) {
+      typedef ChannelTraits<PT_INT_32> CT;
+
+      int numRows = int(args.rows.rows.size());
+      double one = double(CT::One());
+
+      WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = args.rows.rows[y];
+
+        for (int plane=0; plane<args.numPlanes; ++plane) {
+          CT::Type *p = (CT::Type*) row.channels[plane];
+
+          for (size_t i=0; i<row.length; ++i, p+=N) {
+            for (unsigned int c=0; c<N; ++c) {
+              double s = args.scale[plane + c];
+              double o = args.offset[plane + c];
+              p[c] = CT::FromDouble((double(p[c]) / one * s + o) * one);
+            }
+          }
+        }
+      }
+    }
+  };
+
+  template <PixelFormat F, PixelType T>
+  struct GradeKernel {
+    static void Run(GradeArgs &args) {
+      GradeRows<T>::template Run<FormatTraits<F>::NumChannels>(args);
+    }
+  };
+
+  // ---
+
+  void Image::grade(const Color &black, const Color &white, const Color &lift, const Color &gain) {
+
+    if (!mDesc.isPlain()) {
+      std::cerr << "Cannot grade packed or compressed image format" << std::endl;
+      return;
+    }
+
+    GradeArgs args;
+    args.numChannels = mDesc.getNumChannels();
+
+    for (int c=0; c<args.numChannels; ++c) {
+      int comp = GradeComponents[mDesc.getFormat()][c];
+
+      args.scale[c] = 1.0f;
+      args.offset[c] = 0.0f;
+
+      if (comp >= 0) {
+        // (v - black) / (white - black) * (gain - lift) + lift, the division
+        // is skipped for null ranges as in Color::operator/=
+        float range = GradeComponent(white, comp) - GradeComponent(black, comp);
+        float scale = GradeComponent(gain, comp) - GradeComponent(lift, comp);
+        if (range > 0.000001f) {
+          scale /= range;
+        }
+        args.scale[c] = scale;
+        args.offset[c] = GradeComponent(lift, comp) - GradeComponent(black, comp) * scale;
+      }
+    }
+
+    // planes are graded as single channel rows
+    PixelDesc rowDesc = (mPlanar ? PixelDesc(PF_LUMINANCE, mDesc.getType()) : mDesc);
+    args.numPlanes = (mPlanar ? args.numChannels : 1);
+
+    ImageRows(*this, 0, mNumMipmaps, args.rows);
+
+    DispatchPlain<GradeKernel>(rowDesc, args);
+  }
+
+}
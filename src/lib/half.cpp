@@ -0,0 +1,258 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/half.h>
+
+#include "tables.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+# include <cpuid.h>
+# include <immintrin.h>
+# define GIMG_F16C
+# define GIMG_F16C_FUNC __attribute__((target("f16c")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+# include <intrin.h>
+# include <immintrin.h>
+# define GIMG_F16C
+# define GIMG_F16C_FUNC
+#endif
+
+namespace gimg {
+
+  union FloatBits {
+    float f;
+    unsigned int u;
+  };
+
+  // Lookup tables, see "Fast Half Float Conversions" (Jeroen van der Zijp)
+  // Float to half tables are indexed by the float biased exponent and
+  // keep enough information to round to nearest even
+
+  struct HalfTables {
+    
+    // half to float
+    unsigned int mantissa[2048];
+    unsigned int exponent[64];
+    unsigned short offset[64];
+    
+    // float to half
+    unsigned short base[256];
+    unsigned char shift[256];
+    unsigned int implicit[256];
+    
+    HalfTables() {
+      
+      mantissa[0] = 0;
+      for (unsigned int i=1; i<1024; ++i) {
+        // denormal, normalize mantissa
+        unsigned int m = i << 13;
+        unsigned int e = 0;
+        while ((m & 0x00800000) == 0) {
+          e -= 0x00800000;
+          m <<= 1;
+        }
+        m &= ~0x00800000U;
+        e += 0x38800000;
+        mantissa[i] = m | e;
+      }
+      for (unsigned int i=1024; i<2048; ++i) {
+        mantissa[i] = 0x38000000 + ((i - 1024) << 13);
+      }
+      
+      for (unsigned int i=0; i<64; ++i) {
+        unsigned int sign = (i >= 32 ? 0x80000000 : 0);
+        unsigned int e = (i & 0x1F);
+        if (e == 0) {
+          exponent[i] = sign;
+        } else if (e == 31) {
+          // infinity or NaN
+          exponent[i] = sign | 0x47800000;
+        } else {
+          exponent[i] = sign | (e << 23);
+        }
+        offset[i] = (e == 0 ? 0 : 1024);
+      }
+      
+      for (int i=0; i<256; ++i) {
+        int e = i - 127;
+        implicit[i] = 0;
+        if (e < -25) {
+          // rounds to 0
+          base[i] = 0;
+          shift[i] = 24;
+        } else if (e < -14) {
+          // half denormal, shift out the float implicit 1 too
+          base[i] = 0;
+          shift[i] = (unsigned char)(-e - 1);
+          implicit[i] = 0x00800000;
+        } else if (e <= 15) {
+          base[i] = (unsigned short)((e + 15) << 10);
+          shift[i] = 13;
+        } else {
+          // infinity (NaN are handled separately)
+          base[i] = 0x7C00;
+          shift[i] = 24;
+        }
+      }
+    }
+  };
+  
+  static const HalfTables& GetHalfTables() {
+    static HalfTables tables;
+    return tables;
+  }
+  
+  float HalfToFloat(Half h) {
+    const HalfTables &tables = GetHalfTables();
+    FloatBits bits;
+    unsigned int e = h >> 10;
+    bits.u = tables.mantissa[tables.offset[e] + (h & 0x03FF)] + tables.exponent[e];
+    return bits.f;
+  }
+  
+  Half FloatToHalf(float f) {
+    FloatBits bits;
+    bits.f = f;
+    
+    unsigned int sign = (bits.u >> 16) & 0x8000;
+    unsigned int e = (bits.u >> 23) & 0xFF;
+    unsigned int m = bits.u & 0x007FFFFF;
+    
+    if (e == 0xFF && m != 0) {
+      // NaN (keep it quiet)
+      return Half(sign | 0x7E00);
+    }
+    
+    // a mantissa carry correctly bumps the exponent (up to infinity)
+    const HalfTables &tables = GetHalfTables();
+    unsigned int s = tables.shift[e];
+    m |= tables.implicit[e];
+    unsigned int h = tables.base[e] + (m >> s);
+    unsigned int rem = m & ((1U << s) - 1);
+    unsigned int halfway = 1U << (s - 1);
+    if (rem > halfway || (rem == halfway && (h & 1) != 0)) {
+      ++h;
+    }
+    return Half(sign | h);
+  }
+  
+#ifdef GIMG_F16C
+  
+  static bool DetectF16C() {
+    // F16C instructions are VEX encoded, the OS must save AVX state too
+    unsigned int c = 0;
+    unsigned int xcr0 = 0;
+# ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    c = (unsigned int) info[2];
+    if ((c & (1U << 27)) != 0) {
+      xcr0 = (unsigned int) _xgetbv(0);
+    }
+# else
+    unsigned int a, b, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) {
+      return false;
+    }
+    if ((c & (1U << 27)) != 0) {
+      unsigned int hi;
+      __asm__ __volatile__ ("xgetbv" : "=a" (xcr0), "=d" (hi) : "c" (0));
+    }
+# endif
+    bool osxsave = ((c & (1U << 27)) != 0);
+    bool avx = ((c & (1U << 28)) != 0);
+    bool f16c = ((c & (1U << 29)) != 0);
+    return (osxsave && avx && f16c && (xcr0 & 0x6) == 0x6);
+  }
+  
+  static bool UseF16C() {
+    static const bool use = DetectF16C();
+    return use;
+  }
+  
+  GIMG_F16C_FUNC static void HalfToFloatF16C(const Half *src, float *dst, size_t n) {
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+      __m128i h = _mm_loadu_si128((const __m128i*)(src + i));
+      _mm_storeu_ps(dst + i, _mm_cvtph_ps(h));
+      _mm_storeu_ps(dst + i + 4, _mm_cvtph_ps(_mm_unpackhi_epi64(h, h)));
+    }
+    for (; i<n; ++i) {
+      dst[i] = HalfToFloat(src[i]);
+    }
+  }
+  
+  GIMG_F16C_FUNC static void FloatToHalfF16C(const float *src, Half *dst, size_t n) {
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+      // imm 0: round to nearest even
+      __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(src + i), 0);
+      __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(src + i + 4), 0);
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi64(lo, hi));
+    }
+    for (; i<n; ++i) {
+      dst[i] = FloatToHalf(src[i]);
+    }
+  }
+  
+#endif
+  
+  bool HasHalfInstructions() {
+#ifdef GIMG_F16C
+    return UseF16C();
+#else
+    return false;
+#endif
+  }
+  
+  void HalfToFloat(const Half *src, float *dst, size_t n) {
+#ifdef GIMG_F16C
+    if (UseF16C()) {
+      HalfToFloatF16C(src, dst, n);
+      return;
+    }
+#endif
+    for (size_t i=0; i<n; ++i) {
+      dst[i] = HalfToFloat(src[i]);
+    }
+  }
+  
+  void FloatToHalf(const float *src, Half *dst, size_t n) {
+#ifdef GIMG_F16C
+    if (UseF16C()) {
+      FloatToHalfF16C(src, dst, n);
+      return;
+    }
+#endif
+    for (size_t i=0; i<n; ++i) {
+      dst[i] = FloatToHalf(src[i]);
+    }
+  }
+  
+  void WarmHalfTables() {
+    GetHalfTables();
+    HasHalfInstructions();
+  }
+
+}
@@ -27,9 +27,16 @@ USA.
 # endif
 #endif
 #include <gimg/image.h>
+#include <gimg/half.h>
+#include <gimg/convert.h>
+#include <gimg/dxt.h>
+#include <gimg/pixeltraits.h>
 #include <limits>
 #include <cmath>
 #include <cassert>
+#include <algorithm>
+
+#include "tables.h"
 
 namespace gimg {
   
@@ -37,61 +44,95 @@ namespace gimg {
   Image::PluginMap Image::msReaders;
   Image::PluginMap Image::msWriters;
 
-  static void mipmap_int8(void *p0, void *p1, void *p2, void *p3, int n, void *to) {
-    unsigned char *c0 = (unsigned char *) p0;
-    unsigned char *c1 = (unsigned char *) p1;
-    unsigned char *c2 = (unsigned char *) p2;
-    unsigned char *c3 = (unsigned char *) p3;
-    unsigned char *r  = (unsigned char *) to;
-    for (int i=0; i<n; ++i) {
-      unsigned short tmp0 = ((unsigned short)*c0 + (unsigned short)*c1) / 2;
-      unsigned short tmp1 = ((unsigned short)*c2 + (unsigned short)*c3) / 2;
-      unsigned short res  = (tmp0 + tmp1) / 2;
-      *r = (res > 255) ? 255 : (unsigned char)res;
-      ++c0; ++c1; ++c2; ++c3; ++r;
-    }
-  }
-
-  static void mipmap_int16(void *p0, void *p1, void *p2, void *p3, int n, void *to) {
-    unsigned short *c0 = (unsigned short *) p0;
-    unsigned short *c1 = (unsigned short *) p1;
-    unsigned short *c2 = (unsigned short *) p2;
-    unsigned short *c3 = (unsigned short *) p3;
-    unsigned short *r  = (unsigned short *) to;
-    for (int i=0; i<n; ++i) {
-      unsigned long tmp0 = ((unsigned long)*c0 + (unsigned long)*c1) / 2;
-      unsigned long tmp1 = ((unsigned long)*c2 + (unsigned long)*c3) / 2;
-      unsigned long res  = (tmp0 + tmp1) / 2;
-      *r = (res > 65535) ? 65535 : (unsigned short)res;
-      ++c0; ++c1; ++c2; ++c3; ++r;
-    }
-  }
-
-  static void mipmap_int32(void *p0, void *p1, void *p2, void *p3, int n, void *to) {
-    unsigned long *c0 = (unsigned long *) p0;
-    unsigned long *c1 = (unsigned long *) p1;
-    unsigned long *c2 = (unsigned long *) p2;
-    unsigned long *c3 = (unsigned long *) p3;
-    unsigned long *r  = (unsigned long *) to;
-    for (int i=0; i<n; ++i) {
-      unsigned long tmp0 = (*c0 + *c1) / 2;
-      unsigned long tmp1 = (*c2 + *c3) / 2;
-      *r  = (tmp0 + tmp1) / 2;
-      ++c0; ++c1; ++c2; ++c3; ++r;
-    }
-  }
-
-  static void mipmap_float(void *p0, void *p1, void *p2, void *p3, int n, void *to) {
-    float *c0 = (float *) p0;
-    float *c1 = (float *) p1;
-    float *c2 = (float *) p2;
-    float *c3 = (float *) p3;
-    float *r  = (float *) to;
-    for (int i=0; i<n; ++i) {
-      float tmp0 = (*c0 + *c1) / 2.0f;
-      float tmp1 = (*c2 + *c3) / 2.0f;
-      *r  = (tmp0 + tmp1) / 2.0f;
-      ++c0; ++c1; ++c2; ++c3; ++r;
+  // 2x2 box reduction of a mip level, sources 1 pixel wide or high are
+  // averaged with themselves
+  struct MipmapArgs {
+    const void *src;
+    unsigned int srcWidth;
+    unsigned int srcHeight;
+    void *dst;
+    unsigned int width;
+    unsigned int height;
+  };
+
+  template <PixelFormat F, PixelType T>
+  struct MipmapKernel {
+    static void Run(MipmapArgs &args) {
+      typedef PixelTraits<F, T> P;
+      typedef typename P::Type C;
+      
+      const unsigned int N = P::NumChannels;
+      
+      size_t srcRowLen = args.srcWidth * N;
+      unsigned int dx = (args.srcWidth > 1 ? N : 0);
+      size_t dy = (args.srcHeight > 1 ? srcRowLen : 0);
+      
+      const C *srcImg = (const C*) args.src;
+      C *dst = (C*) args.dst;
+      
+      for (unsigned int y=0; y<args.height; ++y) {
+        
+        const C *p0 = srcImg + (2 * y * dy);
+        const C *p1 = p0 + dy;
+        
+        for (unsigned int x=0; x<args.width; ++x) {
+          for (unsigned int c=0; c<N; ++c) {
+            dst[c] = P::Channel::Average(p0[c], p0[dx+c], p1[c], p1[dx+c]);
+          }
+          p0 += 2 * dx;
+          p1 += 2 * dx;
+          dst += N;
+        }
+      }
+    }
+  };
+  
+  // Interleaved <-> planar copy of count pixels
+  struct PlanarArgs {
+    const void *src;
+    void *dst;
+    size_t count;
+    bool toPlanar;
+  };
+  
+  template <PixelFormat F, PixelType T>
+  struct PlanarKernel {
+    static void Run(PlanarArgs &args) {
+      typedef PixelTraits<F, T> P;
+      typedef typename P::Type C;
+      
+      const unsigned int N = P::NumChannels;
+      
+      const C *src = (const C*) args.src;
+      C *dst = (C*) args.dst;
+      
+      for (unsigned int c=0; c<N; ++c) {
+        if (args.toPlanar) {
+          C *plane = dst + c * args.count;
+          const C *pix = src + c;
+          for (size_t i=0; i<args.count; ++i, pix+=N) {
+            plane[i] = *pix;
+          }
+        } else {
+          const C *plane = src + c * args.count;
+          C *pix = dst + c;
+          for (size_t i=0; i<args.count; ++i, pix+=N) {
+            *pix = plane[i];
+          }
+        }
+      }
+    }
+  };
+  
+  // Planar levels are numPlanes single channel images one after the other,
+  // per channel operations (mipmaps, scaling, orientation) run on each
+  static PixelDesc StorageDesc(const PixelDesc &desc, bool planar, int &numPlanes) {
+    if (planar) {
+      numPlanes = desc.getNumChannels();
+      return PixelDesc(PF_LUMINANCE, desc.getType());
+    } else {
+      numPlanes = 1;
+      return desc;
     }
   }
   
@@ -205,15 +246,22 @@ namespace gimg {
       FilterWeights() {
       }
       FilterWeights(Filter *filter, unsigned int srcSize, unsigned int dstSize) {
-        initialize(filter, srcSize, dstSize);
+        initialize(filter, 0.0, double(srcSize), srcSize, dstSize);
+      }
+      FilterWeights(Filter *filter, double srcStart, double srcLength,
+                    unsigned int srcSize, unsigned int dstSize) {
+        initialize(filter, srcStart, srcLength, srcSize, dstSize);
       }
       ~FilterWeights() {
         mWeightsTable.clear();
       }
-      void initialize(Filter *filter, unsigned int srcSize, unsigned dstSize) {
+      // Map [srcStart, srcStart+srcLength[ to [0, dstSize[
+      // Source pixels outside of [0, srcSize[ are never referenced
+      void initialize(Filter *filter, double srcStart, double srcLength,
+                      unsigned int srcSize, unsigned dstSize) {
         assert(filter != 0);
         
-        double scale = double(dstSize) / double(srcSize);
+        double scale = double(dstSize) / srcLength;
         double width = filter->width();
         double fscale = 1.0;
         
@@ -243,10 +291,19 @@ namespace gimg {
           
           PixelWeights &pw = mWeightsTable[i];
           
-          double srcX = (double(i) + 0.5) * iscale; // - 0.5 ?
+          double srcX = srcStart + (double(i) + 0.5) * iscale; // - 0.5 ?
           
           unsigned int start = (unsigned int) maxval(0.0, floor(srcX-width));
-          unsigned int stop = (unsigned int) minval(ceil(srcX+width), double(srcSize)-1);
+          unsigned int stop = (unsigned int) minval(ceil(srcX+width), double(srcSize));
+          
+          if (stop <= start) {
+            // window entirely past the last source pixel
+            pw.start = srcSize - 1;
+            pw.length = 1;
+            pw.weights[0] = 1.0;
+            continue;
+          }
+          
           unsigned int len = minval(windowSize, stop-start);
           
           pw.start = start;
@@ -288,6 +345,20 @@ namespace gimg {
       inline double pixelWeight(unsigned int dstPos, unsigned int idx) const {
         return mWeightsTable[dstPos].weights[idx];
       }
+      // Range of source pixels referenced by the table: [first, last[
+      void sourceRange(unsigned int &first, unsigned int &last) const {
+        first = 0;
+        last = 0;
+        for (size_t i=0; i<mWeightsTable.size(); ++i) {
+          const PixelWeights &pw = mWeightsTable[i];
+          if (i == 0 || pw.start < first) {
+            first = pw.start;
+          }
+          if (pw.start + pw.length > last) {
+            last = pw.start + pw.length;
+          }
+        }
+      }
     protected:
       template <typename T> inline T maxval(T v0, T v1) {
         return (v0 > v1 ? v0 : v1);
@@ -299,126 +370,601 @@ namespace gimg {
       std::vector<PixelWeights> mWeightsTable;
   };
 
-  typedef void (*PixelInitFunc)(unsigned int, void *dst);
-  typedef void (*PixelAccumFunc)(unsigned int, void *dst, double weight, void *src);
+  // Separable filter passes, specialized per plain format and type
+  // Filtered pixels are accumulated in double precision and converted back to
+  // the channel type once all the filter taps have been applied
+  struct ScalePassArgs {
+    const void *src;
+    void *dst;
+    // vertical: row length in pixels, horizontal: number of rows
+    unsigned int count;
+    // vertical: index of the source row src points to, as referenced by weights
+    unsigned int firstRow;
+    // horizontal: byte size of a full source row (may be larger than the
+    // filtered span)
+    size_t srcRowSize;
+    const FilterWeights *weights;
+    unsigned int newSize;
+  };
   
-  static void* scaleVertical(void *src, unsigned int width, unsigned int height,
-                             unsigned pixChannels, unsigned int pixSize,
-                             Filter *filter, unsigned int newHeight,
-                             PixelInitFunc pixInit, PixelAccumFunc pixAccum) {
-    
-    FilterWeights weights(filter, height, newHeight);
-    
-    unsigned int rowSize = width * pixSize;
-    
-    unsigned char *srcImg = (unsigned char*) src;
-    unsigned char *dstImg = (unsigned char*) malloc(newHeight * rowSize);
-    
-    for (unsigned int i=0; i<width; ++i) {
+  template <PixelFormat F, PixelType T>
+  struct ScaleVerticalKernel {
+    static void Run(ScalePassArgs &args) {
+      typedef PixelTraits<F, T> P;
+      typedef typename P::Type C;
       
-      unsigned char *srcCol = srcImg + (i * pixSize);
-      unsigned char *dstCol = dstImg + (i * pixSize);
+      const unsigned int N = P::NumChannels;
       
-      for (unsigned int j=0; j<newHeight; ++j) {
-        
-        unsigned char *dstPix = dstCol + (j * rowSize);
-        
-        pixInit(pixChannels, dstPix);
+      const FilterWeights &weights = *(args.weights);
+      size_t rowLen = size_t(args.count) * N;
+      
+      const C *srcImg = (const C*) args.src;
+      C *dstImg = (C*) args.dst;
+      
+      for (unsigned int i=0; i<args.count; ++i) {
         
-        unsigned int s = weights.firstPixel(j);
-        unsigned int n = weights.numPixels(j);
+        const C *srcCol = srcImg + (i * N);
+        C *dstCol = dstImg + (i * N);
         
-        for (unsigned int k=0; k<n; ++k) {
+        for (unsigned int j=0; j<args.newSize; ++j) {
           
-          double weight = weights.pixelWeight(j, k);
+          double acc[N];
+          for (unsigned int c=0; c<N; ++c) {
+            acc[c] = 0.0;
+          }
+          
+          unsigned int s = weights.firstPixel(j) - args.firstRow;
+          unsigned int n = weights.numPixels(j);
           
-          unsigned char *srcPix = srcCol + ((s + k) * rowSize);
+          for (unsigned int k=0; k<n; ++k) {
+            double weight = weights.pixelWeight(j, k);
+            const C *srcPix = srcCol + ((s + k) * rowLen);
+            for (unsigned int c=0; c<N; ++c) {
+              acc[c] += weight * P::Channel::ToDouble(srcPix[c]);
+            }
+          }
           
-          pixAccum(pixChannels, dstPix, weight, srcPix);
+          C *dstPix = dstCol + (j * rowLen);
+          for (unsigned int c=0; c<N; ++c) {
+            dstPix[c] = P::Channel::FromDouble(acc[c]);
+          }
         }
       }
     }
-    
-    return dstImg;
-  }
+  };
   
-  static void* scaleHorizontal(void *src, unsigned int width, unsigned int height,
-                               unsigned pixChannels, unsigned int pixSize,
-                               Filter *filter, unsigned int newWidth,
-                               PixelInitFunc pixInit, PixelAccumFunc pixAccum) {
-    
-    FilterWeights weights(filter, width, newWidth);
-    
-    unsigned int srcRowSize = width * pixSize;
-    unsigned int dstRowSize = newWidth * pixSize;
-    
-    unsigned char *srcImg = (unsigned char*) src;
-    unsigned char *dstImg = (unsigned char*) malloc(height * dstRowSize);
-    
-    for (unsigned int i=0; i<height; ++i) {
+  template <PixelFormat F, PixelType T>
+  struct ScaleHorizontalKernel {
+    static void Run(ScalePassArgs &args) {
+      typedef PixelTraits<F, T> P;
+      typedef typename P::Type C;
       
-      unsigned char *srcRow = srcImg + (i * srcRowSize);
-      unsigned char *dstRow = dstImg + (i * dstRowSize);
+      const unsigned int N = P::NumChannels;
       
-      for (unsigned int j=0; j<newWidth; ++j) {
-        
-        unsigned char *dstPix = dstRow + (j * pixSize);
-        
-        pixInit(pixChannels, dstPix);
+      const FilterWeights &weights = *(args.weights);
+      
+      const unsigned char *srcImg = (const unsigned char*) args.src;
+      C *dstRow = (C*) args.dst;
+      
+      for (unsigned int i=0; i<args.count; ++i) {
         
-        unsigned int s = weights.firstPixel(j);
-        unsigned int n = weights.numPixels(j);
+        const C *srcRow = (const C*) (srcImg + (i * args.srcRowSize));
         
-        for (unsigned int k=0; k<n; ++k) {
+        for (unsigned int j=0; j<args.newSize; ++j, dstRow+=N) {
+          
+          double acc[N];
+          for (unsigned int c=0; c<N; ++c) {
+            acc[c] = 0.0;
+          }
           
-          double weight = weights.pixelWeight(j, k);
+          const C *srcPix = srcRow + (weights.firstPixel(j) * N);
+          unsigned int n = weights.numPixels(j);
           
-          unsigned char *srcPix = srcRow + ((s + k) * pixSize);
+          for (unsigned int k=0; k<n; ++k, srcPix+=N) {
+            double weight = weights.pixelWeight(j, k);
+            for (unsigned int c=0; c<N; ++c) {
+              acc[c] += weight * P::Channel::ToDouble(srcPix[c]);
+            }
+          }
           
-          pixAccum(pixChannels, dstPix, weight, srcPix);
+          for (unsigned int c=0; c<N; ++c) {
+            dstRow[c] = P::Channel::FromDouble(acc[c]);
+          }
         }
       }
     }
-    
-    return dstImg;
-  }
+  };
   
-  template <typename T>
-  static void pixInitT(unsigned int nChan, void *pix) {
-    T *pixt = (T*)pix;
-    for (unsigned int i=0; i<nChan; ++i) {
-      pixt[i] = T(0);
-    }
+  // firstRow: index of the source row src points to, as referenced by weights
+  // dst: output buffer, allocated if 0
+  static void* scaleVertical(void *src, unsigned int width, unsigned int firstRow,
+                             const PixelDesc &desc, const FilterWeights &weights,
+                             unsigned int newHeight, void *dst=0) {
+    
+    size_t rowSize = width * desc.getBytesPerPixel();
+    
+    ScalePassArgs args;
+    args.src = src;
+    args.dst = (dst ? dst : malloc(newHeight * rowSize));
+    args.count = width;
+    args.firstRow = firstRow;
+    args.srcRowSize = rowSize;
+    args.weights = &weights;
+    args.newSize = newHeight;
+    
+    DispatchPlain<ScaleVerticalKernel>(desc, args);
+    
+    return args.dst;
   }
   
-  template <typename T>
-  static void pixAccumTClamped(unsigned int nChan, void *dst, double w, void *src) {
+  // srcRowSize: byte size of a full source row (may be larger than the filtered span)
+  static void* scaleHorizontal(void *src, size_t srcRowSize, unsigned int height,
+                               const PixelDesc &desc, const FilterWeights &weights,
+                               unsigned int newWidth) {
     
-    static double sToT = double((std::numeric_limits<T>::max)());
-    static double sToD = 1.0 / sToT;
+    ScalePassArgs args;
+    args.src = src;
+    args.dst = malloc(height * newWidth * desc.getBytesPerPixel());
+    args.count = height;
+    args.firstRow = 0;
+    args.srcRowSize = srcRowSize;
+    args.weights = &weights;
+    args.newSize = newWidth;
     
-    T *tsrc = (T *)src;
-    T *tdst = (T *)dst;
+    DispatchPlain<ScaleHorizontalKernel>(desc, args);
     
-    for (unsigned int i=0; i<nChan; ++i) {
-      double v = sToD*tdst[i] + w * (sToD*tsrc[i]);
-      v = (v > 1.0 ? 1.0 : (v < 0.0 ? 0.0 : v));
-      tdst[i] = T(floor(v * sToT));
+    return args.dst;
+  }
+
+  // Integer ratio scaling
+  //
+  // Exact 2x/4x/8x box reductions and integer factor nearest/linear enlargements
+  // have a footprint known in advance, no need to go through FilterWeights
+
+  template <typename T, typename A>
+  struct BoxAverage {
+    static inline T Get(A sum, A count) {
+      return T((sum + count / 2) / count);
+    }
+  };
+
+  template <>
+  struct BoxAverage<float, float> {
+    static inline float Get(float sum, float count) {
+      return (sum / count);
+    }
+  };
+
+  template <>
+  struct BoxAverage<unsigned int, double> {
+    static inline unsigned int Get(double sum, double count) {
+      return (unsigned int) floor(sum / count + 0.5);
+    }
+  };
+
+  template <typename T, typename A>
+  struct LerpStore {
+    static inline T Get(A v) {
+      static A sMax = A((std::numeric_limits<T>::max)());
+      v = floor(v + A(0.5));
+      return T(v < A(0) ? A(0) : (v > sMax ? sMax : v));
+    }
+  };
+
+  template <>
+  struct LerpStore<float, float> {
+    static inline float Get(float v) {
+      return v;
     }
+  };
+
+  template <typename T, typename A, unsigned int F>
+  static void* boxReduce(void *src, unsigned int width, unsigned int height, unsigned int nChan) {
+
+    unsigned int newWidth = width / F;
+    unsigned int newHeight = height / F;
+    unsigned int srcRowLen = width * nChan;
+    unsigned int dstRowLen = newWidth * nChan;
+
+    T *srcImg = (T*) src;
+    T *dstImg = (T*) malloc(newHeight * dstRowLen * sizeof(T));
+
+    std::vector<A> sums(dstRowLen);
+
+    for (unsigned int j=0; j<newHeight; ++j) {
+
+      std::fill(sums.begin(), sums.end(), A(0));
+
+      for (unsigned int k=0; k<F; ++k) {
+
+        T *srcPix = srcImg + ((j * F + k) * srcRowLen);
+        A *sum = &sums[0];
+
+        for (unsigned int i=0; i<newWidth; ++i) {
+          for (unsigned int l=0; l<F; ++l) {
+            for (unsigned int c=0; c<nChan; ++c) {
+              sum[c] += A(srcPix[c]);
+            }
+            srcPix += nChan;
+          }
+          sum += nChan;
+        }
+      }
+
+      T *dstRow = dstImg + (j * dstRowLen);
+
+      for (unsigned int i=0; i<dstRowLen; ++i) {
+        dstRow[i] = BoxAverage<T, A>::Get(sums[i], A(F * F));
+      }
+    }
+
+    return dstImg;
   }
-  
-  template <typename T>
-  static void pixAccumT(unsigned int nChan, void *dst, double w, void *src) {
+
+  static void* nearestEnlarge(void *src, unsigned int width, unsigned int height,
+                              unsigned int pixSize, unsigned int fx, unsigned int fy) {
+
+    unsigned int srcRowSize = width * pixSize;
+    unsigned int dstRowSize = width * fx * pixSize;
+
+    unsigned char *srcImg = (unsigned char*) src;
+    unsigned char *dstImg = (unsigned char*) malloc(height * fy * dstRowSize);
+
+    for (unsigned int j=0; j<height; ++j) {
+
+      unsigned char *srcPix = srcImg + (j * srcRowSize);
+      unsigned char *dstRow = dstImg + (j * fy * dstRowSize);
+      unsigned char *dstPix = dstRow;
+
+      for (unsigned int i=0; i<width; ++i) {
+        for (unsigned int k=0; k<fx; ++k) {
+          memcpy(dstPix, srcPix, pixSize);
+          dstPix += pixSize;
+        }
+        srcPix += pixSize;
+      }
+
+      // remaining rows are plain copies of the first one
+      for (unsigned int k=1; k<fy; ++k) {
+        memcpy(dstRow + (k * dstRowSize), dstRow, dstRowSize);
+      }
+    }
+
+    return dstImg;
+  }
+
+  // For an integer factor f, destination pixel q*f+p always falls between source
+  // pixels q+offset[p] and q+offset[p]+1 with the same weight
+  template <typename A>
+  static void linearPhases(unsigned int f, std::vector<int> &offsets, std::vector<A> &weights) {
+    offsets.resize(f);
+    weights.resize(f);
+    for (unsigned int p=0; p<f; ++p) {
+      A t = (A(p) + A(0.5)) / A(f);
+      if (t < A(0.5)) {
+        offsets[p] = -1;
+        weights[p] = t + A(0.5);
+      } else {
+        offsets[p] = 0;
+        weights[p] = t - A(0.5);
+      }
+    }
+  }
+
+  template <typename T, typename A>
+  static void linearEnlargeRow(T *srcRow, unsigned int width, unsigned int nChan, unsigned int fx,
+                               const std::vector<int> &offsets, const std::vector<A> &weights,
+                               A *dstRow) {
+    int last = int(width) - 1;
+
+    for (int q=0; q<=last; ++q) {
+      for (unsigned int p=0; p<fx; ++p) {
+
+        int i0 = q + offsets[p];
+        int i1 = i0 + 1;
+        i0 = (i0 < 0 ? 0 : i0);
+        i1 = (i1 > last ? last : i1);
+
+        T *s0 = srcRow + (i0 * nChan);
+        T *s1 = srcRow + (i1 * nChan);
+        A w1 = weights[p];
+        A w0 = A(1) - w1;
+
+        for (unsigned int c=0; c<nChan; ++c) {
+          dstRow[c] = w0 * A(s0[c]) + w1 * A(s1[c]);
+        }
+        dstRow += nChan;
+      }
+    }
+  }
+
+  template <typename T, typename A>
+  static void* linearEnlarge(void *src, unsigned int width, unsigned int height,
+                             unsigned int nChan, unsigned int fx, unsigned int fy) {
+
+    unsigned int newHeight = height * fy;
+    unsigned int srcRowLen = width * nChan;
+    unsigned int dstRowLen = width * fx * nChan;
+
+    std::vector<int> xoffsets, yoffsets;
+    std::vector<A> xweights, yweights;
+
+    linearPhases(fx, xoffsets, xweights);
+    linearPhases(fy, yoffsets, yweights);
+
+    T *srcImg = (T*) src;
+    T *dstImg = (T*) malloc(newHeight * dstRowLen * sizeof(T));
+
+    // keep the last two horizontally enlarged source rows around
+    std::vector<A> cache(2 * dstRowLen);
+    int cached[2] = {-1, -1};
+    int last = int(height) - 1;
+
+    for (unsigned int j=0; j<newHeight; ++j) {
+
+      unsigned int q = j / fy;
+      unsigned int p = j % fy;
+
+      int need[2];
+      need[0] = int(q) + yoffsets[p];
+      need[1] = need[0] + 1;
+      need[0] = (need[0] < 0 ? 0 : need[0]);
+      need[1] = (need[1] > last ? last : need[1]);
+
+      A *rows[2];
+
+      for (int n=0; n<2; ++n) {
+        int slot;
+        if (cached[0] == need[n]) {
+          slot = 0;
+        } else if (cached[1] == need[n]) {
+          slot = 1;
+        } else {
+          slot = (cached[0] == need[1-n] ? 1 : 0);
+          linearEnlargeRow(srcImg + (need[n] * srcRowLen), width, nChan, fx,
+                           xoffsets, xweights, &cache[slot * dstRowLen]);
+          cached[slot] = need[n];
+        }
+        rows[n] = &cache[slot * dstRowLen];
+      }
+
+      A w1 = yweights[p];
+      A w0 = A(1) - w1;
+
+      T *dstRow = dstImg + (j * dstRowLen);
+
+      for (unsigned int i=0; i<dstRowLen; ++i) {
+        dstRow[i] = LerpStore<T, A>::Get(w0 * rows[0][i] + w1 * rows[1][i]);
+      }
+    }
+
+    return dstImg;
+  }
+
+  typedef void* (*IntegerRatioScaleFunc)(void *src, unsigned int width, unsigned int height,
+                                         unsigned int nChan, unsigned int newWidth,
+                                         unsigned int newHeight, Image::ScaleMethod method);
+
+  // Returns 0 when no specialized kernel applies
+  template <typename T, typename BoxA, typename LerpA>
+  static void* scaleIntegerRatio(void *src, unsigned int width, unsigned int height,
+                                 unsigned int nChan, unsigned int newWidth,
+                                 unsigned int newHeight, Image::ScaleMethod method) {
+
+    if (newWidth >= width && newHeight >= height) {
+
+      if ((newWidth % width) != 0 || (newHeight % height) != 0) {
+        return 0;
+      }
+
+      unsigned int fx = newWidth / width;
+      unsigned int fy = newHeight / height;
+
+      if (method == Image::NEAREST) {
+        return nearestEnlarge(src, width, height, nChan * sizeof(T), fx, fy);
+
+      } else if (method == Image::LINEAR) {
+        return linearEnlarge<T, LerpA>(src, width, height, nChan, fx, fy);
+      }
+
+    } else if (method == Image::NEAREST) {
+
+      if (newWidth * 2 == width && newHeight * 2 == height) {
+        return boxReduce<T, BoxA, 2>(src, width, height, nChan);
+
+      } else if (newWidth * 4 == width && newHeight * 4 == height) {
+        return boxReduce<T, BoxA, 4>(src, width, height, nChan);
+
+      } else if (newWidth * 8 == width && newHeight * 8 == height) {
+        return boxReduce<T, BoxA, 8>(src, width, height, nChan);
+      }
+    }
+
+    return 0;
+  }
+
+  // Bit exact kernels only, for channel types without native arithmetic (half)
+  static void* scaleNearestRatio(void *src, unsigned int width, unsigned int height,
+                                 unsigned int nChan, unsigned int newWidth,
+                                 unsigned int newHeight, Image::ScaleMethod method) {
     
-    T *tsrc = (T *)src;
-    T *tdst = (T *)dst;
+    if (method == Image::NEAREST &&
+        newWidth >= width && (newWidth % width) == 0 &&
+        newHeight >= height && (newHeight % height) == 0) {
+      return nearestEnlarge(src, width, height, nChan * sizeof(Half),
+                            newWidth / width, newHeight / height);
+    }
     
-    for (unsigned int i=0; i<nChan; ++i) {
-      double v = double(tdst[i]) + w * double(tsrc[i]);
-      tdst[i] = T(v);
+    return 0;
+  }
+
+  // Integer ratio kernel and its accumulator types for each channel type
+  template <PixelType T>
+  struct IntegerRatio;
+
+  template <>
+  struct IntegerRatio<PT_INT_8> {
+    static IntegerRatioScaleFunc Get() {
+      return &scaleIntegerRatio<unsigned char, unsigned int, float>;
+    }
+  };
+
+  template <>
+  struct IntegerRatio<PT_INT_16> {
+    static IntegerRatioScaleFunc Get() {
+      return &scaleIntegerRatio<unsigned short, unsigned int, float>;
+    }
+  };
+
+  template <>
+  struct IntegerRatio<PT_INT_32> {
+    static IntegerRatioScaleFunc Get() {
+      return &scaleIntegerRatio<unsigned int, double, double>;
+    }
+  };
+
+  template <>
+  struct IntegerRatio<PT_FLOAT_16> {
+    static IntegerRatioScaleFunc Get() {
+      return &scaleNearestRatio;
+    }
+  };
+
+  template <>
+  struct IntegerRatio<PT_FLOAT_32> {
+    static IntegerRatioScaleFunc Get() {
+      return &scaleIntegerRatio<float, float, float>;
     }
+  };
+
+  // Orientation
+  //
+  // Pixels are moved as opaque N bytes blocks so any plain or packed pixel
+  // layout is handled by the same code
+
+  template <size_t N>
+  struct PixelBytes {
+    unsigned char bytes[N];
+  };
+
+  enum Rotation {
+    ROT_TRANSPOSE = 0,
+    ROT_CW,
+    ROT_CCW
+  };
+
+  template <size_t N>
+  static void flipRowT(void *row, unsigned int width) {
+    PixelBytes<N> *pix = (PixelBytes<N>*) row;
+    std::reverse(pix, pix + width);
   }
-  
+
+  typedef void (*FlipRowFunc)(void*, unsigned int);
+
+  // Destination is height x width, source is walked in square tiles so that
+  // both the strided reads and the writes stay in cache
+  template <size_t N>
+  static void rotateT(const void *src, unsigned int width, unsigned int height, Rotation rot, void *dst) {
+
+    static const unsigned int sTile = 32;
+
+    const PixelBytes<N> *in = (const PixelBytes<N>*) src;
+    PixelBytes<N> *out = (PixelBytes<N>*) dst;
+
+    for (unsigned int y0=0; y0<height; y0+=sTile) {
+
+      unsigned int y1 = (y0 + sTile < height ? y0 + sTile : height);
+
+      for (unsigned int x0=0; x0<width; x0+=sTile) {
+
+        unsigned int x1 = (x0 + sTile < width ? x0 + sTile : width);
+
+        for (unsigned int x=x0; x<x1; ++x) {
+
+          // source column x becomes destination row
+          PixelBytes<N> *drow;
+          int step;
+
+          switch (rot) {
+          case ROT_CW:
+            drow = out + (x * height) + (height - 1 - y0);
+            step = -1;
+            break;
+          case ROT_CCW:
+            drow = out + ((width - 1 - x) * height) + y0;
+            step = 1;
+            break;
+          case ROT_TRANSPOSE:
+          default:
+            drow = out + (x * height) + y0;
+            step = 1;
+          }
+
+          const PixelBytes<N> *scol = in + (y0 * width) + x;
+
+          for (unsigned int y=y0; y<y1; ++y) {
+            *drow = *scol;
+            drow += step;
+            scol += width;
+          }
+        }
+      }
+    }
+  }
+
+  typedef void (*RotateFunc)(const void*, unsigned int, unsigned int, Rotation, void*);
+
+  static bool GetOrientationFuncs(size_t pixSize, FlipRowFunc &flipFunc, RotateFunc &rotFunc) {
+    switch (pixSize) {
+    case 1:
+      flipFunc = &flipRowT<1>;
+      rotFunc = &rotateT<1>;
+      return true;
+    case 2:
+      flipFunc = &flipRowT<2>;
+      rotFunc = &rotateT<2>;
+      return true;
+    case 3:
+      flipFunc = &flipRowT<3>;
+      rotFunc = &rotateT<3>;
+      return true;
+    case 4:
+      flipFunc = &flipRowT<4>;
+      rotFunc = &rotateT<4>;
+      return true;
+    case 6:
+      flipFunc = &flipRowT<6>;
+      rotFunc = &rotateT<6>;
+      return true;
+    case 8:
+      flipFunc = &flipRowT<8>;
+      rotFunc = &rotateT<8>;
+      return true;
+    case 12:
+      flipFunc = &flipRowT<12>;
+      rotFunc = &rotateT<12>;
+      return true;
+    case 16:
+      flipFunc = &flipRowT<16>;
+      rotFunc = &rotateT<16>;
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  static bool CheckOrientable(const PixelDesc &desc, FlipRowFunc &flipFunc, RotateFunc &rotFunc) {
+    if (desc.isCompressed()) {
+      std::cerr << "Cannot re-orient compressed image format" << std::endl;
+      return false;
+    }
+    if (!GetOrientationFuncs(desc.getBytesPerPixel(), flipFunc, rotFunc)) {
+      std::cerr << "Unsupported pixel size" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
   static bool EnumPlugins(const gcore::Path &path) {
     if (path.isFile()) {
       
@@ -520,18 +1066,37 @@ namespace gimg {
     msPlugins.clear();
   }
   
-  Image* Image::Read(const gcore::Path &filepath, int numMips) {
+  Image* Image::Read(const gcore::Path &filepath, int numMips,
+                     const PixelDesc *desc, int flags) {
     
     gcore::String ext = filepath.getExtension();
     
     PluginMap::iterator it = msReaders.find(ext.c_str());
     
+    if (desc && !desc->isValid()) {
+      std::cerr << "Invalid pixel description requested" << std::endl;
+      return 0;
+    }
+    
+    // mipmaps can only be built for plain pixels, compressed requests
+    // are encoded once all levels are there
+    const PixelDesc *readDesc = 0;
+    
+    if (desc && (desc->isPlain() || (desc->isPacked() && numMips <= 0))) {
+      readDesc = desc;
+    }
+    
     if (it != msReaders.end()) {
-      Image *img = it->second->readImage(filepath.fullname().c_str());
+      Image *img = it->second->readImage(filepath.fullname().c_str(), readDesc, flags);
       if (img) {
         if (img->getNumMipmaps() <= 0 && numMips > 0) {
           img->buildMipmaps(numMips);
         }
+        if (desc && img->getPixelDesc() != *desc) {
+          Image *tmp = img->convert(*desc, flags);
+          delete img;
+          img = tmp;
+        }
         return img;
       }
     }
@@ -545,6 +1110,13 @@ namespace gimg {
     PluginMap::iterator it = msWriters.find(ext.c_str());
     
     if (it != msWriters.end()) {
+      if (img->isPlanar()) {
+        // writers expect interleaved pixels
+        Image *tmp = img->convert(img->getPixelDesc());
+        bool rv = (tmp && it->second->writeImage(tmp, filepath.fullname().c_str()));
+        delete tmp;
+        return rv;
+      }
       return it->second->writeImage(img, filepath.fullname().c_str());
     }
     
@@ -556,35 +1128,26 @@ namespace gimg {
 
   Image::Image(PixelDesc desc, int w, int h, int d, int numMipmaps)
     :mMaxWidth(w), mMaxHeight(h), mMaxDepth(d),
-     mNumMipmaps(numMipmaps), mDesc(desc) {
+     mNumMipmaps(numMipmaps), mOrientation(ORIENT_NORMAL), mPlanar(false), mDesc(desc) {
 
-    // adjust mipmap count if needed
-    int maxMipmaps = desc.getMaxMipmaps(w, h, d);
-    
-    if (mNumMipmaps < 0 || mNumMipmaps > maxMipmaps) {
-      mNumMipmaps = maxMipmaps;
-    }
+    // mipmap count is clamped by the layout
+    mLayout.reset(desc, w, h, d, numMipmaps);
+    mNumMipmaps = mLayout.getNumLevels() - 1;
 
     // allocate memory for all faces, all mipmaps
 
-    int n = mNumMipmaps;
-    int fc = (d <= 0 ? 6 : 1);
+    int fc = mLayout.getNumFaces();
     
     MipLevel mipData;
     
-    while (n >= 0) {
+    for (int level=0; level<=mNumMipmaps; ++level) {
       
-      int level = mNumMipmaps - n;
-
-      size_t sz = desc.getBytesSizeFor(w, h, d, level, 1);
-
-      int levelw = desc.getMipmappedDim(w, level);
-      int levelh = desc.getMipmappedDim(h, level);
-      int leveld = desc.getMipmappedDim(d, level);
+      size_t sz = mLayout.getBytesSize(level);
 
 #ifdef _DEBUG
-      std::cout << "Mip level " << n << ": " << levelw << "x" << levelh << "x"
-                << leveld << ", " << sz << " bytes" << std::endl;
+      std::cout << "Mip level " << level << ": " << mLayout.getWidth(level) << "x"
+                << mLayout.getHeight(level) << "x" << mLayout.getDepth(level)
+                << ", " << sz << " bytes" << std::endl;
 #endif
 
       for (int i=0; i<fc; ++i) {
@@ -594,14 +1157,12 @@ namespace gimg {
 #endif
 
         mipData.data   = malloc(sz);
-        mipData.width  = levelw;
-        mipData.height = levelh;
-        mipData.depth  = leveld;
+        mipData.width  = mLayout.getWidth(level);
+        mipData.height = mLayout.getHeight(level);
+        mipData.depth  = mLayout.getDepth(level);
 
         mFaces[i].push_back(mipData);
       }
-      
-      --n;
     }
   }
   
@@ -627,9 +1188,14 @@ namespace gimg {
       assert(mFaces[i].size() <= 1);
     }
     mNumMipmaps = 0;
+    mLayout.reset(mDesc, mMaxWidth, mMaxHeight, mMaxDepth, 0);
   }
 
-  void Image::buildMipmaps(int numMipmaps) {
+  static bool HasAlpha(const PixelDesc &desc) {
+    return (desc.getFormat() == PF_RGBA || desc.getFormat() == PF_LUMINANCE_ALPHA);
+  }
+  
+  void Image::buildMipmaps(int numMipmaps, bool premultAlpha) {
 #ifdef _DEBUG
     std::cout << "Build image mipmaps" << std::endl;
 #endif
@@ -643,46 +1209,32 @@ namespace gimg {
       return;
     }
 
-    if (mDesc.isFloat() && mDesc.getBytesPerChannel() == 2) {
-      std::cerr << "Cannot build mipmaps for a half float image format" << std::endl;
-      return;
-    }
-
     if (is3D()) {
       std::cerr << "Cannot build mipmaps for a 3D texture" << std::endl;
       return;
     }
     
-    int maxMipmaps = mDesc.getMaxMipmaps(mMaxWidth, mMaxHeight, mMaxDepth);
+    MipLayout layout(mDesc, mMaxWidth, mMaxHeight, mMaxDepth, numMipmaps);
     
-    if (numMipmaps < 0) {
-      numMipmaps = maxMipmaps;
-    }
-
-    if (numMipmaps > maxMipmaps) {
-      numMipmaps = maxMipmaps;
-    }
+    numMipmaps = layout.getNumLevels() - 1;
+    
+    int numPlanes;
+    PixelDesc planeDesc = StorageDesc(mDesc, mPlanar, numPlanes);
     
 #ifdef _DEBUG
     std::cout << "Num mipmaps = " << numMipmaps << std::endl;
 #endif
-
-    size_t pixSize = mDesc.getBytesPerPixel();
-    size_t chanSize = mDesc.getBytesPerChannel();
-    int nChan = mDesc.getNumChannels();
-
-    void (*mipmap_func)(void*, void*, void*, void*, int, void*);
-
-    if (mDesc.isFloat()) {
-      mipmap_func = mipmap_float;
-    } else {
-      if (chanSize == 1) {
-        mipmap_func = mipmap_int8;
-      } else if (chanSize == 2) {
-        mipmap_func = mipmap_int16;
-      } else {
-        mipmap_func = mipmap_int32;
+    
+    // base levels are premultiplied in place, originals restored afterwards
+    std::vector<void*> baseLevels;
+    
+    if (premultAlpha && HasAlpha(mDesc)) {
+      for (int i=0; i<NUM_FACES && mFaces[i].size() > 0; ++i) {
+        void *base = malloc(layout.getBytesSize(0));
+        memcpy(base, mFaces[i][0].data, layout.getBytesSize(0));
+        baseLevels.push_back(base);
       }
+      premultLevels(false, 0);
     }
 
     for (int i=0; i<NUM_FACES; ++i) {
@@ -695,40 +1247,33 @@ namespace gimg {
       
       for (int level=1; level<=numMipmaps; ++level) {
 
-        ml.data = malloc(mDesc.getBytesSizeFor(mMaxWidth, mMaxHeight, 1, level, 1));
-        ml.width = mDesc.getMipmappedDim(mMaxWidth, level);
-        ml.height = mDesc.getMipmappedDim(mMaxHeight, level);
+        ml.data = malloc(layout.getBytesSize(level));
+        ml.width = layout.getWidth(level);
+        ml.height = layout.getHeight(level);
         ml.depth = 1;
 
 
 #ifdef _DEBUG
         std::cout << "Mipmap level " << level << " for face " << i << ": "
                   << ml.width << "x" << ml.height << ", "
-                  << mDesc.getBytesSizeFor(mMaxWidth, mMaxHeight, 1, level, 1) << " bytes" << std::endl;
+                  << layout.getBytesSize(level) << " bytes" << std::endl;
 #endif
 
-        size_t rowSize = mFaces[i][level-1].width * pixSize;
-
-        unsigned char *p0, *p1, *p2, *p3, *pr;
-
-        for (int y=0; y<ml.height; ++y) {
-
-          pr = ((unsigned char*) ml.data) + (y * ml.width * pixSize);
-          p0 = ((unsigned char*) mFaces[i][level-1].data) + (2 * y * rowSize);
-          p1 = p0 + pixSize;
-          p2 = p0 + rowSize;
-          p3 = p2 + pixSize;
-
-          for (int x=0; x<ml.width; ++x) {
-
-            mipmap_func(p0, p1, p2, p3, nChan, pr);
-
-            p0 += 2*pixSize;
-            p1 += 2*pixSize;
-            p2 += 2*pixSize;
-            p3 += 2*pixSize;
-            pr += pixSize;
-          }
+        const MipLevel &prev = mFaces[i][level-1];
+        
+        size_t srcPlaneSize = layout.getBytesSize(level-1) / numPlanes;
+        size_t dstPlaneSize = layout.getBytesSize(level) / numPlanes;
+        
+        MipmapArgs args;
+        args.srcWidth = prev.width;
+        args.srcHeight = prev.height;
+        args.width = ml.width;
+        args.height = ml.height;
+        
+        for (int p=0; p<numPlanes; ++p) {
+          args.src = ((const unsigned char*) prev.data) + p * srcPlaneSize;
+          args.dst = ((unsigned char*) ml.data) + p * dstPlaneSize;
+          DispatchPlain<MipmapKernel>(planeDesc, args);
         }
 
         mFaces[i].push_back(ml);
@@ -736,6 +1281,15 @@ namespace gimg {
     }
 
     mNumMipmaps = numMipmaps;
+    mLayout = layout;
+    
+    if (baseLevels.size() > 0) {
+      premultLevels(true, 1);
+      for (size_t i=0; i<baseLevels.size(); ++i) {
+        free(mFaces[i][0].data);
+        mFaces[i][0].data = baseLevels[i];
+      }
+    }
     
 #ifdef _DEBUG
     std::cout << "Done building mipmaps" << std::endl;
@@ -782,90 +1336,255 @@ namespace gimg {
     return mFaces[face][mipLevel].data;  
   }
 
-  void Image::scale(int w, int h, Image::ScaleMethod method) {
+  void* Image::getPlane(int channel, int mipLevel, int face) {
+    if (!mPlanar || channel < 0 || channel >= mDesc.getNumChannels()) {
+      return 0;
+    }
+    unsigned char *data = (unsigned char*) getPixels(mipLevel, face);
+    if (!data) {
+      return 0;
+    }
+    return data + channel * (mLayout.getBytesSize(mipLevel) / mDesc.getNumChannels());
+  }
+  
+  bool Image::setPlanar(bool planar) {
+    if (planar == mPlanar) {
+      return true;
+    }
     
-    if (mDesc.isPacked() || mDesc.isCompressed()) {
+    if (!mDesc.isPlain()) {
+      std::cerr << "Planar layout is only available for plain image formats" << std::endl;
+      return false;
+    }
+    
+    if (mDesc.getNumChannels() > 1) {
+      PlanarArgs args;
+      args.toPlanar = planar;
+      
+      for (int i=0; i<NUM_FACES; ++i) {
+        for (size_t j=0; j<mFaces[i].size(); ++j) {
+          MipLevel &ml = mFaces[i][j];
+          args.src = ml.data;
+          args.dst = malloc(mLayout.getBytesSize(int(j)));
+          args.count = size_t(ml.width) * size_t(ml.height) * size_t(ml.depth);
+          DispatchPlain<PlanarKernel>(mDesc, args);
+          free(ml.data);
+          ml.data = args.dst;
+        }
+      }
+    }
+    
+    mPlanar = planar;
+    
+    return true;
+  }
+  
+  static bool CheckScalable(const PixelDesc &desc) {
+    
+    if (desc.isPacked() || desc.isCompressed()) {
       std::cerr << "Cannot scale packed or compressed image format"
                 << " (sorry i'm lazy)" << std::endl;
-      return;
+      return false;
     }
-
-    if (mDesc.isFloat() && mDesc.getBytesPerChannel() == 2) {
-      std::cerr << "Cannot scale a half float image format" << std::endl;
-      return;
+    
+    return true;
+  }
+  
+  template <PixelFormat F, PixelType T>
+  struct SelectRatioFunc {
+    static void Run(IntegerRatioScaleFunc &func) {
+      func = IntegerRatio<T>::Get();
     }
-
-    if (is3D()) {
-      std::cerr << "Cannot scale a 3D image" << std::endl;
-      return;
+  };
+  
+  static Filter* CreateFilter(Image::ScaleMethod method) {
+    switch (method) {
+    case Image::NEAREST:
+      return new BoxFilter();
+    case Image::LINEAR:
+      return new LinearFilter();
+    case Image::CUBIC:
+      return new CubicFilter();
+    case Image::LANCZOS:
+      return new LanczosFilter();
+    default:
+      std::cerr << "Invalid filter specified" << std::endl;
+      return 0;
     }
+  }
+
+  // Resize a width x height buffer to w x h, integer ratios use the
+  // dedicated kernels, other ones separable filtering
+  static void* scaleImage(void *src, unsigned int width, unsigned int height,
+                          unsigned int w, unsigned int h, Image::ScaleMethod method,
+                          Filter *filter, const PixelDesc &desc,
+                          IntegerRatioScaleFunc ratioFunc) {
     
-    size_t chanSize = mDesc.getBytesPerChannel();
-    unsigned int pixSize = (unsigned int) mDesc.getBytesPerPixel();
-    int numChan = mDesc.getNumChannels();
+    unsigned int numChan = desc.getNumChannels();
+    size_t pixSize = desc.getBytesPerPixel();
     
-    PixelInitFunc initFunc;
-    PixelAccumFunc accumFunc;
+    void *out = ratioFunc(src, width, height, numChan, w, h, method);
     
-    if (mDesc.isFloat()) {
-      initFunc = &pixInitT<float>;
-      accumFunc = &pixAccumT<float>;
-    } else {
-      if (chanSize == 1) {
-        initFunc = &pixInitT<unsigned char>;
-        accumFunc = &pixAccumTClamped<unsigned char>;
-      } else if (chanSize == 2) {
-        initFunc = &pixInitT<unsigned short>;
-        accumFunc = &pixAccumTClamped<unsigned short>;
+    if (!out) {
+      FilterWeights hweights(filter, width, w);
+      FilterWeights vweights(filter, height, h);
+      
+      if (w*height < h*width) {
+        void *tmp = scaleHorizontal(src, width*pixSize, height, desc, hweights, w);
+        out = scaleVertical(tmp, w, 0, desc, vweights, h);
+        free(tmp);
+        
       } else {
-        initFunc = &pixInitT<unsigned long>;
-        accumFunc = &pixAccumTClamped<unsigned long>;
+        void *tmp = scaleVertical(src, width, 0, desc, vweights, h);
+        out = scaleHorizontal(tmp, width*pixSize, h, desc, hweights, w);
+        free(tmp);
       }
     }
+    
+    return out;
+  }
   
-    Filter *filter = 0;
-    switch (method) {
-    case NEAREST:
-      filter = new BoxFilter();
-      break;
-    case LINEAR:
-      filter = new LinearFilter();
-      break;
-    case CUBIC:
-      filter = new CubicFilter();
-      break;
-    case LANCZOS:
-      filter = new LanczosFilter();
-    default:
-      break;
+  // Resize a width x height x depth buffer to w x h x d with separable X, Y
+  // then Z passes, returns src if no dimension changes
+  static unsigned char* scaleVolume(unsigned char *src, unsigned int width, unsigned int height,
+                                    unsigned int depth, unsigned int w, unsigned int h, unsigned int d,
+                                    Filter *filter, const PixelDesc &desc) {
+    
+    size_t pixSize = desc.getBytesPerPixel();
+    
+    unsigned char *cur = src;
+    unsigned char *tmp = 0;
+    
+    if (width != w) {
+      // all rows of all slices at once
+      FilterWeights weights(filter, width, w);
+      tmp = (unsigned char*) scaleHorizontal(cur, width*pixSize, height*depth, desc, weights, w);
+      if (cur != src) {
+        free(cur);
+      }
+      cur = tmp;
+      width = w;
     }
     
+    if (height != h) {
+      // slice by slice
+      FilterWeights weights(filter, height, h);
+      size_t srcSliceSize = width * height * pixSize;
+      size_t dstSliceSize = width * h * pixSize;
+      tmp = (unsigned char*) malloc(depth * dstSliceSize);
+      for (unsigned int z=0; z<depth; ++z) {
+        scaleVertical(cur + z * srcSliceSize, width, 0, desc, weights, h, tmp + z * dstSliceSize);
+      }
+      if (cur != src) {
+        free(cur);
+      }
+      cur = tmp;
+      height = h;
+    }
+    
+    if (depth != d) {
+      // a slice is just a row of width*height pixels
+      FilterWeights weights(filter, depth, d);
+      tmp = (unsigned char*) scaleVertical(cur, width*height, 0, desc, weights, d);
+      if (cur != src) {
+        free(cur);
+      }
+      cur = tmp;
+    }
+    
+    return cur;
+  }
+  
+  // scaleVolume on each plane of a planar buffer (numPlanes > 1), returns
+  // src if no dimension changes
+  static unsigned char* scaleVolumePlanes(unsigned char *src, unsigned int width, unsigned int height,
+                                          unsigned int depth, unsigned int w, unsigned int h, unsigned int d,
+                                          Filter *filter, const PixelDesc &desc, int numPlanes) {
+    
+    if (numPlanes == 1) {
+      return scaleVolume(src, width, height, depth, w, h, d, filter, desc);
+    }
+    
+    size_t pixSize = desc.getBytesPerPixel();
+    size_t srcPlaneSize = size_t(width) * height * depth * pixSize;
+    size_t dstPlaneSize = size_t(w) * h * d * pixSize;
+    
+    unsigned char *out = (unsigned char*) malloc(numPlanes * dstPlaneSize);
+    
+    for (int p=0; p<numPlanes; ++p) {
+      unsigned char *plane = scaleVolume(src + p * srcPlaneSize, width, height, depth, w, h, d, filter, desc);
+      memcpy(out + p * dstPlaneSize, plane, dstPlaneSize);
+      if (plane != src + p * srcPlaneSize) {
+        free(plane);
+      }
+    }
+    
+    return out;
+  }
+  
+  void Image::scale(int w, int h, Image::ScaleMethod method, bool premultAlpha) {
+    
+    if (is3D()) {
+      scale(w, h, mMaxDepth, method, premultAlpha);
+      return;
+    }
+    
+    if (!CheckScalable(mDesc)) {
+      return;
+    }
+    
+    // flips commute with scaling, transposition only swaps the dimensions
+    if ((mOrientation & ORIENT_TRANSPOSE) != 0) {
+      std::swap(w, h);
+    }
+    
+    int numPlanes;
+    PixelDesc planeDesc = StorageDesc(mDesc, mPlanar, numPlanes);
+    
+    unsigned int pixSize = (unsigned int) planeDesc.getBytesPerPixel();
+    
+    IntegerRatioScaleFunc ratioFunc = 0;
+    
+    DispatchPlain<SelectRatioFunc>(planeDesc, ratioFunc);
+    
+    Filter *filter = CreateFilter(method);
+    
     if (!filter) {
-      std::cerr << "Invalid filter specified" << std::endl;
       return;
     }
     
     unsigned int nmm = getNumMipmaps();
     clearMipmaps();
     
+    premultAlpha = (premultAlpha && HasAlpha(mDesc));
+    
+    if (premultAlpha) {
+      premultLevels(false, 0);
+    }
+    
     for (int i=0; i<NUM_FACES; ++i) {
       
       if (mFaces[i].size() == 1) {
         
-        void *src = mFaces[i][0].data;
+        unsigned char *src = (unsigned char*) mFaces[i][0].data;
         unsigned int width = mFaces[i][0].width;
         unsigned int height = mFaces[i][0].height;
         void *out = 0;
         
-        if (w*height < h*width) {
-          void *tmp = scaleHorizontal(src, width, height, numChan, pixSize, filter, w, initFunc, accumFunc);
-          out = scaleVertical(tmp, w, height, numChan, pixSize, filter, h, initFunc, accumFunc);
-          free(tmp);
+        if (numPlanes == 1) {
+          out = scaleImage(src, width, height, w, h, method, filter, planeDesc, ratioFunc);
           
         } else {
-          void *tmp = scaleVertical(src, width, height, numChan, pixSize, filter, h, initFunc, accumFunc);
-          out = scaleHorizontal(tmp, width, h, numChan, pixSize, filter, w, initFunc, accumFunc);
-          free(tmp);
+          size_t srcPlaneSize = size_t(width) * height * pixSize;
+          size_t dstPlaneSize = size_t(w) * h * pixSize;
+          
+          out = malloc(numPlanes * dstPlaneSize);
+          
+          for (int p=0; p<numPlanes; ++p) {
+            void *plane = scaleImage(src + p * srcPlaneSize, width, height, w, h, method, filter, planeDesc, ratioFunc);
+            memcpy(((unsigned char*) out) + p * dstPlaneSize, plane, dstPlaneSize);
+            free(plane);
+          }
         }
         
         if (out) {
@@ -877,9 +1596,442 @@ namespace gimg {
       }
     }
     
+    delete filter;
+    
     mMaxWidth = w;
     mMaxHeight = h;
+    mLayout.reset(mDesc, mMaxWidth, mMaxHeight, mMaxDepth, 0);
     
+    // mipmaps are built from the premultiplied level
     buildMipmaps(nmm);
+    
+    if (premultAlpha) {
+      premultLevels(true, 0);
+    }
+  }
+  
+  void Image::scale(int w, int h, int d, Image::ScaleMethod method, bool premultAlpha) {
+    
+    if (!is3D()) {
+      if (d != mMaxDepth) {
+        std::cerr << "Cannot change the depth of a 1D, 2D or cube image" << std::endl;
+        return;
+      }
+      scale(w, h, method, premultAlpha);
+      return;
+    }
+    
+    if (!CheckScalable(mDesc)) {
+      return;
+    }
+    
+    if (d < 1) {
+      std::cerr << "Invalid depth specified" << std::endl;
+      return;
+    }
+    
+    if ((mOrientation & ORIENT_TRANSPOSE) != 0) {
+      std::swap(w, h);
+    }
+    
+    int numPlanes;
+    PixelDesc planeDesc = StorageDesc(mDesc, mPlanar, numPlanes);
+    
+    Filter *filter = CreateFilter(method);
+    
+    if (!filter) {
+      return;
+    }
+    
+    int nmm = getNumMipmaps();
+    clearMipmaps();
+    
+    premultAlpha = (premultAlpha && HasAlpha(mDesc));
+    
+    if (premultAlpha) {
+      premultLevels(false, 0);
+    }
+    
+    MipLevel &level = mFaces[0][0];
+    
+    unsigned char *src = (unsigned char*) level.data;
+    unsigned char *out = scaleVolumePlanes(src, level.width, level.height, level.depth,
+                                           w, h, d, filter, planeDesc, numPlanes);
+    
+    if (out != level.data) {
+      free(level.data);
+      level.data = out;
+    }
+    
+    level.width = w;
+    level.height = h;
+    level.depth = d;
+    
+    delete filter;
+    
+    mMaxWidth = w;
+    mMaxHeight = h;
+    mMaxDepth = d;
+    mLayout.reset(mDesc, mMaxWidth, mMaxHeight, mMaxDepth, 0);
+    
+    // buildMipmaps only handles 2D images: each level is box reduced from
+    // the previous (premultiplied) one
+    if (nmm > 0) {
+      MipLayout layout(mDesc, w, h, d, nmm);
+      BoxFilter box;
+      
+      for (int l=1; l<layout.getNumLevels(); ++l) {
+        const MipLevel &prev = mFaces[0][l-1];
+        
+        MipLevel ml;
+        ml.width = layout.getWidth(l);
+        ml.height = layout.getHeight(l);
+        ml.depth = layout.getDepth(l);
+        ml.data = scaleVolumePlanes((unsigned char*) prev.data, prev.width, prev.height, prev.depth,
+                                    ml.width, ml.height, ml.depth, &box, planeDesc, numPlanes);
+        
+        mFaces[0].push_back(ml);
+      }
+      
+      mNumMipmaps = layout.getNumLevels() - 1;
+      mLayout = layout;
+    }
+    
+    if (premultAlpha) {
+      premultLevels(true, 0);
+    }
+  }
+  
+  Image* Image::scaleRegion(double x, double y, double rw, double rh,
+                            int w, int h, Image::ScaleMethod method,
+                            int mipLevel, int face) {
+    
+    if (!CheckScalable(mDesc)) {
+      return 0;
+    }
+
+    if (is3D()) {
+      std::cerr << "Cannot scale a region of a 3D image" << std::endl;
+      return 0;
+    }
+    
+    if (mOrientation != ORIENT_NORMAL) {
+      normalizeOrientation();
+    }
+    
+    void *src = getPixels(mipLevel, face);
+    
+    if (!src || w <= 0 || h <= 0) {
+      return 0;
+    }
+    
+    unsigned int width = mFaces[face][mipLevel].width;
+    unsigned int height = mFaces[face][mipLevel].height;
+    
+    if (rw <= 0.0 || rh <= 0.0 || x < 0.0 || y < 0.0 ||
+        x + rw > double(width) || y + rh > double(height)) {
+      std::cerr << "Invalid source region" << std::endl;
+      return 0;
+    }
+    
+    int numPlanes;
+    PixelDesc planeDesc = StorageDesc(mDesc, mPlanar, numPlanes);
+    
+    unsigned int pixSize = (unsigned int) planeDesc.getBytesPerPixel();
+    
+    Filter *filter = CreateFilter(method);
+    
+    if (!filter) {
+      return 0;
+    }
+    
+    // weights only reference the source window covered by the filters
+    FilterWeights hweights(filter, x, rw, width, w);
+    FilterWeights vweights(filter, y, rh, height, h);
+    
+    unsigned int firstRow, lastRow;
+    vweights.sourceRange(firstRow, lastRow);
+    
+    Image *img = new Image(mDesc, w, h);
+    img->mPlanar = mPlanar;
+    
+    unsigned int rowSize = width * pixSize;
+    size_t srcPlaneSize = size_t(height) * rowSize;
+    size_t dstPlaneSize = size_t(w) * h * pixSize;
+    
+    for (int p=0; p<numPlanes; ++p) {
+      unsigned char *srcRows = ((unsigned char*) src) + (p * srcPlaneSize) + (firstRow * rowSize);
+      unsigned char *dst = ((unsigned char*) img->mFaces[0][0].data) + (p * dstPlaneSize);
+      
+      void *tmp = scaleHorizontal(srcRows, rowSize, lastRow-firstRow, planeDesc, hweights, w);
+      scaleVertical(tmp, w, firstRow, planeDesc, vweights, h, dst);
+      free(tmp);
+    }
+    
+    delete filter;
+    
+    return img;
+  }
+  
+  Image* Image::convert(const PixelDesc &desc, int flags) {
+    
+    if (!desc.isValid()) {
+      std::cerr << "Invalid pixel format" << std::endl;
+      return 0;
+    }
+    
+    bool compressed = (mDesc.isCompressed() || desc.isCompressed());
+    
+    if (compressed && mMaxDepth > 1) {
+      std::cerr << "Cannot convert 3D image from or to compressed image format" << std::endl;
+      return 0;
+    }
+    
+    if (mPlanar) {
+      // work on an interleaved copy
+      Image *tmp = new Image(mDesc, mMaxWidth, mMaxHeight, mMaxDepth, mNumMipmaps);
+      tmp->mOrientation = mOrientation;
+      PlanarArgs args;
+      args.toPlanar = false;
+      for (int i=0; i<NUM_FACES; ++i) {
+        for (size_t j=0; j<mFaces[i].size(); ++j) {
+          const MipLevel &ml = mFaces[i][j];
+          args.src = ml.data;
+          args.dst = tmp->mFaces[i][j].data;
+          args.count = size_t(ml.width) * size_t(ml.height) * size_t(ml.depth);
+          DispatchPlain<PlanarKernel>(mDesc, args);
+        }
+      }
+      Image *img = tmp->convert(desc, flags);
+      delete tmp;
+      return img;
+    }
+    
+    Image *img = new Image(desc, mMaxWidth, mMaxHeight, mMaxDepth, mNumMipmaps);
+    
+    img->mOrientation = mOrientation;
+    
+    if (compressed) {
+      
+      PixelDesc rgba8(PF_RGBA, PT_INT_8);
+      
+      for (int i=0; i<NUM_FACES; ++i) {
+        for (size_t j=0; j<mFaces[i].size(); ++j) {
+          
+          const MipLevel &ml = mFaces[i][j];
+          void *dst = img->mFaces[i][j].data;
+          bool rv = true;
+          
+          if (!mDesc.isCompressed()) {
+            rv = CompressBlocks(ml.data, mDesc, ml.width, ml.height, dst, desc, flags);
+            
+          } else if (!desc.isCompressed()) {
+            rv = DecompressBlocks(ml.data, mDesc, ml.width, ml.height, dst, desc, flags);
+            
+          } else if (desc.getType() == mDesc.getType() && desc.getFormat() == mDesc.getFormat()) {
+            memcpy(dst, ml.data, mLayout.getBytesSize(int(j)));
+            
+          } else {
+            // transcode through 8 bits RGBA
+            void *tmp = malloc(size_t(ml.width) * size_t(ml.height) * 4);
+            rv = (DecompressBlocks(ml.data, mDesc, ml.width, ml.height, tmp, rgba8) &&
+                  CompressBlocks(tmp, rgba8, ml.width, ml.height, dst, desc, flags));
+            free(tmp);
+          }
+          
+          if (!rv) {
+            delete img;
+            return 0;
+          }
+        }
+      }
+      
+      return img;
+    }
+    
+    size_t srcPixSize = mDesc.getBytesPerPixel();
+    size_t dstPixSize = desc.getBytesPerPixel();
+    
+    for (int i=0; i<NUM_FACES; ++i) {
+      for (size_t j=0; j<mFaces[i].size(); ++j) {
+        
+        const MipLevel &ml = mFaces[i][j];
+        
+        if ((flags & (CONVERT_DITHER | CONVERT_DITHER_BLUE_NOISE)) == 0) {
+          size_t count = size_t(ml.width) * size_t(ml.height) * size_t(ml.depth);
+          ConvertPixels(ml.data, mDesc, img->mFaces[i][j].data, desc, count, 0, flags);
+          continue;
+        }
+        
+        // dither patterns need pixel positions, convert row by row (rows
+        // are independent and processed in parallel)
+        const unsigned char *src = (const unsigned char*) ml.data;
+        unsigned char *dst = (unsigned char*) img->mFaces[i][j].data;
+        int numRows = ml.height * ml.depth;
+        
+        // blue noise and sRGB tables are built on first use, not from
+        // concurrent threads
+        WarmConvertTables(flags);
+        
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+        for (int y=0; y<numRows; ++y) {
+          ConvertPixels(src + size_t(y) * ml.width * srcPixSize, mDesc,
+                        dst + size_t(y) * ml.width * dstPixSize, desc,
+                        ml.width, 0, flags, 0, y % ml.height);
+        }
+      }
+    }
+    
+    return img;
+  }
+  
+  void Image::flipHorizontally() {
+    
+    FlipRowFunc flipFunc;
+    RotateFunc rotFunc;
+    
+    int numPlanes;
+    PixelDesc planeDesc = StorageDesc(mDesc, mPlanar, numPlanes);
+    
+    if (!CheckOrientable(planeDesc, flipFunc, rotFunc)) {
+      return;
+    }
+    
+    // planes are stacked like slices
+    size_t pixSize = planeDesc.getBytesPerPixel();
+    
+    for (int i=0; i<NUM_FACES; ++i) {
+      for (size_t j=0; j<mFaces[i].size(); ++j) {
+        
+        MipLevel &ml = mFaces[i][j];
+        
+        unsigned char *row = (unsigned char*) ml.data;
+        size_t rowSize = ml.width * pixSize;
+        int numRows = ml.height * ml.depth * numPlanes;
+        
+        for (int y=0; y<numRows; ++y) {
+          flipFunc(row, ml.width);
+          row += rowSize;
+        }
+      }
+    }
+  }
+  
+  void Image::flipVertically() {
+    
+    FlipRowFunc flipFunc;
+    RotateFunc rotFunc;
+    
+    int numPlanes;
+    PixelDesc planeDesc = StorageDesc(mDesc, mPlanar, numPlanes);
+    
+    if (!CheckOrientable(planeDesc, flipFunc, rotFunc)) {
+      return;
+    }
+    
+    // planes are stacked like slices
+    size_t pixSize = planeDesc.getBytesPerPixel();
+    
+    for (int i=0; i<NUM_FACES; ++i) {
+      for (size_t j=0; j<mFaces[i].size(); ++j) {
+        
+        MipLevel &ml = mFaces[i][j];
+        
+        size_t rowSize = ml.width * pixSize;
+        size_t sliceSize = ml.height * rowSize;
+        
+        for (int z=0; z<ml.depth*numPlanes; ++z) {
+          
+          // swap rows in place
+          unsigned char *r0 = ((unsigned char*) ml.data) + (z * sliceSize);
+          unsigned char *r1 = r0 + ((ml.height - 1) * rowSize);
+          
+          while (r0 < r1) {
+            std::swap_ranges(r0, r0 + rowSize, r1);
+            r0 += rowSize;
+            r1 -= rowSize;
+          }
+        }
+      }
+    }
+  }
+  
+  void Image::rotate(int rot) {
+    
+    FlipRowFunc flipFunc;
+    RotateFunc rotFunc;
+    
+    int numPlanes;
+    PixelDesc planeDesc = StorageDesc(mDesc, mPlanar, numPlanes);
+    
+    if (!CheckOrientable(planeDesc, flipFunc, rotFunc)) {
+      return;
+    }
+    
+    // planes are stacked like slices
+    size_t pixSize = planeDesc.getBytesPerPixel();
+    
+    for (int i=0; i<NUM_FACES; ++i) {
+      for (size_t j=0; j<mFaces[i].size(); ++j) {
+        
+        MipLevel &ml = mFaces[i][j];
+        
+        size_t sliceSize = ml.width * ml.height * pixSize;
+        
+        unsigned char *src = (unsigned char*) ml.data;
+        unsigned char *dst = (unsigned char*) malloc(ml.depth * numPlanes * sliceSize);
+        
+        for (int z=0; z<ml.depth*numPlanes; ++z) {
+          rotFunc(src + z * sliceSize, ml.width, ml.height, Rotation(rot), dst + z * sliceSize);
+        }
+        
+        free(ml.data);
+        ml.data = dst;
+        std::swap(ml.width, ml.height);
+      }
+    }
+    
+    std::swap(mMaxWidth, mMaxHeight);
+    mLayout.reset(mDesc, mMaxWidth, mMaxHeight, mMaxDepth, mNumMipmaps);
+  }
+  
+  void Image::transpose() {
+    rotate(ROT_TRANSPOSE);
+  }
+  
+  void Image::rotateCW() {
+    rotate(ROT_CW);
+  }
+  
+  void Image::rotateCCW() {
+    rotate(ROT_CCW);
+  }
+  
+  void Image::normalizeOrientation() {
+    
+    if (mOrientation == ORIENT_NORMAL) {
+      return;
+    }
+    
+    if (mDesc.isCompressed()) {
+      std::cerr << "Cannot re-orient compressed image format" << std::endl;
+      return;
+    }
+    
+    if ((mOrientation & ORIENT_TRANSPOSE) != 0) {
+      transpose();
+    }
+    
+    if ((mOrientation & ORIENT_FLIP_X) != 0) {
+      flipHorizontally();
+    }
+    
+    if ((mOrientation & ORIENT_FLIP_Y) != 0) {
+      flipVertically();
+    }
+    
+    mOrientation = ORIENT_NORMAL;
   }
 }
@@ -0,0 +1,627 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/lut.h>
+#include <gimg/image.h>
+#include <gimg/pixeltraits.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "simd.h"
+#include "tables.h"
+#include "rows.h"
+
+// Tetrahedral interpolation splits the lattice cell holding a color in 6
+// tetrahedra along its main diagonal, the one used is given by the order of
+// the fractional coordinates and its 4 corners are blended with weights
+// (1 - fmax, fmax - fmid, fmid - fmin, fmin)
+//
+// Cells, tetrahedra and weights are computed 4 pixels at a time without
+// branches, entries are stored as RGBA floats so that each corner is then
+// blended with a single vector multiply-add (gathers being scalar with SSE2)
+
+namespace gimg {
+
+  ColorTransform::ColorTransform() {
+  }
+
+  ColorTransform::~ColorTransform() {
+  }
+
+  // ---
+
+  ColorTransformChain::ColorTransformChain() {
+  }
+
+  ColorTransformChain::~ColorTransformChain() {
+  }
+
+  void ColorTransformChain::append(const ColorTransform *xf) {
+    if (xf) {
+      mTransforms.push_back(xf);
+    }
+  }
+
+  void ColorTransformChain::clear() {
+    mTransforms.clear();
+  }
+
+  Color ColorTransformChain::apply(const Color &c) const {
+    Color rv(c);
+    for (size_t i=0; i<mTransforms.size(); ++i) {
+      rv = mTransforms[i]->apply(rv);
+    }
+    return rv;
+  }
+
+  // --- Interpolation
+
+  // Lattice addressing of a Lut3D
+  struct LutParams {
+    const float *table;
+    int size;
+    // domain to lattice coordinates
+    float mul[3];
+    float add[3];
+    // second and third tetrahedron corners (float offsets from the first)
+    // indexed by (fr >= fg) | (fg >= fb) << 1 | (fr >= fb) << 2
+    int corner1[8];
+    int corner2[8];
+    int corner3;
+
+    LutParams(const Lut3D &lut) {
+      table = lut.getTable();
+      size = lut.getSize();
+      const Color &lo = lut.getDomainMin();
+      const Color &hi = lut.getDomainMax();
+      float dmin[3] = {lo.r, lo.g, lo.b};
+      float dmax[3] = {hi.r, hi.g, hi.b};
+      for (int c=0; c<3; ++c) {
+        float range = dmax[c] - dmin[c];
+        mul[c] = (range > 0.0f ? float(size - 1) / range : 0.0f);
+        add[c] = -dmin[c] * mul[c];
+      }
+
+      // impossible orders (3 and 4) only happen for equal values
+      const int r = 4;
+      const int g = 4 * size;
+      const int b = 4 * size * size;
+      const int first[8] = {b, b, g, r, b, r, g, r};
+      const int second[8] = {b + g, b + r, g + b, r + g, b + g, r + b, g + r, r + g};
+
+      for (int i=0; i<8; ++i) {
+        corner1[i] = first[i];
+        corner2[i] = second[i];
+      }
+      corner3 = r + g + b;
+    }
+  };
+
+  // Corner weights of 4 colors (in[channel][pixel])
+  struct LutCells {
+    // first corner entry
+    int base[4];
+    // tetrahedron, index in LutParams offset tables
+    int tet[4];
+    // corner weights, w[corner][pixel]
+    float w[4][4];
+  };
+
+#ifdef GIMG_SSE2
+  static inline __m128 LutMax(__m128 a, __m128 b) {
+    return _mm_max_ps(a, b);
+  }
+  static inline __m128 LutMin(__m128 a, __m128 b) {
+    return _mm_min_ps(a, b);
+  }
+#else
+  // same results as maxps/minps (second operand for NaNs)
+  static inline float LutMax(float a, float b) {
+    return (a > b ? a : b);
+  }
+  static inline float LutMin(float a, float b) {
+    return (a < b ? a : b);
+  }
+#endif
+
+  static inline void LutCoords(const LutParams &lp, const float in[3][4], LutCells &cells) {
+    int idx[3][4];
+
+#ifdef GIMG_SSE2
+    __m128 zero = _mm_setzero_ps();
+    __m128 last = _mm_set1_ps(float(lp.size - 1));
+    __m128i lastCell = _mm_set1_epi32(lp.size - 2);
+    __m128 f[3];
+
+    for (int c=0; c<3; ++c) {
+      __m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(in[c]), _mm_set1_ps(lp.mul[c])),
+                            _mm_set1_ps(lp.add[c]));
+      // max first so that NaNs clamp to 0
+      x = LutMin(LutMax(x, zero), last);
+      __m128i i = _mm_cvttps_epi32(x);
+      __m128i over = _mm_cmpgt_epi32(i, lastCell);
+      i = _mm_or_si128(_mm_andnot_si128(over, i), _mm_and_si128(over, lastCell));
+      _mm_storeu_si128((__m128i*) idx[c], i);
+      f[c] = _mm_sub_ps(x, _mm_cvtepi32_ps(i));
+    }
+
+    __m128 fmax = LutMax(LutMax(f[0], f[1]), f[2]);
+    __m128 fmin = LutMin(LutMin(f[0], f[1]), f[2]);
+    __m128 fmid = LutMax(LutMin(f[0], f[1]), LutMin(LutMax(f[0], f[1]), f[2]));
+
+    _mm_storeu_ps(cells.w[0], _mm_sub_ps(_mm_set1_ps(1.0f), fmax));
+    _mm_storeu_ps(cells.w[1], _mm_sub_ps(fmax, fmid));
+    _mm_storeu_ps(cells.w[2], _mm_sub_ps(fmid, fmin));
+    _mm_storeu_ps(cells.w[3], fmin);
+
+    int rg = _mm_movemask_ps(_mm_cmpge_ps(f[0], f[1]));
+    int gb = _mm_movemask_ps(_mm_cmpge_ps(f[1], f[2]));
+    int rb = _mm_movemask_ps(_mm_cmpge_ps(f[0], f[2]));
+
+    for (int k=0; k<4; ++k) {
+      cells.tet[k] = ((rg >> k) & 1) | (((gb >> k) & 1) << 1) | (((rb >> k) & 1) << 2);
+    }
+#else
+    float last = float(lp.size - 1);
+
+    for (int k=0; k<4; ++k) {
+      float f[3];
+
+      for (int c=0; c<3; ++c) {
+        float x = in[c][k] * lp.mul[c] + lp.add[c];
+        x = LutMin(LutMax(x, 0.0f), last);
+        int i = int(x);
+        if (i > lp.size - 2) {
+          i = lp.size - 2;
+        }
+        idx[c][k] = i;
+        f[c] = x - float(i);
+      }
+
+      float fmax = LutMax(LutMax(f[0], f[1]), f[2]);
+      float fmin = LutMin(LutMin(f[0], f[1]), f[2]);
+      float fmid = LutMax(LutMin(f[0], f[1]), LutMin(LutMax(f[0], f[1]), f[2]));
+
+      cells.w[0][k] = 1.0f - fmax;
+      cells.w[1][k] = fmax - fmid;
+      cells.w[2][k] = fmid - fmin;
+      cells.w[3][k] = fmin;
+
+      cells.tet[k] = (f[0] >= f[1] ? 1 : 0) | (f[1] >= f[2] ? 2 : 0) | (f[0] >= f[2] ? 4 : 0);
+    }
+#endif
+
+    for (int k=0; k<4; ++k) {
+      cells.base[k] = 4 * ((idx[2][k] * lp.size + idx[1][k]) * lp.size + idx[0][k]);
+    }
+  }
+
+  // Blend the tetrahedron corners of pixel k, out receives RGB(A)
+  static inline void LutBlend(const LutParams &lp, const LutCells &cells, int k, float out[4]) {
+    const float *c0 = lp.table + cells.base[k];
+    const float *c1 = c0 + lp.corner1[cells.tet[k]];
+    const float *c2 = c0 + lp.corner2[cells.tet[k]];
+    const float *c3 = c0 + lp.corner3;
+
+#ifdef GIMG_SSE2
+    __m128 acc = _mm_mul_ps(_mm_loadu_ps(c0), _mm_set1_ps(cells.w[0][k]));
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(c1), _mm_set1_ps(cells.w[1][k])));
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(c2), _mm_set1_ps(cells.w[2][k])));
+    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(c3), _mm_set1_ps(cells.w[3][k])));
+    _mm_storeu_ps(out, acc);
+#else
+    for (int c=0; c<3; ++c) {
+      float acc = c0[c] * cells.w[0][k];
+      acc = acc + c1[c] * cells.w[1][k];
+      acc = acc + c2[c] * cells.w[2][k];
+      acc = acc + c3[c] * cells.w[3][k];
+      out[c] = acc;
+    }
+#endif
+  }
+
+  // --- Buffers
+
+  // Normalized channel values
+  template <PixelType T>
+  struct LutChannel {
+    typedef ChannelTraits<T> CT;
+    typedef typename CT::Type C;
+
+    static inline float Load(C v) {
+      return float(CT::ToDouble(v) / CT::ToDouble(CT::One()));
+    }
+    static inline C Store(float v) {
+      return CT::FromDouble(double(v) * CT::ToDouble(CT::One()));
+    }
+  };
+
+  template <>
+  struct LutChannel<PT_INT_8> {
+    static inline float Load(unsigned char v) {
+      return float(v) * (1.0f / 255.0f);
+    }
+    static inline unsigned char Store(float v) {
+      v = v * 255.0f + 0.5f;
+      v = (v > 0.0f ? v : 0.0f);
+      return (unsigned char)(v < 255.0f ? int(v) : 255);
+    }
+  };
+
+  template <>
+  struct LutChannel<PT_FLOAT_32> {
+    static inline float Load(float v) {
+      return v;
+    }
+    static inline float Store(float v) {
+      return v;
+    }
+  };
+
+  struct LutArgs {
+    const Lut3D *lut;
+    // R, G and B channels are read (alpha is left untouched)
+    PixelRows rows;
+  };
+
+  template <PixelFormat F, PixelType T>
+  struct LutKernel {
+    static void Run(LutArgs &args) {
+      typedef typename ChannelTraits<T>::Type C;
+
+      LutParams lp(*(args.lut));
+      size_t stride = args.rows.stride;
+      int numRows = int(args.rows.rows.size());
+
+      WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = args.rows.rows[y];
+
+        C *ch[3] = {(C*) row.channels[0], (C*) row.channels[1], (C*) row.channels[2]};
+
+        float in[3][4];
+        float out[4];
+        LutCells cells;
+
+        for (size_t i=0; i<row.length; i+=4) {
+          size_t n = row.length - i;
+          if (n > 4) {
+            n = 4;
+          }
+
+          for (int c=0; c<3; ++c) {
+            for (size_t k=0; k<4; ++k) {
+              in[c][k] = (k < n ? LutChannel<T>::Load(ch[c][(i + k) * stride]) : 0.0f);
+            }
+          }
+
+          LutCoords(lp, in, cells);
+
+          for (size_t k=0; k<n; ++k) {
+            LutBlend(lp, cells, int(k), out);
+            for (int c=0; c<3; ++c) {
+              ch[c][(i + k) * stride] = LutChannel<T>::Store(out[c]);
+            }
+          }
+        }
+      }
+    }
+  };
+
+  static bool CheckLutDesc(const PixelDesc &desc) {
+    return (desc.isPlain() && (desc.getFormat() == PF_RGB || desc.getFormat() == PF_RGBA));
+  }
+
+  // --- Lut3D
+
+  Lut3D::Lut3D(int size)
+    : mSize(0), mTable(0), mDomainMin(0.0f), mDomainMax(1.0f) {
+    if (!resize(size)) {
+      resize(33);
+    }
+  }
+
+  Lut3D::Lut3D(const Lut3D &rhs)
+    : mSize(0), mTable(0), mDomainMin(0.0f), mDomainMax(1.0f) {
+    operator=(rhs);
+  }
+
+  Lut3D::~Lut3D() {
+    free(mTable);
+  }
+
+  Lut3D& Lut3D::operator=(const Lut3D &rhs) {
+    if (this != &rhs) {
+      size_t sz = 4 * size_t(rhs.mSize) * rhs.mSize * rhs.mSize * sizeof(float);
+      mTable = (float*) realloc(mTable, sz);
+      memcpy(mTable, rhs.mTable, sz);
+      mSize = rhs.mSize;
+      mDomainMin = rhs.mDomainMin;
+      mDomainMax = rhs.mDomainMax;
+    }
+    return *this;
+  }
+
+  bool Lut3D::resize(int size) {
+    if (size < MIN_SIZE || size > MAX_SIZE) {
+      std::cerr << "Invalid 3D LUT size " << size << " (expected " << int(MIN_SIZE)
+                << " to " << int(MAX_SIZE) << ")" << std::endl;
+      return false;
+    }
+    if (size != mSize) {
+      free(mTable);
+      mTable = (float*) malloc(4 * size_t(size) * size * size * sizeof(float));
+      mSize = size;
+    }
+    setIdentity();
+    return true;
+  }
+
+  void Lut3D::setIdentity() {
+    float *e = mTable;
+    float scl = 1.0f / float(mSize - 1);
+    for (int b=0; b<mSize; ++b) {
+      for (int g=0; g<mSize; ++g) {
+        for (int r=0; r<mSize; ++r, e+=4) {
+          e[0] = mDomainMin.r + (mDomainMax.r - mDomainMin.r) * (r * scl);
+          e[1] = mDomainMin.g + (mDomainMax.g - mDomainMin.g) * (g * scl);
+          e[2] = mDomainMin.b + (mDomainMax.b - mDomainMin.b) * (b * scl);
+          e[3] = 1.0f;
+        }
+      }
+    }
+  }
+
+  void Lut3D::setDomain(const Color &domainMin, const Color &domainMax) {
+    mDomainMin = domainMin;
+    mDomainMax = domainMax;
+  }
+
+  void Lut3D::sample(const ColorTransform &xf) {
+    float scl = 1.0f / float(mSize - 1);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int b=0; b<mSize; ++b) {
+      float *e = mTable + 4 * size_t(b) * mSize * mSize;
+      for (int g=0; g<mSize; ++g) {
+        for (int r=0; r<mSize; ++r, e+=4) {
+          Color in(mDomainMin.r + (mDomainMax.r - mDomainMin.r) * (r * scl),
+                   mDomainMin.g + (mDomainMax.g - mDomainMin.g) * (g * scl),
+                   mDomainMin.b + (mDomainMax.b - mDomainMin.b) * (b * scl));
+          Color out = xf.apply(in);
+          e[0] = out.r;
+          e[1] = out.g;
+          e[2] = out.b;
+          e[3] = 1.0f;
+        }
+      }
+    }
+  }
+
+  Color Lut3D::getEntry(int r, int g, int b) const {
+    const float *e = mTable + 4 * ((size_t(b) * mSize + g) * mSize + r);
+    return Color(e[0], e[1], e[2]);
+  }
+
+  void Lut3D::setEntry(int r, int g, int b, const Color &c) {
+    float *e = mTable + 4 * ((size_t(b) * mSize + g) * mSize + r);
+    e[0] = c.r;
+    e[1] = c.g;
+    e[2] = c.b;
+  }
+
+  Color Lut3D::lookup(const Color &c) const {
+    LutParams lp(*this);
+    float in[3][4] = {{c.r, 0.0f, 0.0f, 0.0f}, {c.g, 0.0f, 0.0f, 0.0f}, {c.b, 0.0f, 0.0f, 0.0f}};
+    float out[4];
+    LutCells cells;
+    LutCoords(lp, in, cells);
+    LutBlend(lp, cells, 0, out);
+    return Color(out[0], out[1], out[2], c.a);
+  }
+
+  void Lut3D::lookup(float *r, float *g, float *b, size_t count) const {
+    LutParams lp(*this);
+    float *ch[3] = {r, g, b};
+    float in[3][4];
+    float out[4];
+    LutCells cells;
+
+    for (size_t i=0; i<count; i+=4) {
+      size_t n = count - i;
+      if (n > 4) {
+        n = 4;
+      }
+
+      for (int c=0; c<3; ++c) {
+        for (size_t k=0; k<4; ++k) {
+          in[c][k] = (k < n ? ch[c][i + k] : 0.0f);
+        }
+      }
+
+      LutCoords(lp, in, cells);
+
+      for (size_t k=0; k<n; ++k) {
+        LutBlend(lp, cells, int(k), out);
+        for (int c=0; c<3; ++c) {
+          ch[c][i + k] = out[c];
+        }
+      }
+    }
+  }
+
+  bool Lut3D::apply(const void *src, void *dst, const PixelDesc &desc, size_t count) const {
+    if (!CheckLutDesc(desc)) {
+      return false;
+    }
+
+    if (src != dst) {
+      memcpy(dst, src, count * desc.getBytesPerPixel());
+    }
+
+    LutArgs args;
+    args.lut = this;
+
+    ChunkRows(dst, desc, count, 0, 0, args.rows);
+
+    return DispatchPlainType<LutKernel, PF_RGB>(desc.getType(), args);
+  }
+
+  // --- .cube files
+
+  bool Lut3D::read(const gcore::Path &filepath) {
+    gcore::String path = filepath.fullname();
+
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file) {
+      std::cerr << "Could not open LUT file \"" << path << "\"" << std::endl;
+      return false;
+    }
+
+    Lut3D lut(2);
+    Color dmin(0.0f);
+    Color dmax(1.0f);
+    int size = 0;
+    size_t count = 0;
+    size_t total = 0;
+    float *e = 0;
+    bool failed = false;
+    char line[1024];
+
+    while (!failed && fgets(line, sizeof(line), file)) {
+      char *p = line;
+      while (*p == ' ' || *p == '\t') {
+        ++p;
+      }
+      if (*p == '\0' || *p == '\n' || *p == '\r' || *p == '#') {
+        continue;
+      }
+
+      float r, g, b;
+      int n;
+
+      if (!strncmp(p, "TITLE", 5)) {
+        continue;
+      } else if (sscanf(p, "LUT_3D_SIZE %d", &n) == 1) {
+        if (size != 0 || !lut.resize(n)) {
+          failed = true;
+        } else {
+          size = n;
+          total = size_t(n) * n * n;
+          e = lut.mTable;
+        }
+      } else if (!strncmp(p, "LUT_1D_SIZE", 11)) {
+        std::cerr << "1D LUTs are not supported" << std::endl;
+        failed = true;
+      } else if (sscanf(p, "DOMAIN_MIN %f %f %f", &r, &g, &b) == 3) {
+        dmin = Color(r, g, b);
+      } else if (sscanf(p, "DOMAIN_MAX %f %f %f", &r, &g, &b) == 3) {
+        dmax = Color(r, g, b);
+      } else if (sscanf(p, "LUT_3D_INPUT_RANGE %f %f", &r, &g) == 2) {
+        dmin = Color(r);
+        dmax = Color(g);
+      } else if (sscanf(p, "%f %f %f", &r, &g, &b) == 3) {
+        if (count >= total) {
+          failed = true;
+        } else {
+          e[0] = r;
+          e[1] = g;
+          e[2] = b;
+          e[3] = 1.0f;
+          e += 4;
+          ++count;
+        }
+      } else {
+        // unknown keyword
+        continue;
+      }
+    }
+
+    fclose(file);
+
+    if (failed || size == 0 || count != total) {
+      std::cerr << "Invalid LUT file \"" << path << "\"" << std::endl;
+      return false;
+    }
+
+    lut.setDomain(dmin, dmax);
+    *this = lut;
+
+    return true;
+  }
+
+  bool Lut3D::write(const gcore::Path &filepath, const char *title) const {
+    gcore::String path = filepath.fullname();
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+      std::cerr << "Could not create LUT file \"" << path << "\"" << std::endl;
+      return false;
+    }
+
+    if (title) {
+      fprintf(file, "TITLE \"%s\"\n", title);
+    }
+    fprintf(file, "LUT_3D_SIZE %d\n", mSize);
+    fprintf(file, "DOMAIN_MIN %.9g %.9g %.9g\n", mDomainMin.r, mDomainMin.g, mDomainMin.b);
+    fprintf(file, "DOMAIN_MAX %.9g %.9g %.9g\n", mDomainMax.r, mDomainMax.g, mDomainMax.b);
+
+    size_t total = size_t(mSize) * mSize * mSize;
+    const float *e = mTable;
+
+    for (size_t i=0; i<total; ++i, e+=4) {
+      fprintf(file, "%.9g %.9g %.9g\n", e[0], e[1], e[2]);
+    }
+
+    bool rv = !ferror(file);
+    fclose(file);
+
+    return rv;
+  }
+
+  // --- Image
+
+  void Image::applyLut(const Lut3D &lut) {
+
+    if (!CheckLutDesc(mDesc)) {
+      std::cerr << "3D LUTs only apply to plain RGB and RGBA images" << std::endl;
+      return;
+    }
+
+    LutArgs args;
+    args.lut = &lut;
+
+    ImageRows(*this, 0, mNumMipmaps, args.rows);
+
+    DispatchPlainType<LutKernel, PF_RGB>(mDesc.getType(), args);
+  }
+
+}
@@ -0,0 +1,686 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/pipeline.h>
+#include <gimg/image.h>
+#include <gimg/convert.h>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+#include "simd.h"
+#include "tables.h"
+#include "rows.h"
+
+// Rows (or fixed size chunks) are split in blocks of BlockSize pixels,
+// loaded as float arrays per channel (through ConvertPixels unless already
+// RGBA floats), run through all operations and stored back
+//
+// Gamma and transfer functions use pow(x, y) = exp2(y log2(x)) with
+// polynomial log2 and exp2, the scalar and SSE2 versions run the same float
+// operations so that the Color version gives the same results as the pixel
+// one
+
+namespace gimg {
+
+  enum {
+    BlockSize = 256
+  };
+
+  static PixelPipeline::Op MakeOp(PixelPipeline::OpType type) {
+    PixelPipeline::Op op;
+    op.type = type;
+    for (int c=0; c<3; ++c) {
+      op.mul[c] = 1.0f;
+      op.add[c] = 0.0f;
+    }
+    for (int i=0; i<9; ++i) {
+      op.matrix[i] = (i % 4 == 0 ? 1.0f : 0.0f);
+    }
+    op.transfer = TRANSFER_LINEAR;
+    op.lut = 0;
+    op.xf = 0;
+    return op;
+  }
+
+  PixelPipeline::PixelPipeline() {
+  }
+
+  PixelPipeline::~PixelPipeline() {
+  }
+
+  void PixelPipeline::append(const Op &op) {
+    if (op.type == OP_MULTIPLY_ADD && !mOps.empty() && mOps.back().type == OP_MULTIPLY_ADD) {
+      // (v * m0 + a0) * m1 + a1
+      Op &last = mOps.back();
+      for (int c=0; c<3; ++c) {
+        last.add[c] = last.add[c] * op.mul[c] + op.add[c];
+        last.mul[c] = last.mul[c] * op.mul[c];
+      }
+      return;
+    }
+    if (op.type == OP_MATRIX && !mOps.empty() && mOps.back().type == OP_MATRIX) {
+      // m1 * (m0 * v)
+      Op &last = mOps.back();
+      float m[9];
+      for (int r=0; r<3; ++r) {
+        for (int c=0; c<3; ++c) {
+          m[3 * r + c] = (op.matrix[3 * r] * last.matrix[c] +
+                          op.matrix[3 * r + 1] * last.matrix[3 + c] +
+                          op.matrix[3 * r + 2] * last.matrix[6 + c]);
+        }
+      }
+      memcpy(last.matrix, m, sizeof(m));
+      return;
+    }
+    mOps.push_back(op);
+  }
+
+  void PixelPipeline::exposure(float stops) {
+    Op op = MakeOp(OP_MULTIPLY_ADD);
+    float scale = float(pow(2.0, double(stops)));
+    for (int c=0; c<3; ++c) {
+      op.mul[c] = scale;
+    }
+    append(op);
+  }
+
+  void PixelPipeline::multiplyAdd(const Color &mul, const Color &add) {
+    Op op = MakeOp(OP_MULTIPLY_ADD);
+    op.mul[0] = mul.r;
+    op.mul[1] = mul.g;
+    op.mul[2] = mul.b;
+    op.add[0] = add.r;
+    op.add[1] = add.g;
+    op.add[2] = add.b;
+    append(op);
+  }
+
+  void PixelPipeline::grade(const Color &black, const Color &white, const Color &lift, const Color &gain) {
+    // (v - black) / (white - black) * (gain - lift) + lift
+    Color scale = (gain - lift) / (white - black);
+    Color offset = lift - black * scale;
+    multiplyAdd(scale, offset);
+  }
+
+  void PixelPipeline::saturation(float s) {
+    Op op = MakeOp(OP_SATURATION);
+    op.mul[0] = s;
+    append(op);
+  }
+
+  void PixelPipeline::gamma(float g) {
+    if (g <= 0.0f) {
+      std::cerr << "Invalid gamma " << g << std::endl;
+      return;
+    }
+    Op op = MakeOp(OP_GAMMA);
+    op.mul[0] = 1.0f / g;
+    append(op);
+  }
+
+  void PixelPipeline::clamp(float minValue, float maxValue) {
+    Op op = MakeOp(OP_CLAMP);
+    op.mul[0] = minValue;
+    op.add[0] = maxValue;
+    append(op);
+  }
+
+  void PixelPipeline::lut(const Lut3D *table) {
+    if (!table) {
+      return;
+    }
+    Op op = MakeOp(OP_LUT);
+    op.lut = table;
+    append(op);
+  }
+
+  void PixelPipeline::transform(const ColorTransform *xf) {
+    if (!xf) {
+      return;
+    }
+    Op op = MakeOp(OP_TRANSFORM);
+    op.xf = xf;
+    append(op);
+  }
+
+  void PixelPipeline::matrix(const float m[9]) {
+    Op op = MakeOp(OP_MATRIX);
+    memcpy(op.matrix, m, sizeof(op.matrix));
+    append(op);
+  }
+
+  void PixelPipeline::decode(TransferFunction tf) {
+    if (tf == TRANSFER_LINEAR) {
+      return;
+    }
+    Op op = MakeOp(OP_DECODE);
+    op.transfer = tf;
+    append(op);
+  }
+
+  void PixelPipeline::encode(TransferFunction tf) {
+    if (tf == TRANSFER_LINEAR) {
+      return;
+    }
+    Op op = MakeOp(OP_ENCODE);
+    op.transfer = tf;
+    append(op);
+  }
+
+  bool PixelPipeline::colorSpace(ColorSpace from, ColorSpace to) {
+    float m[9];
+    if (!GetColorSpaceMatrix(from, to, m)) {
+      return false;
+    }
+    if (from == to) {
+      return true;
+    }
+    decode(GetTransferFunction(from));
+    matrix(m);
+    encode(GetTransferFunction(to));
+    return true;
+  }
+
+  void PixelPipeline::clear() {
+    mOps.clear();
+  }
+
+  // --- Operations on channel arrays
+
+  // log2(m) = t P(t^2) with t = (m - 1) / (m + 1), m in [sqrt(1/2), sqrt(2))
+  static const float Log2Poly[5] = {
+    2.885390043258667f, 0.9617967009544373f, 0.5770780444145203f, 0.41219857335090637f, 0.32059890031814575f
+  };
+
+  // 2^f on [-1/2, 1/2]
+  static const float Exp2Poly[7] = {
+    1.0f, 0.6931471824645996f, 0.24022650718688965f, 0.05550327152013779f,
+    0.00961802527308464f, 0.001340043731033802f, 0.00015469736536033452f
+  };
+
+  static const float Sqrt2 = 1.41421356f;
+
+#ifdef GIMG_SSE2
+
+  // x^y for x > 0, x otherwise
+  static inline __m128 Pow(__m128 x, __m128 y) {
+    __m128 pos = _mm_cmpgt_ps(x, _mm_setzero_ps());
+    __m128 v = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(FLT_MIN)), _mm_set1_ps(FLT_MAX));
+
+    __m128i bits = _mm_castps_si128(v);
+    __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+    bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000));
+    __m128 m = _mm_castsi128_ps(bits);
+    __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(Sqrt2));
+    m = _mm_or_ps(_mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(big, m));
+    // mask is -1
+    e = _mm_sub_epi32(e, _mm_castps_si128(big));
+
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 p = _mm_set1_ps(Log2Poly[4]);
+    for (int i=3; i>=0; --i) {
+      p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(Log2Poly[i]));
+    }
+    __m128 l = _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(t, p));
+
+    __m128 z = _mm_mul_ps(l, y);
+    z = _mm_min_ps(_mm_max_ps(z, _mm_set1_ps(-126.0f)), _mm_set1_ps(127.0f));
+    // floor(z + 0.5) through a positive truncation
+    __m128i k = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(z, _mm_set1_ps(128.5f))), _mm_set1_epi32(128));
+    __m128 f = _mm_sub_ps(z, _mm_cvtepi32_ps(k));
+    __m128 q = _mm_set1_ps(Exp2Poly[6]);
+    for (int i=5; i>=0; --i) {
+      q = _mm_add_ps(_mm_mul_ps(q, f), _mm_set1_ps(Exp2Poly[i]));
+    }
+    __m128 r = _mm_mul_ps(q, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(k, _mm_set1_epi32(127)), 23)));
+
+    return _mm_or_ps(_mm_and_ps(pos, r), _mm_andnot_ps(pos, x));
+  }
+
+#else
+
+  static inline float Pow(float x, float y) {
+    if (!(x > 0.0f)) {
+      return x;
+    }
+    float v = (x > FLT_MIN ? x : FLT_MIN);
+    v = (v < FLT_MAX ? v : FLT_MAX);
+
+    unsigned int bits;
+    memcpy(&bits, &v, 4);
+    int e = int(bits >> 23) - 127;
+    bits = (bits & 0x007FFFFF) | 0x3F800000;
+    float m;
+    memcpy(&m, &bits, 4);
+    if (m > Sqrt2) {
+      m = m * 0.5f;
+      e += 1;
+    }
+
+    float t = (m - 1.0f) / (m + 1.0f);
+    float t2 = t * t;
+    float p = Log2Poly[4];
+    for (int i=3; i>=0; --i) {
+      p = p * t2 + Log2Poly[i];
+    }
+    float l = float(e) + t * p;
+
+    float z = l * y;
+    z = (z > -126.0f ? z : -126.0f);
+    z = (z < 127.0f ? z : 127.0f);
+    int k = int(z + 128.5f) - 128;
+    float f = z - float(k);
+    float q = Exp2Poly[6];
+    for (int i=5; i>=0; --i) {
+      q = q * f + Exp2Poly[i];
+    }
+    unsigned int sbits = (unsigned int)(k + 127) << 23;
+    float s;
+    memcpy(&s, &sbits, 4);
+
+    return q * s;
+  }
+
+#endif
+
+  // Transfer functions are linear (v * slope) up to their knee, then decode
+  // as ((v + offset) / scale)^power and encode as scale v^(1/power) - offset
+
+  struct TransferParams {
+    float decodeKnee;
+    float encodeKnee;
+    float slope;
+    float scale;
+    float offset;
+    float power;
+  };
+
+  static const TransferParams Transfers[] = {
+    {0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f},
+    {0.04045f, 0.0031308f, 12.92f, 1.055f, 0.055f, 2.4f},
+    {0.081243f, 0.018054f, 4.5f, 1.099297f, 0.099297f, 1.0f / 0.45f}
+  };
+
+#ifdef GIMG_SSE2
+
+  static inline __m128 Decode(__m128 v, const TransferParams &tp) {
+    __m128 lin = _mm_mul_ps(v, _mm_set1_ps(1.0f / tp.slope));
+    __m128 x = _mm_mul_ps(_mm_add_ps(v, _mm_set1_ps(tp.offset)), _mm_set1_ps(1.0f / tp.scale));
+    __m128 p = Pow(x, _mm_set1_ps(tp.power));
+    __m128 low = _mm_cmple_ps(v, _mm_set1_ps(tp.decodeKnee));
+    return _mm_or_ps(_mm_and_ps(low, lin), _mm_andnot_ps(low, p));
+  }
+
+  static inline __m128 Encode(__m128 v, const TransferParams &tp) {
+    __m128 lin = _mm_mul_ps(v, _mm_set1_ps(tp.slope));
+    __m128 p = Pow(v, _mm_set1_ps(1.0f / tp.power));
+    p = _mm_sub_ps(_mm_mul_ps(p, _mm_set1_ps(tp.scale)), _mm_set1_ps(tp.offset));
+    __m128 low = _mm_cmple_ps(v, _mm_set1_ps(tp.encodeKnee));
+    return _mm_or_ps(_mm_and_ps(low, lin), _mm_andnot_ps(low, p));
+  }
+
+#else
+
+  static inline float Decode(float v, const TransferParams &tp) {
+    if (v <= tp.decodeKnee) {
+      return v * (1.0f / tp.slope);
+    }
+    return Pow((v + tp.offset) * (1.0f / tp.scale), tp.power);
+  }
+
+  static inline float Encode(float v, const TransferParams &tp) {
+    if (v <= tp.encodeKnee) {
+      return v * tp.slope;
+    }
+    return Pow(v, 1.0f / tp.power) * tp.scale - tp.offset;
+  }
+
+#endif
+
+  // c[channel] holds n values, padded to a multiple of 4
+  static void RunOp(const PixelPipeline::Op &op, float *c[4], size_t n) {
+    size_t n4 = (n + 3) & ~size_t(3);
+
+    switch (op.type) {
+    case PixelPipeline::OP_MULTIPLY_ADD:
+      for (int j=0; j<3; ++j) {
+        float *v = c[j];
+#ifdef GIMG_SSE2
+        __m128 m = _mm_set1_ps(op.mul[j]);
+        __m128 a = _mm_set1_ps(op.add[j]);
+        for (size_t i=0; i<n4; i+=4) {
+          _mm_storeu_ps(v + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(v + i), m), a));
+        }
+#else
+        for (size_t i=0; i<n4; ++i) {
+          v[i] = v[i] * op.mul[j] + op.add[j];
+        }
+#endif
+      }
+      break;
+
+    case PixelPipeline::OP_SATURATION: {
+      float *r = c[0];
+      float *g = c[1];
+      float *b = c[2];
+#ifdef GIMG_SSE2
+      __m128 s = _mm_set1_ps(op.mul[0]);
+      for (size_t i=0; i<n4; i+=4) {
+        __m128 x[3] = {_mm_loadu_ps(r + i), _mm_loadu_ps(g + i), _mm_loadu_ps(b + i)};
+        __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[0], _mm_set1_ps(0.3f)),
+                                         _mm_mul_ps(x[1], _mm_set1_ps(0.59f))),
+                              _mm_mul_ps(x[2], _mm_set1_ps(0.11f)));
+        for (int j=0; j<3; ++j) {
+          _mm_storeu_ps(c[j] + i, _mm_add_ps(l, _mm_mul_ps(s, _mm_sub_ps(x[j], l))));
+        }
+      }
+#else
+      float s = op.mul[0];
+      for (size_t i=0; i<n4; ++i) {
+        float l = r[i] * 0.3f + g[i] * 0.59f + b[i] * 0.11f;
+        r[i] = l + s * (r[i] - l);
+        g[i] = l + s * (g[i] - l);
+        b[i] = l + s * (b[i] - l);
+      }
+#endif
+      break;
+    }
+
+    case PixelPipeline::OP_GAMMA:
+      for (int j=0; j<3; ++j) {
+        float *v = c[j];
+#ifdef GIMG_SSE2
+        __m128 y = _mm_set1_ps(op.mul[0]);
+        for (size_t i=0; i<n4; i+=4) {
+          _mm_storeu_ps(v + i, Pow(_mm_loadu_ps(v + i), y));
+        }
+#else
+        for (size_t i=0; i<n4; ++i) {
+          v[i] = Pow(v[i], op.mul[0]);
+        }
+#endif
+      }
+      break;
+
+    case PixelPipeline::OP_CLAMP:
+      for (int j=0; j<3; ++j) {
+        float *v = c[j];
+#ifdef GIMG_SSE2
+        __m128 lo = _mm_set1_ps(op.mul[0]);
+        __m128 hi = _mm_set1_ps(op.add[0]);
+        for (size_t i=0; i<n4; i+=4) {
+          _mm_storeu_ps(v + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(v + i), lo), hi));
+        }
+#else
+        // same results as maxps/minps (second operand for NaNs)
+        for (size_t i=0; i<n4; ++i) {
+          float x = (v[i] > op.mul[0] ? v[i] : op.mul[0]);
+          v[i] = (x < op.add[0] ? x : op.add[0]);
+        }
+#endif
+      }
+      break;
+
+    case PixelPipeline::OP_LUT:
+      op.lut->lookup(c[0], c[1], c[2], n);
+      break;
+
+    case PixelPipeline::OP_TRANSFORM:
+      for (size_t i=0; i<n; ++i) {
+        Color out = op.xf->apply(Color(c[0][i], c[1][i], c[2][i], c[3][i]));
+        c[0][i] = out.r;
+        c[1][i] = out.g;
+        c[2][i] = out.b;
+        c[3][i] = out.a;
+      }
+      break;
+
+    case PixelPipeline::OP_MATRIX: {
+      const float *m = op.matrix;
+      float *r = c[0];
+      float *g = c[1];
+      float *b = c[2];
+#ifdef GIMG_SSE2
+      for (size_t i=0; i<n4; i+=4) {
+        __m128 x[3] = {_mm_loadu_ps(r + i), _mm_loadu_ps(g + i), _mm_loadu_ps(b + i)};
+        for (int j=0; j<3; ++j) {
+          __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[0], _mm_set1_ps(m[3 * j])),
+                                           _mm_mul_ps(x[1], _mm_set1_ps(m[3 * j + 1]))),
+                                _mm_mul_ps(x[2], _mm_set1_ps(m[3 * j + 2])));
+          _mm_storeu_ps(c[j] + i, y);
+        }
+      }
+#else
+      for (size_t i=0; i<n4; ++i) {
+        float x[3] = {r[i], g[i], b[i]};
+        for (int j=0; j<3; ++j) {
+          c[j][i] = x[0] * m[3 * j] + x[1] * m[3 * j + 1] + x[2] * m[3 * j + 2];
+        }
+      }
+#endif
+      break;
+    }
+
+    case PixelPipeline::OP_DECODE:
+    case PixelPipeline::OP_ENCODE: {
+      const TransferParams &tp = Transfers[op.transfer];
+      bool dec = (op.type == PixelPipeline::OP_DECODE);
+      for (int j=0; j<3; ++j) {
+        float *v = c[j];
+#ifdef GIMG_SSE2
+        for (size_t i=0; i<n4; i+=4) {
+          __m128 x = _mm_loadu_ps(v + i);
+          _mm_storeu_ps(v + i, (dec ? Decode(x, tp) : Encode(x, tp)));
+        }
+#else
+        for (size_t i=0; i<n4; ++i) {
+          v[i] = (dec ? Decode(v[i], tp) : Encode(v[i], tp));
+        }
+#endif
+      }
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+  static void RunOps(const std::vector<PixelPipeline::Op> &ops, float *c[4], size_t n) {
+    for (size_t i=0; i<ops.size(); ++i) {
+      RunOp(ops[i], c, n);
+    }
+  }
+
+  Color PixelPipeline::apply(const Color &col) const {
+    float v[4][4] = {{col.r, 0.0f, 0.0f, 0.0f},
+                     {col.g, 0.0f, 0.0f, 0.0f},
+                     {col.b, 0.0f, 0.0f, 0.0f},
+                     {col.a, 0.0f, 0.0f, 0.0f}};
+    float *c[4] = {v[0], v[1], v[2], v[3]};
+    RunOps(mOps, c, 1);
+    return Color(v[0][0], v[1][0], v[2][0], v[3][0]);
+  }
+
+  // --- Blocks
+
+  struct PipelineBlock {
+    float c[4][BlockSize];
+    float rgba[4 * BlockSize];
+    // interleaved planar pixels (16 bytes at most)
+    unsigned char pix[16 * BlockSize];
+  };
+
+  struct PipelineArgs {
+    const std::vector<PixelPipeline::Op> *ops;
+    PixelDesc desc;
+    // same layout and lengths
+    PixelRows src;
+    PixelRows dst;
+  };
+
+  static void RunRow(const PipelineArgs &args, const PixelRow &src, const PixelRow &dst, PipelineBlock &blk) {
+    const PixelDesc &desc = args.desc;
+    PixelDesc rgbaf(PF_RGBA, PT_FLOAT_32);
+    bool direct = (desc == rgbaf);
+    size_t bpp = desc.getBytesPerPixel();
+    size_t nc = desc.getNumChannels();
+    size_t cs = bpp / nc;
+    bool planar = args.src.planar;
+    float *c[4] = {blk.c[0], blk.c[1], blk.c[2], blk.c[3]};
+
+    for (size_t i=0; i<src.length; i+=BlockSize) {
+      size_t n = (src.length - i < size_t(BlockSize) ? src.length - i : size_t(BlockSize));
+
+      // load
+      const unsigned char *in = src.channels[0] + i * bpp;
+      if (planar) {
+        unsigned char *p = blk.pix;
+        for (size_t k=0; k<n; ++k) {
+          for (size_t j=0; j<nc; ++j, p+=cs) {
+            memcpy(p, src.channels[j] + (i + k) * cs, cs);
+          }
+        }
+        in = blk.pix;
+      }
+
+      const float *v = (const float*) in;
+      if (!direct) {
+        ConvertPixels(in, desc, blk.rgba, rgbaf, n);
+        v = blk.rgba;
+      }
+
+      for (size_t k=0; k<n; ++k, v+=4) {
+        c[0][k] = v[0];
+        c[1][k] = v[1];
+        c[2][k] = v[2];
+        c[3][k] = v[3];
+      }
+      for (size_t k=n; k<((n + 3) & ~size_t(3)); ++k) {
+        c[0][k] = c[1][k] = c[2][k] = c[3][k] = 0.0f;
+      }
+
+      RunOps(*(args.ops), c, n);
+
+      // store
+      unsigned char *out = (planar ? blk.pix : dst.channels[0] + i * bpp);
+      float *w = (direct ? (float*) out : blk.rgba);
+
+      for (size_t k=0; k<n; ++k, w+=4) {
+        w[0] = c[0][k];
+        w[1] = c[1][k];
+        w[2] = c[2][k];
+        w[3] = c[3][k];
+      }
+
+      if (!direct) {
+        ConvertPixels(blk.rgba, rgbaf, out, desc, n);
+      }
+
+      if (planar) {
+        const unsigned char *p = blk.pix;
+        for (size_t k=0; k<n; ++k) {
+          for (size_t j=0; j<nc; ++j, p+=cs) {
+            memcpy(dst.channels[j] + (i + k) * cs, p, cs);
+          }
+        }
+      }
+    }
+  }
+
+  static void RunRows(const PipelineArgs &args) {
+    int numRows = int(args.src.rows.size());
+
+    WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      PipelineBlock *blk = new PipelineBlock();
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        RunRow(args, args.src.rows[y], args.dst.rows[y], *blk);
+      }
+
+      delete blk;
+    }
+  }
+
+  bool PixelPipeline::apply(const void *src, void *dst, const PixelDesc &desc, size_t count) const {
+    if (!desc.isValid() || desc.isCompressed()) {
+      std::cerr << "Pixel pipelines do not support compressed pixel types" << std::endl;
+      return false;
+    }
+
+    size_t bpp = desc.getBytesPerPixel();
+
+    if (mOps.empty()) {
+      if (src != dst) {
+        memcpy(dst, src, count * bpp);
+      }
+      return true;
+    }
+
+    PipelineArgs args;
+    args.ops = &mOps;
+    args.desc = desc;
+
+    ChunkRows(src, desc, count, 0, 0, args.src);
+    ChunkRows(dst, desc, count, 0, 0, args.dst);
+
+    RunRows(args);
+
+    return true;
+  }
+
+  void Image::applyPipeline(const PixelPipeline &pipeline) {
+
+    if (mDesc.isCompressed()) {
+      std::cerr << "Pixel pipelines do not support compressed pixel types" << std::endl;
+      return;
+    }
+
+    if (pipeline.size() == 0) {
+      return;
+    }
+
+    PipelineArgs args;
+    args.ops = &(pipeline.getOps());
+    args.desc = mDesc;
+
+    // in place
+    ImageRows(*this, 0, mNumMipmaps, args.src);
+    args.dst = args.src;
+
+    RunRows(args);
+  }
+
+}
@@ -0,0 +1,384 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/image.h>
+#include <gimg/pixeltraits.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "simd.h"
+#include "tables.h"
+#include "rows.h"
+
+// Color channels are multiplied (divided) by alpha, rounded to nearest for
+// integer types:
+//   8 bits   c * a / 255 with the exact (t + (t >> 8)) >> 8 rounding and
+//            division through per alpha float reciprocals chosen so that
+//            the rounded products are exact for all channel values
+//   16 bits  same rounding for the product, doubles for the division
+//   32 bits  doubles
+//   floats   as Color::premult and Color::unpremult
+// Alpha 0 (below Color epsilon for floats) leaves colors untouched
+//
+// Interleaved RGBA8 and RGBA float rows are processed with SSE2, other
+// formats and planar images use the scalar functions (same results)
+
+namespace gimg {
+
+  // 255 / a, nudged to the closest value giving exact rounded results
+  struct Unpremult8Table {
+    float factors[256][4];
+
+    Unpremult8Table() {
+      for (int a=0; a<256; ++a) {
+        float f = (a == 0 ? 1.0f : 255.0f / float(a));
+        if (a > 0) {
+          f = Search(f, a);
+        }
+        factors[a][0] = f;
+        factors[a][1] = f;
+        factors[a][2] = f;
+        // alpha lane
+        factors[a][3] = 1.0f;
+      }
+    }
+
+    static inline unsigned char Apply(unsigned int c, float f) {
+      float v = float(c) * f + 0.5f;
+      return (unsigned char)(v < 255.0f ? int(v) : 255);
+    }
+
+    static bool Exact(float f, int a) {
+      for (int c=0; c<256; ++c) {
+        int expected = (2 * c * 255 + a) / (2 * a);
+        if (Apply(c, f) != (expected > 255 ? 255 : expected)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    static float Search(float f, int a) {
+      // a few ulps around 255 / a are enough for all alphas
+      unsigned int bits;
+      memcpy(&bits, &f, sizeof(float));
+      for (unsigned int i=0; i<64; ++i) {
+        unsigned int b = bits + ((i & 1) ? (i + 1) / 2 : 0u - i / 2);
+        float g;
+        memcpy(&g, &b, sizeof(float));
+        if (Exact(g, a)) {
+          return g;
+        }
+      }
+      return f;
+    }
+  };
+
+  static const Unpremult8Table& GetUnpremult8Table() {
+    static Unpremult8Table table;
+    return table;
+  }
+
+  template <PixelType T>
+  struct PremultChannel;
+
+  template <>
+  struct PremultChannel<PT_INT_8> {
+    typedef unsigned char C;
+    static inline C Premult(C c, C a) {
+      unsigned int t = (unsigned int)c * a + 128;
+      return C((t + (t >> 8)) >> 8);
+    }
+    static inline C Unpremult(C c, C a) {
+      return Unpremult8Table::Apply(c, GetUnpremult8Table().factors[a][0]);
+    }
+  };
+
+  template <>
+  struct PremultChannel<PT_INT_16> {
+    typedef unsigned short C;
+    static inline C Premult(C c, C a) {
+      unsigned int t = (unsigned int)c * a + 32768;
+      return C((t + (t >> 16)) >> 16);
+    }
+    static inline C Unpremult(C c, C a) {
+      return (a == 0 ? c : ChannelTraits<PT_INT_16>::FromDouble(double(c) * 65535.0 / double(a)));
+    }
+  };
+
+  template <>
+  struct PremultChannel<PT_INT_32> {
+    typedef unsigned int C;
+    static inline C Premult(C c, C a) {
+      return ChannelTraits<PT_INT_32>::FromDouble(double(c) * double(a) / 4294967295.0);
+    }
+    static inline C Unpremult(C c, C a) {
+      return (a == 0 ? c : ChannelTraits<PT_INT_32>::FromDouble(double(c) * 4294967295.0 / double(a)));
+    }
+  };
+
+  template <>
+  struct PremultChannel<PT_FLOAT_32> {
+    typedef float C;
+    static inline C Premult(C c, C a) {
+      return c * a;
+    }
+    static inline C Unpremult(C c, C a) {
+      return (a >= 0.000001f ? c * (1.0f / a) : c);
+    }
+  };
+
+  template <>
+  struct PremultChannel<PT_FLOAT_16> {
+    typedef Half C;
+    static inline C Premult(C c, C a) {
+      return FloatToHalf(PremultChannel<PT_FLOAT_32>::Premult(HalfToFloat(c), HalfToFloat(a)));
+    }
+    static inline C Unpremult(C c, C a) {
+      return FloatToHalf(PremultChannel<PT_FLOAT_32>::Unpremult(HalfToFloat(c), HalfToFloat(a)));
+    }
+  };
+
+  // --- SSE2 rows
+
+#ifdef GIMG_SSE2
+  // returns the number of pixels processed (a multiple of 4)
+  static size_t PremultRGBA8(unsigned char *p, size_t count) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    __m128i alphaOne = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    __m128i half = _mm_set1_epi16(128);
+    size_t n = count & ~size_t(3);
+
+    for (size_t i=0; i<n; i+=4, p+=16) {
+      __m128i v = _mm_loadu_si128((const __m128i*) p);
+      __m128i px[2] = {_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero)};
+
+      for (int k=0; k<2; ++k) {
+        // [a0 a0 a0 255 a1 a1 a1 255] factors
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px[k], _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        a = _mm_or_si128(_mm_and_si128(a, colorMask), alphaOne);
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(px[k], a), half);
+        px[k] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+      }
+
+      _mm_storeu_si128((__m128i*) p, _mm_packus_epi16(px[0], px[1]));
+    }
+
+    return n;
+  }
+
+  static inline __m128i UnpremultPixel8(__m128i px, const float *factors) {
+    __m128 v = _mm_cvtepi32_ps(px);
+    v = _mm_add_ps(_mm_mul_ps(v, _mm_loadu_ps(factors)), _mm_set1_ps(0.5f));
+    return _mm_cvttps_epi32(v);
+  }
+
+  static size_t UnpremultRGBA8(unsigned char *p, size_t count) {
+    __m128i zero = _mm_setzero_si128();
+    size_t n = count & ~size_t(3);
+    const Unpremult8Table &table = GetUnpremult8Table();
+
+    for (size_t i=0; i<n; i+=4, p+=16) {
+      __m128i v = _mm_loadu_si128((const __m128i*) p);
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+      __m128i p0 = UnpremultPixel8(_mm_unpacklo_epi16(lo, zero), table.factors[p[3]]);
+      __m128i p1 = UnpremultPixel8(_mm_unpackhi_epi16(lo, zero), table.factors[p[7]]);
+      __m128i p2 = UnpremultPixel8(_mm_unpacklo_epi16(hi, zero), table.factors[p[11]]);
+      __m128i p3 = UnpremultPixel8(_mm_unpackhi_epi16(hi, zero), table.factors[p[15]]);
+
+      // saturating packs clamp to 255
+      _mm_storeu_si128((__m128i*) p, _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3)));
+    }
+
+    return n;
+  }
+
+  static size_t PremultRGBAF(float *p, size_t count) {
+    __m128 colorMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128 alphaOne = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+    for (size_t i=0; i<count; ++i, p+=4) {
+      __m128 v = _mm_loadu_ps(p);
+      __m128 a = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+      a = _mm_or_ps(_mm_and_ps(a, colorMask), alphaOne);
+      _mm_storeu_ps(p, _mm_mul_ps(v, a));
+    }
+
+    return count;
+  }
+
+  static size_t UnpremultRGBAF(float *p, size_t count) {
+    __m128 colorMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 eps = _mm_set1_ps(0.000001f);
+
+    for (size_t i=0; i<count; ++i, p+=4) {
+      __m128 v = _mm_loadu_ps(p);
+      __m128 a = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+      // 1 / a on color lanes with a >= epsilon, 1 elsewhere
+      __m128 m = _mm_and_ps(_mm_cmpge_ps(a, eps), colorMask);
+      __m128 f = _mm_or_ps(_mm_and_ps(m, _mm_div_ps(one, a)), _mm_andnot_ps(m, one));
+      _mm_storeu_ps(p, _mm_mul_ps(v, f));
+    }
+
+    return count;
+  }
+#endif
+
+  template <PixelType T>
+  struct PremultSIMD {
+    static inline size_t Run(void *, size_t, bool) {
+      return 0;
+    }
+  };
+
+#ifdef GIMG_SSE2
+  template <>
+  struct PremultSIMD<PT_INT_8> {
+    static inline size_t Run(void *p, size_t count, bool unpremult) {
+      return (unpremult ? UnpremultRGBA8((unsigned char*) p, count) : PremultRGBA8((unsigned char*) p, count));
+    }
+  };
+
+  template <>
+  struct PremultSIMD<PT_FLOAT_32> {
+    static inline size_t Run(void *p, size_t count, bool unpremult) {
+      return (unpremult ? UnpremultRGBAF((float*) p, count) : PremultRGBAF((float*) p, count));
+    }
+  };
+#endif
+
+  // --- Rows
+
+  struct PremultArgs {
+    // color channels then alpha
+    PixelRows rows;
+    bool unpremult;
+  };
+
+  template <PixelFormat F, PixelType T>
+  struct PremultKernel {
+    static void Run(PremultArgs &args) {
+      typedef PixelTraits<F, T> P;
+      typedef typename P::Type C;
+      typedef PremultChannel<T> PC;
+
+      // alpha is the last channel of formats with color channels
+      const int NC = P::NumChannels - 1;
+
+      if (int(P::Alpha) != NC || NC == 0) {
+        return;
+      }
+
+      size_t stride = args.rows.stride;
+      bool unpremult = args.unpremult;
+      bool simd = (NC == 3 && stride == 4);
+      int numRows = int(args.rows.rows.size());
+
+      WarmHalfTables();
+      GetUnpremult8Table();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = args.rows.rows[y];
+
+        size_t i = (simd ? PremultSIMD<T>::Run(row.channels[0], row.length, unpremult) : 0);
+
+        C *alpha = ((C*) row.channels[NC]) + i * stride;
+        C *color[3];
+        for (int c=0; c<NC; ++c) {
+          color[c] = ((C*) row.channels[c]) + i * stride;
+        }
+
+        for (; i<row.length; ++i, alpha+=stride) {
+          C a = *alpha;
+          for (int c=0; c<NC; ++c) {
+            *color[c] = (unpremult ? PC::Unpremult(*color[c], a) : PC::Premult(*color[c], a));
+            color[c] += stride;
+          }
+        }
+      }
+    }
+  };
+
+  static bool CheckPremultDesc(const PixelDesc &desc) {
+    return (desc.isPlain() && (desc.getFormat() == PF_RGBA || desc.getFormat() == PF_LUMINANCE_ALPHA));
+  }
+
+  static bool PremultPixels(const void *src, void *dst, const PixelDesc &desc, size_t count, bool unpremult) {
+    if (!CheckPremultDesc(desc)) {
+      return false;
+    }
+
+    if (src != dst) {
+      memcpy(dst, src, count * desc.getBytesPerPixel());
+    }
+
+    PremultArgs args;
+    args.unpremult = unpremult;
+
+    ChunkRows(dst, desc, count, 0, 0, args.rows);
+
+    return DispatchPlain<PremultKernel>(desc, args);
+  }
+
+  bool Premultiply(const void *src, void *dst, const PixelDesc &desc, size_t count) {
+    return PremultPixels(src, dst, desc, count, false);
+  }
+
+  bool Unpremultiply(const void *src, void *dst, const PixelDesc &desc, size_t count) {
+    return PremultPixels(src, dst, desc, count, true);
+  }
+
+  // --- Image
+
+  void Image::premultLevels(bool unpremult, int firstLevel) {
+
+    if (!CheckPremultDesc(mDesc)) {
+      std::cerr << "Alpha premultiplication requires a plain RGBA or luminance alpha image" << std::endl;
+      return;
+    }
+
+    PremultArgs args;
+    args.unpremult = unpremult;
+
+    ImageRows(*this, firstLevel, mNumMipmaps, args.rows);
+
+    DispatchPlain<PremultKernel>(mDesc, args);
+  }
+
+  void Image::premultiply() {
+    premultLevels(false, 0);
+  }
+
+  void Image::unpremultiply() {
+    premultLevels(true, 0);
+  }
+
+}
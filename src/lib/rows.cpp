@@ -0,0 +1,103 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+
+#include "rows.h"
+
+namespace gimg {
+
+  void ChunkRows(const void *data, const PixelDesc &desc, size_t count, int x, int y, PixelRows &pr) {
+    // fixed size chunks for load balancing
+    const size_t chunk = 4096;
+
+    size_t bpp = desc.getBytesPerPixel();
+    size_t nc = desc.getNumChannels();
+    size_t cs = bpp / nc;
+
+    pr.rows.clear();
+    pr.stride = nc;
+    pr.planar = false;
+    pr.maxLength = (count < chunk ? count : chunk);
+
+    unsigned char *start = (unsigned char*) data;
+
+    for (size_t i=0; i<count; i+=chunk, start+=chunk*bpp) {
+      PixelRow row;
+      for (size_t c=0; c<4; ++c) {
+        row.channels[c] = (c < nc ? start + c * cs : 0);
+      }
+      row.length = (count - i < chunk ? count - i : chunk);
+      row.x = x + int(i);
+      row.y = y;
+      pr.rows.push_back(row);
+    }
+  }
+
+  void ImageRows(Image &img, int firstLevel, int lastLevel, PixelRows &pr) {
+    const PixelDesc &desc = img.getPixelDesc();
+
+    size_t nc = desc.getNumChannels();
+    size_t cs = desc.getBytesPerPixel() / nc;
+
+    pr.rows.clear();
+    pr.planar = img.isPlanar();
+    pr.stride = (pr.planar ? 1 : nc);
+    pr.maxLength = 0;
+
+    for (int f=0; f<Image::NUM_FACES; ++f) {
+      for (int j=firstLevel; j<=lastLevel; ++j) {
+        unsigned char *data = (unsigned char*) img.getPixels(j, f);
+        if (!data) {
+          break;
+        }
+
+        int height = img.getHeight(j, f);
+        size_t numRows = size_t(height) * size_t(img.getDepth(j, f));
+        size_t width = img.getWidth(j, f);
+        size_t rowSize = width * (pr.planar ? cs : nc * cs);
+
+        unsigned char *channels[4] = {0, 0, 0, 0};
+        for (size_t c=0; c<nc; ++c) {
+          channels[c] = (pr.planar ? (unsigned char*) img.getPlane(int(c), j, f) : data + c * cs);
+        }
+
+        PixelRow row;
+        row.length = width;
+        row.x = 0;
+
+        for (size_t y=0; y<numRows; ++y) {
+          for (size_t c=0; c<4; ++c) {
+            row.channels[c] = (channels[c] ? channels[c] + y * rowSize : 0);
+          }
+          row.y = int(y % size_t(height));
+          pr.rows.push_back(row);
+        }
+
+        if (width > pr.maxLength) {
+          pr.maxLength = width;
+        }
+      }
+    }
+  }
+
+}
@@ -0,0 +1,64 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+
+#ifndef __gimg_rows_h_
+#define __gimg_rows_h_
+
+#include <gimg/image.h>
+#include <vector>
+
+// Private to the library sources
+// Pixel operations run in parallel over rows: the rows of every face and
+// level of an image, or fixed size chunks of a pixel array
+
+namespace gimg {
+
+  struct PixelRow {
+    // first value of each channel (one plane per channel for planar
+    // images), the first entry is the row start in both layouts
+    unsigned char *channels[4];
+    size_t length;
+    // image position of the first pixel
+    int x;
+    int y;
+  };
+
+  struct PixelRows {
+    std::vector<PixelRow> rows;
+    // values between two pixels of a channel (1 for planes)
+    size_t stride;
+    bool planar;
+    size_t maxLength;
+  };
+
+  // count interleaved pixels starting at image position x, y, split in
+  // chunks for load balancing
+  void ChunkRows(const void *data, const PixelDesc &desc, size_t count, int x, int y, PixelRows &pr);
+
+  // rows of all faces, from level firstLevel to lastLevel (included)
+  void ImageRows(Image &img, int firstLevel, int lastLevel, PixelRows &pr);
+
+}
+
+#endif
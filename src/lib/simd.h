@@ -0,0 +1,37 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#ifndef __gimg_simd_h_
+#define __gimg_simd_h_
+
+// Private to the library sources
+// GIMG_SSE2 is defined when SSE2 intrinsics can be used (always on x86-64),
+// every SSE2 path has a scalar fallback giving the same results, define
+// GIMG_NO_SSE2 to build the fallbacks
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(GIMG_NO_SSE2)
+# include <emmintrin.h>
+# define GIMG_SSE2
+#endif
+
+#endif
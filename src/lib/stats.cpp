@@ -0,0 +1,490 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/stats.h>
+#include <gimg/image.h>
+#include <gimg/convert.h>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "simd.h"
+#include "tables.h"
+#include "rows.h"
+
+// Rows are converted to float values (in place for RGBA float images) and
+// reduced independently: each row gives per channel count, mean, sum of
+// squared deviations, min and max, merged in row order afterwards (Chan et
+// al. pairwise update) so that results do not depend on the thread count
+//
+// Row sums are accumulated in doubles relative to the first pixel of the
+// row, which keeps the variance accurate for values far from 0
+//
+// Histograms are filled in per thread copies merged at the end
+
+namespace gimg {
+
+  ImageStats::ImageStats()
+    : numChannels(0), count(0) {
+    for (int c=0; c<4; ++c) {
+      min[c] = 0.0f;
+      max[c] = 0.0f;
+      mean[c] = 0.0;
+      variance[c] = 0.0;
+    }
+  }
+
+  // --- Histogram
+
+  Histogram::Histogram(int numBins, float minValue, float maxValue, bool logScale)
+    : mTotal(0), mMinValue(0.0f), mMaxValue(1.0f), mLogScale(false), mOffset(0.0f), mScale(1.0f) {
+    if (!reset(numBins, minValue, maxValue, logScale)) {
+      reset(256, 0.0f, 1.0f, false);
+    }
+  }
+
+  Histogram::Histogram(const Histogram &rhs)
+    : mCounts(rhs.mCounts), mTotal(rhs.mTotal), mMinValue(rhs.mMinValue), mMaxValue(rhs.mMaxValue),
+      mLogScale(rhs.mLogScale), mOffset(rhs.mOffset), mScale(rhs.mScale) {
+  }
+
+  Histogram::~Histogram() {
+  }
+
+  Histogram& Histogram::operator=(const Histogram &rhs) {
+    if (this != &rhs) {
+      mCounts = rhs.mCounts;
+      mTotal = rhs.mTotal;
+      mMinValue = rhs.mMinValue;
+      mMaxValue = rhs.mMaxValue;
+      mLogScale = rhs.mLogScale;
+      mOffset = rhs.mOffset;
+      mScale = rhs.mScale;
+    }
+    return *this;
+  }
+
+  bool Histogram::reset(int numBins, float minValue, float maxValue, bool logScale) {
+    if (numBins <= 0 || !(maxValue > minValue) || (logScale && !(minValue > 0.0f))) {
+      std::cerr << "Invalid histogram range or number of bins" << std::endl;
+      return false;
+    }
+
+    mCounts.assign(numBins, 0);
+    mTotal = 0;
+    mMinValue = minValue;
+    mMaxValue = maxValue;
+    mLogScale = logScale;
+
+    if (logScale) {
+      mOffset = float(log(double(minValue)) / log(2.0));
+      mScale = float(numBins / (log(double(maxValue) / double(minValue)) / log(2.0)));
+    } else {
+      mOffset = minValue;
+      mScale = float(numBins / (double(maxValue) - double(minValue)));
+    }
+
+    return true;
+  }
+
+  void Histogram::clear() {
+    std::fill(mCounts.begin(), mCounts.end(), size_t(0));
+    mTotal = 0;
+  }
+
+  void Histogram::add(const float *values, size_t count, size_t stride) {
+    size_t *counts = &mCounts[0];
+    int last = int(mCounts.size()) - 1;
+    float top = float(last);
+    size_t i = 0;
+
+#ifdef GIMG_SSE2
+    if (!mLogScale && stride == 1) {
+      __m128 offset = _mm_set1_ps(mOffset);
+      __m128 scale = _mm_set1_ps(mScale);
+      __m128 zero = _mm_setzero_ps();
+      __m128 vtop = _mm_set1_ps(top);
+      int bins[4];
+
+      for (; i+4<=count; i+=4) {
+        __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(values + i), offset), scale);
+        // max first so that NaNs go to the first bin
+        x = _mm_min_ps(_mm_max_ps(x, zero), vtop);
+        _mm_storeu_si128((__m128i*) bins, _mm_cvttps_epi32(x));
+        ++counts[bins[0]];
+        ++counts[bins[1]];
+        ++counts[bins[2]];
+        ++counts[bins[3]];
+      }
+    }
+#endif
+
+    for (const float *v=values+i*stride; i<count; ++i, v+=stride) {
+      float x = *v;
+      if (mLogScale) {
+        x = (x > 0.0f ? float(log(double(x)) / log(2.0)) : mOffset);
+      }
+      x = (x - mOffset) * mScale;
+      x = (x > 0.0f ? x : 0.0f);
+      x = (x < top ? x : top);
+      ++counts[int(x)];
+    }
+
+    mTotal += count;
+  }
+
+  bool Histogram::merge(const Histogram &rhs) {
+    if (rhs.mCounts.size() != mCounts.size() || rhs.mMinValue != mMinValue ||
+        rhs.mMaxValue != mMaxValue || rhs.mLogScale != mLogScale) {
+      return false;
+    }
+    for (size_t i=0; i<mCounts.size(); ++i) {
+      mCounts[i] += rhs.mCounts[i];
+    }
+    mTotal += rhs.mTotal;
+    return true;
+  }
+
+  float Histogram::getBinValue(int bin) const {
+    float x = mOffset + float(bin) / mScale;
+    return (mLogScale ? float(pow(2.0, double(x))) : x);
+  }
+
+  float Histogram::percentile(float p) const {
+    if (mTotal == 0) {
+      return mMinValue;
+    }
+
+    double target = double(p < 0.0f ? 0.0f : (p > 1.0f ? 1.0f : p)) * double(mTotal);
+    double cumul = 0.0;
+    int numBins = int(mCounts.size());
+
+    for (int i=0; i<numBins; ++i) {
+      double next = cumul + double(mCounts[i]);
+      if (next >= target && mCounts[i] > 0) {
+        float t = float((target - cumul) / double(mCounts[i]));
+        float x = mOffset + (float(i) + t) / mScale;
+        return (mLogScale ? float(pow(2.0, double(x))) : x);
+      }
+      cumul = next;
+    }
+
+    return mMaxValue;
+  }
+
+  // --- Rows
+
+  // Interleaved float values of a row in the image format
+  // (data itself for interleaved float images)
+  static const float* RowValues(const PixelDesc &desc, const PixelRows &sr, const PixelRow &row,
+                                std::vector<unsigned char> &pix, std::vector<float> &values) {
+    PixelDesc floatDesc(desc.getFormat(), PT_FLOAT_32);
+    const unsigned char *src = row.channels[0];
+
+    if (sr.planar) {
+      size_t nc = desc.getNumChannels();
+      size_t cs = desc.getBytesPerPixel() / nc;
+      unsigned char *dst = &pix[0];
+      for (size_t i=0; i<row.length; ++i) {
+        for (size_t c=0; c<nc; ++c, dst+=cs) {
+          memcpy(dst, row.channels[c] + i * cs, cs);
+        }
+      }
+      src = &pix[0];
+    }
+
+    if (desc == floatDesc) {
+      return (const float*) src;
+    }
+
+    ConvertPixels(src, desc, &values[0], floatDesc, row.length);
+
+    return &values[0];
+  }
+
+  static bool CollectRows(Image &img, int mipLevel, PixelRows &sr) {
+    const PixelDesc &desc = img.getPixelDesc();
+
+    if (desc.isCompressed()) {
+      std::cerr << "Cannot compute statistics of a compressed image" << std::endl;
+      return false;
+    }
+    if (mipLevel < 0 || mipLevel > img.getNumMipmaps()) {
+      std::cerr << "Invalid mipmap level " << mipLevel << std::endl;
+      return false;
+    }
+
+    ImageRows(img, mipLevel, mipLevel, sr);
+
+    return true;
+  }
+
+  // --- Statistics
+
+  struct RowStats {
+    float min[4];
+    float max[4];
+    double mean[4];
+    // sum of squared deviations from mean
+    double m2[4];
+    size_t count;
+  };
+
+  static void ReduceRow(const float *v, size_t length, int nc, RowStats &rs) {
+    // sums relative to the first pixel
+    float shift[4];
+    double sum[4];
+    double sq[4];
+
+    for (int c=0; c<nc; ++c) {
+      shift[c] = v[c];
+      rs.min[c] = v[c];
+      rs.max[c] = v[c];
+      sum[c] = 0.0;
+      sq[c] = 0.0;
+    }
+
+    size_t n = length * nc;
+    size_t i = 0;
+
+#ifdef GIMG_SSE2
+    // groups of 12 (RGB) or 4 values, a whole number of pixels, value k of
+    // a group is channel k % nc
+    const int numVecs = (nc == 3 ? 3 : 1);
+    const size_t group = 4 * numVecs;
+
+    __m128 vmin[3], vmax[3], vshift[3];
+    __m128d vsum[3][2], vsq[3][2];
+
+    for (int k=0; k<numVecs; ++k) {
+      float s[4], lo[4];
+      for (int j=0; j<4; ++j) {
+        s[j] = shift[(4 * k + j) % nc];
+        lo[j] = rs.min[(4 * k + j) % nc];
+      }
+      vshift[k] = _mm_loadu_ps(s);
+      vmin[k] = _mm_loadu_ps(lo);
+      vmax[k] = vmin[k];
+      vsum[k][0] = vsum[k][1] = _mm_setzero_pd();
+      vsq[k][0] = vsq[k][1] = _mm_setzero_pd();
+    }
+
+    for (; i+group<=n; i+=group) {
+      for (int k=0; k<numVecs; ++k) {
+        __m128 x = _mm_loadu_ps(v + i + 4 * k);
+        vmin[k] = _mm_min_ps(vmin[k], x);
+        vmax[k] = _mm_max_ps(vmax[k], x);
+        __m128 d = _mm_sub_ps(x, vshift[k]);
+        __m128d dlo = _mm_cvtps_pd(d);
+        __m128d dhi = _mm_cvtps_pd(_mm_movehl_ps(d, d));
+        vsum[k][0] = _mm_add_pd(vsum[k][0], dlo);
+        vsum[k][1] = _mm_add_pd(vsum[k][1], dhi);
+        vsq[k][0] = _mm_add_pd(vsq[k][0], _mm_mul_pd(dlo, dlo));
+        vsq[k][1] = _mm_add_pd(vsq[k][1], _mm_mul_pd(dhi, dhi));
+      }
+    }
+
+    for (int k=0; k<numVecs; ++k) {
+      float lo[4], hi[4];
+      double s[4], q[4];
+      _mm_storeu_ps(lo, vmin[k]);
+      _mm_storeu_ps(hi, vmax[k]);
+      _mm_storeu_pd(s, vsum[k][0]);
+      _mm_storeu_pd(s + 2, vsum[k][1]);
+      _mm_storeu_pd(q, vsq[k][0]);
+      _mm_storeu_pd(q + 2, vsq[k][1]);
+      for (int j=0; j<4; ++j) {
+        int c = (4 * k + j) % nc;
+        rs.min[c] = (lo[j] < rs.min[c] ? lo[j] : rs.min[c]);
+        rs.max[c] = (hi[j] > rs.max[c] ? hi[j] : rs.max[c]);
+        sum[c] += s[j];
+        sq[c] += q[j];
+      }
+    }
+#endif
+
+    for (int c=0; i<n; ++i) {
+      float x = v[i];
+      rs.min[c] = (x < rs.min[c] ? x : rs.min[c]);
+      rs.max[c] = (x > rs.max[c] ? x : rs.max[c]);
+      double d = double(x - shift[c]);
+      sum[c] += d;
+      sq[c] += d * d;
+      if (++c == nc) {
+        c = 0;
+      }
+    }
+
+    rs.count = length;
+
+    for (int c=0; c<nc; ++c) {
+      double m = sum[c] / double(length);
+      rs.mean[c] = double(shift[c]) + m;
+      rs.m2[c] = sq[c] - sum[c] * m;
+      if (rs.m2[c] < 0.0) {
+        rs.m2[c] = 0.0;
+      }
+    }
+  }
+
+  bool Image::computeStats(ImageStats &stats, int mipLevel) {
+    PixelRows sr;
+
+    if (!CollectRows(*this, mipLevel, sr)) {
+      return false;
+    }
+
+    int nc = int(mDesc.getNumChannels());
+    int numRows = int(sr.rows.size());
+    std::vector<RowStats> partials(numRows);
+
+    WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      std::vector<unsigned char> pix(sr.planar ? sr.maxLength * mDesc.getBytesPerPixel() : 0);
+      std::vector<float> values(sr.maxLength * nc);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = sr.rows[y];
+        if (row.length > 0) {
+          ReduceRow(RowValues(mDesc, sr, row, pix, values), row.length, nc, partials[y]);
+        } else {
+          partials[y].count = 0;
+        }
+      }
+    }
+
+    stats = ImageStats();
+    stats.numChannels = nc;
+
+    for (int y=0; y<numRows; ++y) {
+      const RowStats &rs = partials[y];
+
+      if (rs.count == 0) {
+        continue;
+      }
+
+      double na = double(stats.count);
+      double nb = double(rs.count);
+      double n = na + nb;
+
+      for (int c=0; c<nc; ++c) {
+        if (stats.count == 0) {
+          stats.min[c] = rs.min[c];
+          stats.max[c] = rs.max[c];
+          stats.mean[c] = rs.mean[c];
+          stats.variance[c] = rs.m2[c];
+        } else {
+          double delta = rs.mean[c] - stats.mean[c];
+          stats.min[c] = (rs.min[c] < stats.min[c] ? rs.min[c] : stats.min[c]);
+          stats.max[c] = (rs.max[c] > stats.max[c] ? rs.max[c] : stats.max[c]);
+          stats.mean[c] += delta * nb / n;
+          // sum of squared deviations until the end of the loop
+          stats.variance[c] += rs.m2[c] + delta * delta * na * nb / n;
+        }
+      }
+
+      stats.count += rs.count;
+    }
+
+    for (int c=0; c<nc; ++c) {
+      stats.variance[c] = (stats.count > 0 ? stats.variance[c] / double(stats.count) : 0.0);
+    }
+
+    return true;
+  }
+
+  // --- Histograms
+
+  bool Image::computeHistogram(Histogram &hist, int channel, int mipLevel) {
+    int nc = int(mDesc.getNumChannels());
+
+    if (channel < -1 || channel >= nc) {
+      std::cerr << "Invalid histogram channel " << channel << std::endl;
+      return false;
+    }
+
+    PixelRows sr;
+
+    if (!CollectRows(*this, mipLevel, sr)) {
+      return false;
+    }
+
+    PixelDesc lumDesc(PF_LUMINANCE, PT_FLOAT_32);
+    int numRows = int(sr.rows.size());
+
+    hist.clear();
+
+    WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      Histogram local(hist);
+      std::vector<unsigned char> pix(sr.planar ? sr.maxLength * mDesc.getBytesPerPixel() : 0);
+      std::vector<float> values(sr.maxLength * nc);
+      std::vector<float> lum(channel < 0 ? sr.maxLength : 0);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = sr.rows[y];
+
+        if (row.length == 0) {
+          continue;
+        }
+
+        const float *v = RowValues(mDesc, sr, row, pix, values);
+
+        if (channel < 0) {
+          // luminance as in ConvertPixels (Color::luminance weights)
+          if (nc == 1 && mDesc.getFormat() == PF_LUMINANCE) {
+            local.add(v, row.length);
+          } else {
+            ConvertPixels(v, PixelDesc(mDesc.getFormat(), PT_FLOAT_32), &lum[0], lumDesc, row.length);
+            local.add(&lum[0], row.length);
+          }
+        } else {
+          local.add(v + channel, row.length, nc);
+        }
+      }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      hist.merge(local);
+    }
+
+    return true;
+  }
+
+}
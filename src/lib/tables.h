@@ -0,0 +1,44 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+
+#ifndef __gimg_tables_h_
+#define __gimg_tables_h_
+
+// Private to the library sources
+// Lookup tables are built on first use (function local statics), which is
+// not thread safe in C++98: warm the ones a conversion needs before entering
+// a parallel region
+
+namespace gimg {
+
+  // half float tables and F16C detection
+  void WarmHalfTables();
+
+  // tables used by ConvertPixels with the given CONVERT_* flags (includes
+  // the half float ones)
+  void WarmConvertTables(int flags);
+
+}
+
+#endif
@@ -0,0 +1,384 @@
+/*
+
+Copyright (C) 2010  Gaetan Guidet
+
+This file is part of gimg.
+
+gimg is free software; you can redistribute it and/or modify it
+under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or (at
+your option) any later version.
+
+gimg is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+USA.
+
+*/
+
+#include <gimg/tonemap.h>
+#include <gimg/image.h>
+#include <gimg/convert.h>
+#include <cmath>
+#include <vector>
+#include <iostream>
+
+#include "simd.h"
+#include "tables.h"
+#include "rows.h"
+
+// Pixels are tone mapped in blocks of BlockSize, loaded as float arrays per
+// channel (integer and packed sources through ConvertPixels), so that the
+// operators run on 4 values at a time
+//
+// Gamma encoding and 8 bits quantization are a single lookup in a table
+// indexed by the value quantized to 16 bits, built from the 255 code
+// thresholds (256 pow calls instead of one per value), dithering uses a
+// second table of 8.8 fixed point encoded values
+
+namespace gimg {
+
+  ToneMapSettings::ToneMapSettings(ToneMapOperator o, float e, float g, float w, int d)
+    : op(o), exposure(e), gamma(g), whitePoint(w), dither(d) {
+  }
+
+  enum {
+    BlockSize = 256,
+    TableSize = 65536
+  };
+
+  // Hable filmic curve coefficients
+  static const float FilmicA = 0.15f;
+  static const float FilmicB = 0.50f;
+  static const float FilmicC = 0.10f;
+  static const float FilmicD = 0.20f;
+  static const float FilmicE = 0.02f;
+  static const float FilmicF = 0.30f;
+
+  // inputs are clamped to [0, MaxInput] (NaNs to 0) so that the operators
+  // stay finite for infinite values
+  static const float MaxInput = 1.0e18f;
+
+  static inline float Filmic(float x) {
+    return ((x * (FilmicA * x + FilmicC * FilmicB) + FilmicD * FilmicE) /
+            (x * (FilmicA * x + FilmicB) + FilmicD * FilmicF)) - FilmicE / FilmicF;
+  }
+
+  struct ToneMapper {
+    ToneMapOperator op;
+    // 2^exposure
+    float scale;
+    // Reinhard 1 / white^2
+    float invWhite2;
+    // filmic 1 / Filmic(white)
+    float filmicNorm;
+    std::vector<unsigned char> encode;
+    // dither pattern (see GetDitherPattern), null when rounding
+    const unsigned int *pattern;
+    int patternSize;
+    // encoded values in 1/256 codes, linear between the code thresholds
+    std::vector<unsigned short> encodeFine;
+
+    ToneMapper(const ToneMapSettings &settings)
+      : op(settings.op), invWhite2(0.0f), filmicNorm(1.0f), encode(TableSize),
+        pattern(0), patternSize(0) {
+
+      scale = float(pow(2.0, double(settings.exposure)));
+
+      if (op == TONEMAP_REINHARD && settings.whitePoint > 0.0f) {
+        invWhite2 = 1.0f / (settings.whitePoint * settings.whitePoint);
+      } else if (op == TONEMAP_FILMIC) {
+        filmicNorm = 1.0f / Filmic(settings.whitePoint > 0.0f ? settings.whitePoint : 11.2f);
+      }
+
+      double gamma = (settings.gamma > 0.0f ? double(settings.gamma) : 1.0);
+
+      // code k starts at ((k - 0.5) / 255)^gamma
+      double thresholds[257];
+      thresholds[0] = 0.0;
+      for (int k=1; k<256; ++k) {
+        thresholds[k] = pow((k - 0.5) / 255.0, gamma);
+      }
+      thresholds[256] = 2.0;
+
+      int code = 0;
+      for (int i=0; i<TableSize; ++i) {
+        double v = double(i) / double(TableSize - 1);
+        while (v >= thresholds[code + 1]) {
+          ++code;
+        }
+        encode[i] = (unsigned char) code;
+      }
+
+      pattern = GetDitherPattern(settings.dither, &patternSize);
+
+      if (pattern) {
+        encodeFine.resize(TableSize);
+        code = 0;
+        for (int i=0; i<TableSize; ++i) {
+          double v = double(i) / double(TableSize - 1);
+          while (v >= thresholds[code + 1]) {
+            ++code;
+          }
+          // code k covers [k - 0.5, k + 0.5[ (clamped to [0, 255])
+          double lo = (code > 0 ? code - 0.5 : 0.0);
+          double hi = (code < 255 ? code + 0.5 : 255.0);
+          double end = (thresholds[code + 1] < 1.0 ? thresholds[code + 1] : 1.0);
+          double e = lo + (hi - lo) * (v - thresholds[code]) / (end - thresholds[code]);
+          encodeFine[i] = (unsigned short) int(e * 256.0 + 0.5);
+        }
+      }
+    }
+  };
+
+  struct ToneMapBlock {
+    float c[4][BlockSize];
+    int idx[3][BlockSize];
+    float rgba[4 * BlockSize];
+  };
+
+  static void LoadBlock(const unsigned char *src, const PixelDesc &desc, size_t n, ToneMapBlock &blk) {
+    const float *p = (const float*) src;
+    size_t nc = 4;
+
+    if (desc.getType() == PT_FLOAT_32 && (desc.getFormat() == PF_RGB || desc.getFormat() == PF_RGBA)) {
+      nc = desc.getNumChannels();
+    } else {
+      ConvertPixels(src, desc, blk.rgba, PixelDesc(PF_RGBA, PT_FLOAT_32), n);
+      p = blk.rgba;
+    }
+
+    for (size_t i=0; i<n; ++i, p+=nc) {
+      blk.c[0][i] = p[0];
+      blk.c[1][i] = p[1];
+      blk.c[2][i] = p[2];
+      blk.c[3][i] = (nc == 4 ? p[3] : 1.0f);
+    }
+
+    // whole groups of 4
+    for (size_t i=n; i<((n + 3) & ~size_t(3)); ++i) {
+      blk.c[0][i] = blk.c[1][i] = blk.c[2][i] = blk.c[3][i] = 0.0f;
+    }
+  }
+
+  static void MapBlock(const ToneMapper &tm, size_t n, ToneMapBlock &blk) {
+    float *r = blk.c[0];
+    float *g = blk.c[1];
+    float *b = blk.c[2];
+
+#ifdef GIMG_SSE2
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 scale = _mm_set1_ps(tm.scale);
+    __m128 tableScale = _mm_set1_ps(float(TableSize - 1));
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 big = _mm_set1_ps(MaxInput);
+
+    for (size_t i=0; i<n; i+=4) {
+      __m128 x[3] = {_mm_mul_ps(_mm_loadu_ps(r + i), scale),
+                     _mm_mul_ps(_mm_loadu_ps(g + i), scale),
+                     _mm_mul_ps(_mm_loadu_ps(b + i), scale)};
+
+      // max first so that NaNs clamp to 0
+      for (int c=0; c<3; ++c) {
+        x[c] = _mm_min_ps(_mm_max_ps(x[c], zero), big);
+      }
+
+      if (tm.op == TONEMAP_REINHARD) {
+        __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[0], _mm_set1_ps(0.3f)),
+                                         _mm_mul_ps(x[1], _mm_set1_ps(0.59f))),
+                              _mm_mul_ps(x[2], _mm_set1_ps(0.11f)));
+        __m128 s = _mm_div_ps(_mm_add_ps(one, _mm_mul_ps(l, _mm_set1_ps(tm.invWhite2))), _mm_add_ps(one, l));
+        for (int c=0; c<3; ++c) {
+          x[c] = _mm_mul_ps(x[c], s);
+        }
+
+      } else if (tm.op == TONEMAP_FILMIC) {
+        for (int c=0; c<3; ++c) {
+          __m128 v = x[c];
+          __m128 num = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(FilmicA), v), _mm_set1_ps(FilmicC * FilmicB))),
+                                  _mm_set1_ps(FilmicD * FilmicE));
+          __m128 den = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(FilmicA), v), _mm_set1_ps(FilmicB))),
+                                  _mm_set1_ps(FilmicD * FilmicF));
+          v = _mm_sub_ps(_mm_div_ps(num, den), _mm_set1_ps(FilmicE / FilmicF));
+          x[c] = _mm_mul_ps(v, _mm_set1_ps(tm.filmicNorm));
+        }
+      }
+
+      for (int c=0; c<3; ++c) {
+        __m128 v = _mm_min_ps(x[c], one);
+        v = _mm_add_ps(_mm_mul_ps(v, tableScale), half);
+        _mm_storeu_si128((__m128i*) (blk.idx[c] + i), _mm_cvttps_epi32(v));
+      }
+    }
+#else
+    for (size_t i=0; i<n; ++i) {
+      float x[3] = {r[i] * tm.scale, g[i] * tm.scale, b[i] * tm.scale};
+
+      for (int c=0; c<3; ++c) {
+        x[c] = (x[c] > 0.0f ? x[c] : 0.0f);
+        x[c] = (x[c] < MaxInput ? x[c] : MaxInput);
+      }
+
+      if (tm.op == TONEMAP_REINHARD) {
+        float l = x[0] * 0.3f + x[1] * 0.59f + x[2] * 0.11f;
+        float s = (1.0f + l * tm.invWhite2) / (1.0f + l);
+        for (int c=0; c<3; ++c) {
+          x[c] *= s;
+        }
+
+      } else if (tm.op == TONEMAP_FILMIC) {
+        for (int c=0; c<3; ++c) {
+          x[c] = Filmic(x[c]) * tm.filmicNorm;
+        }
+      }
+
+      for (int c=0; c<3; ++c) {
+        float v = (x[c] < 1.0f ? x[c] : 1.0f);
+        blk.idx[c][i] = int(v * float(TableSize - 1) + 0.5f);
+      }
+    }
+#endif
+  }
+
+  // x, y: image position of the first pixel (dithering)
+  static void StoreBlock(const ToneMapper &tm, const ToneMapBlock &blk, size_t n, size_t nc,
+                         int x, int y, unsigned char *dst) {
+    const unsigned char *encode = &(tm.encode[0]);
+    int mask = tm.patternSize - 1;
+    const unsigned int *row = (tm.pattern ? tm.pattern + (y & mask) * tm.patternSize : 0);
+    unsigned int levels = unsigned(tm.patternSize * tm.patternSize);
+
+    for (size_t i=0; i<n; ++i, dst+=nc) {
+      if (row) {
+        // threshold in 1/256 codes, encodeFine is at most 255 * 256
+        const unsigned short *fine = &(tm.encodeFine[0]);
+        unsigned int t = ((2 * row[(x + int(i)) & mask] + 1) * 128) / levels;
+        dst[0] = (unsigned char)((fine[blk.idx[0][i]] + t) >> 8);
+        dst[1] = (unsigned char)((fine[blk.idx[1][i]] + t) >> 8);
+        dst[2] = (unsigned char)((fine[blk.idx[2][i]] + t) >> 8);
+      } else {
+        dst[0] = encode[blk.idx[0][i]];
+        dst[1] = encode[blk.idx[1][i]];
+        dst[2] = encode[blk.idx[2][i]];
+      }
+      if (nc == 4) {
+        float a = blk.c[3][i];
+        a = (a > 0.0f ? a : 0.0f);
+        dst[3] = (unsigned char)(int((a < 1.0f ? a : 1.0f) * 255.0f + 0.5f));
+      }
+    }
+  }
+
+  static void ToneMapRun(const ToneMapper &tm, const unsigned char *src, const PixelDesc &srcDesc,
+                         unsigned char *dst, size_t dstChannels, size_t count, int x, int y,
+                         ToneMapBlock &blk) {
+    size_t srcPixSize = srcDesc.getBytesPerPixel();
+
+    for (size_t i=0; i<count; i+=BlockSize) {
+      size_t n = (count - i < size_t(BlockSize) ? count - i : size_t(BlockSize));
+      LoadBlock(src, srcDesc, n, blk);
+      MapBlock(tm, n, blk);
+      StoreBlock(tm, blk, n, dstChannels, x + (int)i, y, dst);
+      src += n * srcPixSize;
+      dst += n * dstChannels;
+    }
+  }
+
+  static bool CheckToneMapDescs(const PixelDesc &srcDesc, const PixelDesc &dstDesc) {
+    if (!srcDesc.isValid() || srcDesc.isCompressed()) {
+      std::cerr << "Cannot tone map compressed image format" << std::endl;
+      return false;
+    }
+    if (dstDesc.getType() != PT_INT_8 || (dstDesc.getFormat() != PF_RGB && dstDesc.getFormat() != PF_RGBA)) {
+      std::cerr << "Tone mapping only outputs 8 bits RGB or RGBA pixels" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // src and dst rows have the same lengths
+  static void ToneMapRows(const ToneMapper &tm, const PixelRows &src, const PixelDesc &srcDesc,
+                          const PixelRows &dst, const PixelDesc &dstDesc) {
+    size_t dstChannels = dstDesc.getNumChannels();
+    int numRows = int(src.rows.size());
+
+    WarmHalfTables();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      ToneMapBlock *blk = new ToneMapBlock();
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, 16)
+#endif
+      for (int y=0; y<numRows; ++y) {
+        const PixelRow &row = src.rows[y];
+        ToneMapRun(tm, row.channels[0], srcDesc, dst.rows[y].channels[0], dstChannels, row.length,
+                   row.x, row.y, *blk);
+      }
+
+      delete blk;
+    }
+  }
+
+  bool ToneMapPixels(const void *src, const PixelDesc &srcDesc,
+                     void *dst, const PixelDesc &dstDesc,
+                     size_t count, const ToneMapSettings &settings,
+                     int x, int y) {
+    if (!CheckToneMapDescs(srcDesc, dstDesc)) {
+      return false;
+    }
+
+    ToneMapper tm(settings);
+
+    PixelRows srcRows;
+    PixelRows dstRows;
+
+    ChunkRows(src, srcDesc, count, x, y, srcRows);
+    ChunkRows(dst, dstDesc, count, x, y, dstRows);
+
+    ToneMapRows(tm, srcRows, srcDesc, dstRows, dstDesc);
+
+    return true;
+  }
+
+  Image* Image::toneMap(const PixelDesc &desc, const ToneMapSettings &settings) {
+
+    if (!CheckToneMapDescs(mDesc, desc)) {
+      return 0;
+    }
+
+    if (mPlanar) {
+      // work on an interleaved copy
+      Image *tmp = convert(mDesc);
+      Image *img = (tmp ? tmp->toneMap(desc, settings) : 0);
+      delete tmp;
+      return img;
+    }
+
+    ToneMapper tm(settings);
+
+    Image *img = new Image(desc, mMaxWidth, mMaxHeight, mMaxDepth, mNumMipmaps);
+
+    img->mOrientation = mOrientation;
+
+    PixelRows srcRows;
+    PixelRows dstRows;
+
+    ImageRows(*this, 0, mNumMipmaps, srcRows);
+    ImageRows(*img, 0, mNumMipmaps, dstRows);
+
+    ToneMapRows(tm, srcRows, mDesc, dstRows, desc);
+
+    return img;
+  }
+
+}
@@ -1,4 +1,5 @@
 #include <gimg/image.h>
+#include <gimg/convert.h>
 #include <gcore/dmodule.h>
 #include <cmath>
 #include <string>
@@ -93,10 +94,11 @@ GCORE_MODULE_API bool canWrite() {
     return 0;\
   }
 
-GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
+GCORE_MODULE_API gimg::Image* readImage(const char *filepath, const gimg::PixelDesc *outDesc, int flags) {
   // dib is not in the format we want 
   // PF_RGB | PF_RGBA (24 or 32 bits)
   // -> NOT BGR beware !
+  // scanlines are converted to outDesc (8 bits RGB if null) as they are copied
   
   gimg::Image *bmp = 0;
   
@@ -203,15 +205,32 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
     
     gimg::PixelDesc desc(gimg::PF_RGB, gimg::PT_INT_8);
     
+    if (outDesc && outDesc->isValid() && !outDesc->isCompressed()) {
+      desc = *outDesc;
+    }
+    
     bmp = new gimg::Image(desc, bi.biWidth, bi.biHeight);
     
-    size_t srcPixSize = bi.biBitCount >> 3;
+    // 32 bits pixels are BGRX, drop the unused channel
+    gimg::PixelDesc dibDesc((bi.biBitCount == 32 ? gimg::PF_RGBA : gimg::PF_RGB), gimg::PT_INT_8);
+    static const int bgra[4] = {2, 1, 0, 3};
+    
+    // X would be read as alpha by formats that have one, go through a RGB row
+    gimg::PixelDesc rgb8(gimg::PF_RGB, gimg::PT_INT_8);
+    bool alpha = (desc.getFormat() == gimg::PF_A ||
+                  desc.getFormat() == gimg::PF_LUMINANCE_ALPHA ||
+                  desc.getFormat() == gimg::PF_RGBA);
+    unsigned char *rgbScanline = 0;
+    
+    if (bi.biBitCount == 32 && alpha) {
+      rgbScanline = (unsigned char*) malloc(bi.biWidth * 3);
+    }
     
     void *dstPixels = bmp->getPixels();
-    size_t dstPitch = bi.biWidth * desc.getBytesPerPixel();
+    size_t dstPitch = bmp->getLayout().getRowBytes(0);
     
 #ifdef _DEBUG
-    std::cout << "gimg::Image pitch (from PixelDesc): " << dstPitch << std::endl;
+    std::cout << "gimg::Image pitch (from MipLayout): " << dstPitch << std::endl;
 #endif
     
     for (LONG y=0; y<bi.biHeight; ++y) {
@@ -221,16 +240,18 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
       
       unsigned char* bmpScanline = ((unsigned char*)dstPixels) + (y * dstPitch);
       
-      for (LONG x=0; x<bi.biWidth; ++x) {
-        
-        bmpScanline[3*x+0] = dibScanline[2];
-        bmpScanline[3*x+1] = dibScanline[1];
-        bmpScanline[3*x+2] = dibScanline[0];
-        
-        dibScanline += srcPixSize;
+      if (rgbScanline) {
+        gimg::ConvertPixels(dibScanline, dibDesc, rgbScanline, rgb8, bi.biWidth, bgra);
+        gimg::ConvertPixels(rgbScanline, rgb8, bmpScanline, desc, bi.biWidth, 0, flags, 0, y);
+      } else {
+        gimg::ConvertPixels(dibScanline, dibDesc, bmpScanline, desc, bi.biWidth, bgra, flags, 0, y);
       }
     }
     
+    if (rgbScanline) {
+      free(rgbScanline);
+    }
+    
     free(dib);
     
     fclose(bitmap);
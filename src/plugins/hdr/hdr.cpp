@@ -1,4 +1,6 @@
 #include <gimg/image.h>
+#include <gimg/convert.h>
+#include <gimg/pipeline.h>
 #include <gcore/dmodule.h>
 #include <cmath>
 
@@ -167,113 +169,6 @@ static bool writeComponentScanline(FILE *hdrFile,
   return (cur == w);
 }
 
-static void flipVertically(void *pixels, unsigned int width, unsigned int height) {
-  if (!pixels) {
-    return;
-  }
-  
-  unsigned int n = height / 2;
-
-  PixelRGBF *inout = (PixelRGBF*) pixels;
-  
-  for (unsigned int x=0; x<width; ++x) {
-    
-    for (unsigned int y0=0, y1=height-1; y0<n; ++y0, --y1) {
-      
-      PixelRGBF *sl0 = inout + (y0 * width + x);
-      PixelRGBF *sl1 = inout + (y1 * width + x);
-      
-      PixelRGBF tmp = *sl0;
-      *sl0 = *sl1;
-      *sl1 = tmp;
-    }
-  }
-}
-
-static void flipHorizontally(void *pixels, unsigned int width, unsigned int height) {
-  if (!pixels) {
-    return;
-  }
-  
-  unsigned int n = width / 2;
-  
-  PixelRGBF *inout = (PixelRGBF*) pixels;
-  
-  for (unsigned int y=0; y<height; ++y) {
-    
-    PixelRGBF *scanline = inout + (y * width);
-    
-    for (unsigned int x0=0, x1=width-1; x0<n; ++x0, --x1) {
-      
-      PixelRGBF tmp = scanline[x0];
-      scanline[x0] = scanline[x1];
-      scanline[x1] = tmp;
-    }
-  }
-}
-
-static void rotateCW(void *&pixels, unsigned int &width, unsigned int &height) {
-  if (!pixels) {
-    return;
-  }
-  
-  void *rotated = malloc(width * height * 3 * sizeof(float));
-  unsigned int rw = height;
-  unsigned int rh = width;
-  
-  PixelRGBF *in  = (PixelRGBF*) pixels;
-  PixelRGBF *out = (PixelRGBF*) rotated;
-  PixelRGBF *from, *to;
-
-  for (unsigned int y=0; y<height; ++y) {
-    
-    for (unsigned int x=0; x<width; ++x) {
-      
-      from = in + ((width * y) + x);
-      to   = out + (x * rw + (rw - 1 - y));
-
-      *to = *from;
-    }
-  }
-  
-  free(pixels);
-  pixels = rotated;
-  width = rw;
-  height = rh;
-}
-
-static void rotateCCW(void *&pixels, unsigned int &width, unsigned int &height) {
-  
-  if (!pixels) {
-    return;
-  }
-  
-  void *rotated = malloc(width * height * 3 * sizeof(float));
-  unsigned int rw = height;
-  unsigned int rh = width;
-  
-  PixelRGBF *in  = (PixelRGBF*) pixels;
-  PixelRGBF *out = (PixelRGBF*) rotated;
-  PixelRGBF *to, *from;
-
-  for (unsigned int y=0; y<height; ++y) {
-    
-    for (unsigned int x=0; x<width; ++x) {
-      
-      from = in + ((y * width) + x);
-      to   = out + ((rh - 1 - x) * rw + y);
-
-      *to = *from;
-    }
-  }
-  
-  free(pixels);
-  pixels = rotated;
-  width = rw;
-  height = rh;
-}
-
-
 // ---
 
 GCORE_MODULE_API int numExtensions() {
@@ -296,12 +191,12 @@ GCORE_MODULE_API bool canWrite() {
   return true;
 }
 
-GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
+GCORE_MODULE_API gimg::Image* readImage(const char *filepath, const gimg::PixelDesc *outDesc, int flags) {
   
   FILE *hdrFile = fopen(filepath, "rb");
   
   if (!hdrFile) {
-    return false;
+    return 0;
   }
   
   // header info
@@ -309,6 +204,7 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
   bool readInfo = true;
   bool readHeader = true;
   bool hasFormat = false;
+  bool isXYZ = false;
   char headerLine[512];
   bool hflip = false;
   bool vflip = false;
@@ -346,18 +242,15 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
         } else if (sscanf(headerLine, "EXPOSURE=%f", &v0) == 1) {
           exposure *= v0;
           
-        } else if (!strcmp(headerLine, "FORMAT=32-bit_rle_xyze\n")) {
-          // XYZE color format not supported
-          fclose(hdrFile);
-          return 0;
-          
-        } else if (!strcmp(headerLine, "FORMAT=32-bit_rle_rgbe\n")) {
+        } else if (!strcmp(headerLine, "FORMAT=32-bit_rle_rgbe\n") ||
+                   !strcmp(headerLine, "FORMAT=32-bit_rle_xyze\n")) {
           if (hasFormat) {
             // already has a FORMAT header
             fclose(hdrFile);
             return 0;
           }
           hasFormat = true;
+          isXYZ = (strcmp(headerLine, "FORMAT=32-bit_rle_xyze\n") == 0);
           
         } else if (sscanf(headerLine, "COLORCORR=%f %f %f", &v0, &v1, &v2) == 3) {
           // color correction (gamma ?)
@@ -416,10 +309,27 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
     return 0;
   }
   
-  // Float buffer
-  //float *pixels = new float[width * height * 3];
-  void *pixels = malloc(width * height * 3 * sizeof(float));
-  float *fpixels = (float*) pixels;  
+  // Decode straight into the image, in file order, when it is float RGB
+  // Other requested pixels are converted from a float scanline as soon as
+  // it is decoded (half floats are rounded from it directly)
+  gimg::PixelDesc fileDesc(gimg::PF_RGB, gimg::PT_FLOAT_32);
+  gimg::PixelDesc desc(fileDesc);
+  
+  if (outDesc && outDesc->isValid() && !outDesc->isCompressed()) {
+    desc = *outDesc;
+  }
+  
+  gimg::Image *img = new gimg::Image(desc, width, height);
+  unsigned char *pixels = (unsigned char*) img->getPixels();
+  size_t rowSize = img->getLayout().getRowBytes(0);
+  
+  PixelRGBF *fscanl = (desc == fileDesc ? 0 : new PixelRGBF[width]);
+  
+  // XYZE scanlines are converted to linear Rec.709 RGB once decoded
+  gimg::PixelPipeline xyzToRGB;
+  if (isXYZ) {
+    xyzToRGB.colorSpace(gimg::COLORSPACE_XYZ, gimg::COLORSPACE_LINEAR_REC709);
+  }
 
   // Image file scanline
   unsigned char *scanl = new unsigned char[width * 4];
@@ -429,7 +339,7 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
   for (unsigned int i=0; i<height; ++i) {
     
     // output scanline
-    PixelRGBF *outpix = (PixelRGBF*) (fpixels + 3*(i * width));
+    PixelRGBF *outpix = (fscanl ? fscanl : (PixelRGBF*) (pixels + i * rowSize));
     
     fread(&header, sizeof(PixelRGBE), 1, hdrFile);
     
@@ -450,7 +360,8 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
         fprintf(stdout, "Failed to read component scanline\n");
         fclose(hdrFile);
         delete[] scanl;
-        free(pixels);
+        delete[] fscanl;
+        delete img;
         return 0;
       }
       
@@ -477,7 +388,8 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
         if (rr != 4*(width-1)) {
           fclose(hdrFile);
           delete[] scanl;
-          free(pixels);
+          delete[] fscanl;
+          delete img;
           return 0;
         }
         
@@ -495,37 +407,42 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
       }
     }
     
+    if (isXYZ) {
+      xyzToRGB.apply(outpix, outpix, fileDesc, width);
+    }
+    
+    if (fscanl) {
+      gimg::ConvertPixels(fscanl, fileDesc, pixels + i * rowSize, desc, width, 0, flags, 0, i);
+    }
   }
   
   delete[] scanl;
+  delete[] fscanl;
   
-  // do rotations first, then flip
+  // rotations first, then flips
+  // -> expressed as orientation flags, pixels are left in file order
+  
+  int orient = gimg::Image::ORIENT_NORMAL;
   
   if (rcw) {
-    rotateCW(pixels, width, height);
+    orient = gimg::Image::ORIENT_TRANSPOSE | gimg::Image::ORIENT_FLIP_X;
   }
   
   if (rccw) {
-    rotateCCW(pixels, width, height);
+    orient = gimg::Image::ORIENT_TRANSPOSE | gimg::Image::ORIENT_FLIP_Y;
   }
   
   if (hflip) {
-    flipHorizontally(pixels, width, height);
+    orient ^= gimg::Image::ORIENT_FLIP_X;
   }
   
   if (vflip) {
-    flipVertically(pixels, width, height);
+    orient ^= gimg::Image::ORIENT_FLIP_Y;
   }
   
-  fclose(hdrFile);
-
-  // now create the image
-  gimg::PixelDesc desc(gimg::PF_RGB, gimg::PT_FLOAT_32);  
-  gimg::Image *img = new gimg::Image(desc, width, height);
+  img->setOrientation(orient);
   
-  void *data = img->getPixels();
-  memcpy(data, pixels, width*height*3*sizeof(float));
-  free(pixels);
+  fclose(hdrFile);
 
   return img;
 
@@ -537,6 +454,13 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
     return false;
   }
 
+  gimg::PixelDesc desc = img->getPixelDesc();
+  
+  if (!desc.isPlain()) {
+    std::cerr << "HDR writer only supports plain pixel types" << std::endl;
+    return false;
+  }
+
   unsigned int width = img->getWidth();
   unsigned int height = img->getHeight();
 
@@ -549,10 +473,30 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
   fprintf(hdrFile, "EXPOSURE=1.0\n");
   //fprintf(hdrFile, "COLORCORR=1.0 1.0 1.0\n"); // is that Gamma ?
   fprintf(hdrFile, "\n");
-  fprintf(hdrFile, "-Y %u +X %u\n", height, width);
+  
+  // the resolution string can express any orientation, write pixels as stored
+  int orient = img->getOrientation();
+  bool flipX = ((orient & gimg::Image::ORIENT_FLIP_X) != 0);
+  bool flipY = ((orient & gimg::Image::ORIENT_FLIP_Y) != 0);
+  
+  if ((orient & gimg::Image::ORIENT_TRANSPOSE) != 0) {
+    // scanlines are columns (see readImage)
+    fprintf(hdrFile, "%cX %u %cY %u\n", (flipY ? '-' : '+'), width, (flipX ? '+' : '-'), height);
+  } else {
+    fprintf(hdrFile, "%cY %u %cX %u\n", (flipY ? '+' : '-'), height, (flipX ? '-' : '+'), width);
+  }
   
   // Write Pixel Data (RLE)
-  float *pixels = (float*) img->getPixels();
+  // other formats than RGB float (half float for example) are converted
+  // one scanline at a time
+  const gimg::PixelDesc rgbf(gimg::PF_RGB, gimg::PT_FLOAT_32);
+  
+  bool convert = (desc.getFormat() != gimg::PF_RGB || desc.getType() != gimg::PT_FLOAT_32);
+  
+  unsigned char *pixels = (unsigned char*) img->getPixels();
+  size_t rowSize = width * desc.getBytesPerPixel();
+  
+  PixelRGBF *rowf = (convert ? new PixelRGBF[width] : 0);
 
   unsigned char *scanl = new unsigned char[width * 4];
 
@@ -571,7 +515,12 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
     
     for (unsigned int y=0; y<height; ++y) {
       
-      PixelRGBF *inpix = (PixelRGBF*) (pixels + 3*(y * width));
+      PixelRGBF *inpix = (PixelRGBF*) (pixels + y * rowSize);
+      
+      if (convert) {
+        gimg::ConvertPixels(inpix, desc, rowf, rgbf, width);
+        inpix = rowf;
+      }
       
       header[0] = 2;
       header[1] = 2;
@@ -593,6 +542,7 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
           !writeComponentScanline(hdrFile, escanl, width)) {
         fclose(hdrFile);
         delete[] scanl;
+        delete[] rowf;
         return false;
       }
     }
@@ -603,7 +553,12 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
     
     for (unsigned int y=0; y<height; ++y) {
       
-      PixelRGBF *inpix = (PixelRGBF*) (pixels + 3*(y * width));
+      PixelRGBF *inpix = (PixelRGBF*) (pixels + y * rowSize);
+      
+      if (convert) {
+        gimg::ConvertPixels(inpix, desc, rowf, rgbf, width);
+        inpix = rowf;
+      }
       
       for (unsigned int x=0; x<width; ++x) {
         convertRGBFtoRGBE(inpix[x], outpix[x]);
@@ -615,6 +570,7 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
   fclose(hdrFile);
   
   delete[] scanl;
+  delete[] rowf;
   
   return true;
 }
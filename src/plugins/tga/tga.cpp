@@ -1,4 +1,5 @@
 #include <gimg/image.h>
+#include <gimg/convert.h>
 #include <gcore/dmodule.h>
 #include <cmath>
 #include <fstream>
@@ -49,9 +50,36 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
 
   gimg::PixelDesc desc = img->getPixelDesc();
 
+  gimg::Image *tmp = 0;
+
+  if (desc.isPlain() &&
+      (desc.getType() != gimg::PT_INT_8 ||
+       (desc.getFormat() != gimg::PF_RGB && desc.getFormat() != gimg::PF_RGBA))) {
+    // write any other plain format as 8 bits RGB(A), keeping alpha if any
+    bool alpha = (desc.getFormat() == gimg::PF_A ||
+                  desc.getFormat() == gimg::PF_LUMINANCE_ALPHA ||
+                  desc.getFormat() == gimg::PF_RGBA);
+    tmp = img->convert(gimg::PixelDesc(alpha ? gimg::PF_RGBA : gimg::PF_RGB, gimg::PT_INT_8));
+    img = tmp;
+    desc = img->getPixelDesc();
+  }
+
+  if ((img->getOrientation() & gimg::Image::ORIENT_TRANSPOSE) != 0) {
+    // TGA can only express flips, normalize a copy (the caller's image is
+    // left untouched)
+    if (!tmp) {
+      tmp = img->convert(desc);
+      if (!tmp) {
+        return false;
+      }
+      img = tmp;
+    }
+    img->normalizeOrientation();
+  }
+
 #ifdef _DEBUG
   std::cout << "Expected image size: "
-            << desc.getBytesSizeFor(img->getWidth(), img->getHeight(), 1, 0, 1) << std::endl;
+            << img->getLayout().getBytesSize(0) << std::endl;
 #endif
 
   if ((desc.getFormat() == gimg::PF_RGB ||
@@ -93,7 +121,14 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
     short width = (short) w;
     short height = (short) h;
     char bits = (desc.getFormat() == gimg::PF_RGB ? 24 : 32);
-    char flip = 0x20; // bottom row coming first
+    // bit 5: top row coming first, bit 4: right to left rows
+    char flip = 0x20;
+    if ((img->getOrientation() & gimg::Image::ORIENT_FLIP_Y) != 0) {
+      flip &= ~0x20;
+    }
+    if ((img->getOrientation() & gimg::Image::ORIENT_FLIP_X) != 0) {
+      flip |= 0x10;
+    }
 
     file.write((const char*)&xstart, 2);
     file.write((const char*)&ystart, 2);
@@ -111,33 +146,27 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
     std::cout << "TGA (" << w << "x" << h << ":" << (int)bits << ") pixel data size = " << sz << std::endl;
 #endif
     // no, write BGR(A)
-    
+    static const int bgra[4] = {2, 1, 0, 3};
+
+    size_t rowSize = w * ps;
+    char *row = (char*) malloc(rowSize);
     const char *pix = (const char*) pixels;
-    
-    if (ps == 3) {
-      for (unsigned int y=0; y<h; ++y) {
-        for (unsigned int x=0; x<w; ++x) {
-          file.write((const char*)(&pix[2]), 1);
-          file.write((const char*)(&pix[1]), 1);
-          file.write((const char*)(&pix[0]), 1);
-          pix += ps;
-        }
-      }
-    } else {
-      for (unsigned int y=0; y<h; ++y) {
-        for (unsigned int x=0; x<w; ++x) {
-          file.write((const char*)(&pix[2]), 1);
-          file.write((const char*)(&pix[1]), 1);
-          file.write((const char*)(&pix[0]), 1);
-          file.write((const char*)(&pix[3]), 1);
-          pix += ps;
-        }
-      }
+
+    for (unsigned int y=0; y<h; ++y) {
+      gimg::ConvertPixels(pix, desc, row, desc, w, bgra);
+      file.write(row, rowSize);
+      pix += rowSize;
     }
+
+    free(row);
     //file.write((const char*)pixels, sz);
 
     file.close();
 
+    if (tmp) {
+      delete tmp;
+    }
+
     return true;
 
   } else {
@@ -145,11 +174,15 @@ GCORE_MODULE_API bool writeImage(gimg::Image *img, const char *filepath) {
     std::cout << "Save TGA: unsupported image format" << std::endl;
 #endif
 
+    if (tmp) {
+      delete tmp;
+    }
+
     return false;
   }
 }
 
-GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
+GCORE_MODULE_API gimg::Image* readImage(const char *filepath, const gimg::PixelDesc *outDesc, int flags) {
   std::ifstream file;  
   
   file.open(filepath, std::ios::binary);
@@ -264,157 +297,56 @@ GCORE_MODULE_API gimg::Image* readImage(const char *filepath) {
             std::cout << "  Create gimg::Image instance" << std::endl;
 #endif
 
-            gimg::PixelDesc desc((bdepth == 4 ? gimg::PF_RGBA : gimg::PF_RGB), gimg::PT_INT_8);
+            gimg::PixelDesc fileDesc((bdepth == 4 ? gimg::PF_RGBA : gimg::PF_RGB), gimg::PT_INT_8);
+            gimg::PixelDesc desc(fileDesc);
 
-#ifdef _DEBUG
-            std::cout << "  Image size: " << w << "x" << h << ":" << (int)depth << ", "
-                      << desc.getBytesSizeFor(w, h, 1, 0, 1) << " bytes" << std::endl;
-#endif
+            if (outDesc && outDesc->isValid() && !outDesc->isCompressed()) {
+              desc = *outDesc;
+            }
 
             img = new gimg::Image(desc, w, h);
 
-            unsigned int pitch = w * bdepth;
-
-            unsigned char *dst = (unsigned char*) img->getPixels();
-
-            if (swapRows) {
-              // in TGA file, top rows coming first
-              // -> reverse vertical order
 #ifdef _DEBUG
-              std::cout << "  Swap rows" << std::endl;
+            std::cout << "  Image size: " << w << "x" << h << ":" << (int)depth << ", "
+                      << img->getLayout().getBytesSize(0) << " bytes" << std::endl;
 #endif
-              unsigned int lr = h - 1;
-              unsigned int lc = w - 1;
 
-              unsigned char *src = (unsigned char*)(pixels + (lr * pitch));
+            // keep file pixel order, only swap BGR(A) to RGB(A) while
+            // converting to the requested pixels
+            static const int bgra[4] = {2, 1, 0, 3};
 
-              if (swapCols) {
-#ifdef _DEBUG
-                std::cout << "  Swap columns" << std::endl;
-#endif
-                // in TGA file, row pixels are stored right to left
-                // -> reverse horizontal order
-                if (bdepth == 4) {
-                  for (int j=(int)lr; j>=0; --j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int od = k * bdepth;
-                      unsigned int os = (lc - k) * bdepth;
-                      dst[od] = src[os+2];
-                      dst[od+1] = src[os+1];
-                      dst[od+2] = src[os];
-                      dst[od+3] = src[os+3];
-                    }
-                    src -= pitch;
-                    dst += pitch;
-                  }
-                } else {
-                  for (int j=(int)lr; j>=0; --j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int od = k * bdepth;
-                      unsigned int os = (lc - k) * bdepth;
-                      dst[od] = src[os+2];
-                      dst[od+1] = src[os+1];
-                      dst[od+2] = src[os];
-                    }
-                    src -= pitch;
-                    dst += pitch;
-                  }
-                }
-                
-              } else {
-                if (bdepth == 4) {
-                  for (int j=(int)lr; j>=0; --j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int o = k * bdepth;
-                      dst[o] = src[o+2];
-                      dst[o+1] = src[o+1];
-                      dst[o+2] = src[o];
-                      dst[o+3] = src[o+3];
-                    }
-                    src -= pitch;
-                    dst += pitch;
-                  }
-                } else {
-                  for (int j=(int)lr; j>=0; --j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int o = k * bdepth;
-                      dst[o] = src[o+2];
-                      dst[o+1] = src[o+1];
-                      dst[o+2] = src[o];
-                    }
-                    src -= pitch;
-                    dst += pitch;
-                  }
-                }
-              }
+            if ((flags & (gimg::CONVERT_DITHER | gimg::CONVERT_DITHER_BLUE_NOISE)) == 0) {
+              gimg::ConvertPixels(pixels, fileDesc, img->getPixels(), desc, w * h, bgra, flags);
 
             } else {
-              
-              unsigned int lc = w - 1;
+              // dither patterns need pixel positions, convert row by row
+              const char *src = pixels;
+              char *dst = (char*) img->getPixels();
+              size_t srcRowSize = w * bdepth;
+              size_t dstRowSize = img->getLayout().getRowBytes(0);
+
+              for (unsigned int y=0; y<h; ++y) {
+                gimg::ConvertPixels(src, fileDesc, dst, desc, w, bgra, flags, 0, y);
+                src += srcRowSize;
+                dst += dstRowSize;
+              }
+            }
 
-              char *src = pixels;
+            // in TGA file, top rows coming first (swapRows)
+            // and/or row pixels are stored right to left (swapCols)
+            // -> let the image orientation reverse the order
+            int orient = gimg::Image::ORIENT_NORMAL;
 
-              if (swapCols) {
-#ifdef _DEBUG
-                std::cout << "  Swap columns" << std::endl;
-#endif
-                // in TGA file, row pixels are stored right to left
-                // -> reverse horizontal order
-                if (bdepth == 4) {
-                  for (unsigned int j=0; j<h; ++j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int od = k * bdepth;
-                      unsigned int os = (lc - k) * bdepth;
-                      dst[od] = src[os+2];
-                      dst[od+1] = src[os+1];
-                      dst[od+2] = src[os];
-                      dst[od+3] = src[os+3];
-                    }
-                    src += pitch;
-                    dst += pitch;
-                  }
-                } else {
-                  for (unsigned int j=0; j<h; ++j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int od = k * bdepth;
-                      unsigned int os = (lc - k) * bdepth;
-                      dst[od] = src[os+2];
-                      dst[od+1] = src[os+1];
-                      dst[od+2] = src[os];
-                    }
-                    src += pitch;
-                    dst += pitch;
-                  }
-                }
-                
-              } else {
-                if (bdepth == 4) {
-                  for (unsigned int j=0; j<h; ++j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int o = k * bdepth;
-                      dst[o] = src[o+2];
-                      dst[o+1] = src[o+1];
-                      dst[o+2] = src[o];
-                      dst[o+3] = src[o+3];
-                    }
-                    src += pitch;
-                    dst += pitch;
-                  }
-                } else {
-                  for (unsigned int j=0; j<h; ++j) {
-                    for (unsigned int k=0; k<w; ++k) {
-                      unsigned int o = k * bdepth;
-                      dst[o] = src[o+2];
-                      dst[o+1] = src[o+1];
-                      dst[o+2] = src[o];
-                    }
-                    src += pitch;
-                    dst += pitch;
-                  }
-                }
-              }
+            if (swapRows) {
+              orient |= gimg::Image::ORIENT_FLIP_Y;
             }
 
+            if (swapCols) {
+              orient |= gimg::Image::ORIENT_FLIP_X;
+            }
+
+            img->setOrientation(orient);
+
 #ifdef _DEBUG
             std::cout << "  Done, free temporary allocated memory" << std::endl;
 #endif
@@ -0,0 +1,131 @@
+#include <gimg/color.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+using namespace gimg;
+
+static const size_t NumPixels = 1024 * 1024;
+
+enum Operation {
+  OP_TO_HSV = 0,
+  OP_FROM_HSV,
+  OP_TO_HSL,
+  OP_FROM_HSL,
+  OP_MULTIPLY_ADD,
+  OP_MAX
+};
+
+static const char* OperationName[] = {
+  "toHSV", "fromHSV", "toHSL", "fromHSL", "*= +="
+};
+
+static const Color Mul(0.8f, 1.1f, 0.9f);
+static const Color Add(0.05f, 0.0f, -0.02f);
+
+// per pixel Color path, RGBA float only
+static void RunColor(Operation op, const float *in, float *out) {
+  Color c;
+  for (size_t i=0; i<NumPixels; ++i, in+=4, out+=4) {
+    Color src(in[0], in[1], in[2], in[3]);
+    switch (op) {
+    case OP_TO_HSV:
+      c = src.toHSV();
+      break;
+    case OP_FROM_HSV:
+      c.fromHSV(src);
+      break;
+    case OP_TO_HSL:
+      c = src.toHSL();
+      break;
+    case OP_FROM_HSL:
+      c.fromHSL(src);
+      break;
+    default:
+      c = src;
+      c *= Mul;
+      c += Add;
+    }
+    out[0] = c.r;
+    out[1] = c.g;
+    out[2] = c.b;
+    out[3] = c.a;
+  }
+}
+
+static void RunBatch(Operation op, const void *in, void *out, const PixelDesc &desc) {
+  switch (op) {
+  case OP_TO_HSV:
+    RGBToHSV(in, out, desc, NumPixels);
+    break;
+  case OP_FROM_HSV:
+    HSVToRGB(in, out, desc, NumPixels);
+    break;
+  case OP_TO_HSL:
+    RGBToHSL(in, out, desc, NumPixels);
+    break;
+  case OP_FROM_HSL:
+    HSLToRGB(in, out, desc, NumPixels);
+    break;
+  default:
+    MultiplyAdd(in, out, desc, NumPixels, Mul, Add);
+  }
+}
+
+// Mpixels/s, run for at least a quarter of a second
+static double Bench(Operation op, const void *in, void *out, const PixelDesc *desc) {
+  int runs = 0;
+  clock_t start = clock();
+  clock_t elapsed = 0;
+
+  do {
+    if (desc) {
+      RunBatch(op, in, out, *desc);
+    } else {
+      RunColor(op, (const float*) in, (float*) out);
+    }
+    ++runs;
+    elapsed = clock() - start;
+  } while (elapsed < CLOCKS_PER_SEC / 4);
+
+  double secs = double(elapsed) / CLOCKS_PER_SEC;
+  return (double(NumPixels) * runs / (secs * 1000000.0));
+}
+
+int main(int, char**) {
+
+  fprintf(stdout, "Color operations on %lu pixels, Mpixels/s\n\n", (unsigned long)NumPixels);
+
+  PixelDesc rgbaf(PF_RGBA, PT_FLOAT_32);
+  PixelDesc rgba8(PF_RGBA, PT_INT_8);
+  PixelDesc rgb8(PF_RGB, PT_INT_8);
+
+  float *inf = (float*) malloc(NumPixels * 4 * sizeof(float));
+  float *outf = (float*) malloc(NumPixels * 4 * sizeof(float));
+  unsigned char *in8 = (unsigned char*) malloc(NumPixels * 4);
+  unsigned char *out8 = (unsigned char*) malloc(NumPixels * 4);
+
+  for (size_t i=0; i<NumPixels*4; ++i) {
+    in8[i] = (unsigned char)((i * 7) & 0xFF);
+    inf[i] = float(in8[i]) / 255.0f;
+  }
+
+  fprintf(stdout, "%-8s %12s %12s %12s %12s %8s\n", "", "Color", "RGBA float", "RGBA 8", "RGB 8", "speedup");
+
+  for (int i=0; i<OP_MAX; ++i) {
+    Operation op = (Operation) i;
+    double ref = Bench(op, inf, outf, 0);
+    double bf = Bench(op, inf, outf, &rgbaf);
+    double b8 = Bench(op, in8, out8, &rgba8);
+    double b3 = Bench(op, in8, out8, &rgb8);
+    fprintf(stdout, "%-8s %12.1f %12.1f %12.1f %12.1f %7.1fx\n",
+            OperationName[i], ref, bf, b8, b3, bf / ref);
+  }
+
+  free(inf);
+  free(outf);
+  free(in8);
+  free(out8);
+
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <gimg/convert.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+using namespace gimg;
+
+static const char* FormatName[] = {
+  "L", "R", "G", "B", "A", "LA", "RGB", "RGBA", "RG"
+};
+
+static const char* TypeName[] = {
+  "INT_8", "INT_16", "INT_32", "FLOAT_16", "FLOAT_32",
+  "3_3_2", "5_6_5", "4_4_4_4", "5_5_5_1", "8_8_8_8", "10_10_10_2"
+};
+
+static const size_t NumPixels = 1024 * 1024;
+
+static void Bench(const PixelDesc &src, const PixelDesc &dst, const int *order=0, int flags=0) {
+
+  size_t srcBytes = NumPixels * src.getBytesPerPixel();
+  size_t dstBytes = NumPixels * dst.getBytesPerPixel();
+
+  unsigned char *in = (unsigned char*) malloc(srcBytes);
+  unsigned char *out = (unsigned char*) malloc(dstBytes);
+
+  // ramp converted to the source type (avoids denormal floats)
+  PixelDesc rampDesc(src.getFormat(), PT_INT_8);
+  if (src.isPacked()) {
+    // any bit pattern is valid
+    rampDesc = src;
+  }
+  size_t rampSize = NumPixels * rampDesc.getBytesPerPixel();
+  unsigned char *ramp = (unsigned char*) malloc(rampSize);
+  for (size_t i=0; i<rampSize; ++i) {
+    ramp[i] = (unsigned char)((i * 7) & 0xFF);
+  }
+  ConvertPixels(ramp, rampDesc, in, src, NumPixels);
+  free(ramp);
+
+  // warm up, then run for at least a quarter of a second
+  ConvertPixels(in, src, out, dst, NumPixels, order, flags);
+
+  int runs = 0;
+  clock_t start = clock();
+  clock_t elapsed = 0;
+
+  do {
+    ConvertPixels(in, src, out, dst, NumPixels, order, flags);
+    ++runs;
+    elapsed = clock() - start;
+  } while (elapsed < CLOCKS_PER_SEC / 4);
+
+  double secs = double(elapsed) / CLOCKS_PER_SEC;
+  double gbps = double(srcBytes + dstBytes) * runs / (secs * 1024.0 * 1024.0 * 1024.0);
+
+  fprintf(stdout, "%4s %-10s -> %4s %-10s%s%s: %6.2f GB/s\n",
+          FormatName[src.getFormat()], TypeName[src.getType()],
+          FormatName[dst.getFormat()], TypeName[dst.getType()],
+          (order ? " (swizzled)" : ""), (flags & CONVERT_DITHER ? " (dithered)" : ""), gbps);
+
+  free(in);
+  free(out);
+}
+
+int main(int, char**) {
+
+  fprintf(stdout, "Conversion of %lu pixels, GB/s counts bytes read and written\n\n", (unsigned long)NumPixels);
+
+  // all channel types
+  for (int i=PT_INT_8; i<=PT_FLOAT_32; ++i) {
+    for (int j=PT_INT_8; j<=PT_FLOAT_32; ++j) {
+      Bench(PixelDesc(PF_RGBA, (PixelType)i), PixelDesc(PF_RGBA, (PixelType)j));
+    }
+  }
+
+  fprintf(stdout, "\n");
+
+  // channel add/drop/collapse
+  for (int t=PT_INT_8; t<=PT_FLOAT_32; t+=(PT_FLOAT_32-PT_INT_8)) {
+    for (int i=PF_LUMINANCE; i<PF_MAX; ++i) {
+      for (int j=PF_LUMINANCE; j<PF_MAX; ++j) {
+        if (i == j || (i >= PF_R && i <= PF_A) || (j >= PF_R && j <= PF_A)) {
+          continue;
+        }
+        Bench(PixelDesc((PixelFormat)i, (PixelType)t), PixelDesc((PixelFormat)j, (PixelType)t));
+      }
+    }
+  }
+
+  fprintf(stdout, "\n");
+
+  // mixed channels and types
+  Bench(PixelDesc(PF_RGB, PT_INT_8), PixelDesc(PF_RGBA, PT_FLOAT_32));
+  Bench(PixelDesc(PF_RGBA, PT_INT_16), PixelDesc(PF_RGB, PT_INT_8));
+  Bench(PixelDesc(PF_RGBA, PT_FLOAT_32), PixelDesc(PF_LUMINANCE, PT_INT_8));
+  Bench(PixelDesc(PF_LUMINANCE, PT_INT_8), PixelDesc(PF_RGBA, PT_FLOAT_32));
+
+  // BGR(A) file data
+  static const int bgra[4] = {2, 1, 0, 3};
+  Bench(PixelDesc(PF_RGB, PT_INT_8), PixelDesc(PF_RGB, PT_INT_8), bgra);
+  Bench(PixelDesc(PF_RGBA, PT_INT_8), PixelDesc(PF_RGBA, PT_INT_8), bgra);
+  Bench(PixelDesc(PF_RGBA, PT_INT_8), PixelDesc(PF_RGB, PT_INT_8), bgra);
+  Bench(PixelDesc(PF_RGB, PT_INT_8), PixelDesc(PF_RGBA, PT_FLOAT_32), bgra);
+
+  fprintf(stdout, "\n");
+
+  // packed types
+  for (int t=PT_INT_3_3_2; t<=PT_INT_10_10_10_2; ++t) {
+    PixelFormat fmt = (t <= PT_INT_5_6_5 ? PF_RGB : PF_RGBA);
+    PixelType plainType = (t == PT_INT_10_10_10_2 ? PT_INT_16 : PT_INT_8);
+    Bench(PixelDesc(fmt, plainType), PixelDesc(fmt, (PixelType)t));
+    Bench(PixelDesc(fmt, plainType), PixelDesc(fmt, (PixelType)t), 0, CONVERT_DITHER);
+    Bench(PixelDesc(fmt, (PixelType)t), PixelDesc(fmt, plainType));
+  }
+  Bench(PixelDesc(PF_RGBA, PT_FLOAT_32), PixelDesc(PF_RGB, PT_INT_5_6_5), 0, CONVERT_DITHER);
+  Bench(PixelDesc(PF_RGB, PT_INT_5_6_5), PixelDesc(PF_RGBA, PT_FLOAT_32));
+
+  return 0;
+}
@@ -1,4 +1,15 @@
 #include <gimg/image.h>
+#include <gimg/half.h>
+#include <gimg/convert.h>
+#include <gimg/dxt.h>
+#include <gimg/stats.h>
+#include <gimg/pipeline.h>
+#include <limits>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
 
 using namespace std;
 using namespace gimg;
@@ -12,6 +23,7 @@ static std::string FormatString[]  = {
   "PF_LUMINANCE_ALPHA",
   "PF_RGB",
   "PF_RGBA",
+  "PF_RG",
   "PF_DEPTH"
 };
 
@@ -124,6 +136,994 @@ RGBA operator*(unsigned char n, const RGBA &c) {
 
 // ---
 
+// failed checks make main return non zero
+
+static int NumFailures = 0;
+
+static void Check(bool cond, const string &what) {
+  if (!cond) {
+    cout << "FAILED: " << what << endl;
+    ++NumFailures;
+  }
+}
+
+static unsigned int Bits(float f) {
+  unsigned int u;
+  memcpy(&u, &f, sizeof(float));
+  return u;
+}
+
+static unsigned int Random() {
+  static unsigned int state = 12345;
+  state = state * 1664525 + 1013904223;
+  return (state >> 8);
+}
+
+// half float (PT_FLOAT_16)
+
+static float RefHalfToFloat(Half h) {
+  int e = (h >> 10) & 0x1F;
+  int m = h & 0x03FF;
+  float v;
+  if (e == 0) {
+    v = float(ldexp(double(m), -24));
+  } else if (e == 31) {
+    v = (m != 0 ? numeric_limits<float>::quiet_NaN() : numeric_limits<float>::infinity());
+  } else {
+    v = float(ldexp(double(m | 0x0400), e - 25));
+  }
+  return ((h & 0x8000) != 0 ? -v : v);
+}
+
+static void TestHalf() {
+  vector<Half> halves(65536);
+  vector<float> floats(65536);
+  vector<Half> back(65536);
+
+  for (size_t i=0; i<halves.size(); ++i) {
+    halves[i] = Half(i);
+  }
+  HalfToFloat(&halves[0], &floats[0], halves.size());
+  FloatToHalf(&floats[0], &back[0], floats.size());
+
+  int badScalar = 0;
+  int badArray = 0;
+  int badRoundTrip = 0;
+
+  for (size_t i=0; i<halves.size(); ++i) {
+    float ref = RefHalfToFloat(halves[i]);
+    float f = HalfToFloat(halves[i]);
+    if (ref != ref) {
+      // NaNs stay NaNs
+      badScalar += (f == f ? 1 : 0);
+      badArray += (floats[i] == floats[i] ? 1 : 0);
+      badRoundTrip += ((back[i] & 0x7C00) != 0x7C00 || (back[i] & 0x03FF) == 0 ? 1 : 0);
+      continue;
+    }
+    badScalar += (Bits(f) != Bits(ref) ? 1 : 0);
+    badArray += (Bits(floats[i]) != Bits(ref) ? 1 : 0);
+    badRoundTrip += (FloatToHalf(f) != halves[i] || back[i] != halves[i] ? 1 : 0);
+  }
+
+  Check(badScalar == 0, "HalfToFloat matches the reference decoding for all halves");
+  Check(badArray == 0, "array HalfToFloat matches the reference decoding for all halves");
+  Check(badRoundTrip == 0, "FloatToHalf round trips all halves");
+
+  // values halfway between two consecutive finite halves round to even
+  vector<float> ties;
+  vector<Half> expected;
+
+  for (unsigned int i=0; i<65536; ++i) {
+    if ((i & 0x7C00) == 0x7C00 || (i & 0x7FFF) == 0x7BFF) {
+      continue;
+    }
+    ties.push_back((HalfToFloat(Half(i)) + HalfToFloat(Half(i + 1))) * 0.5f);
+    expected.push_back(Half((i & 1) != 0 ? i + 1 : i));
+  }
+
+  vector<Half> rounded(ties.size());
+  FloatToHalf(&ties[0], &rounded[0], ties.size());
+
+  int badTies = 0;
+  for (size_t i=0; i<ties.size(); ++i) {
+    badTies += (FloatToHalf(ties[i]) != expected[i] || rounded[i] != expected[i] ? 1 : 0);
+  }
+  Check(badTies == 0, "FloatToHalf rounds ties to even");
+
+  Check(FloatToHalf(65519.0f) == 0x7BFF, "FloatToHalf(65519) is the largest half");
+  Check(FloatToHalf(65520.0f) == 0x7C00, "FloatToHalf(65520) overflows to infinity");
+  Check(FloatToHalf(-1.0e10f) == 0xFC00, "FloatToHalf(-1e10) overflows to -infinity");
+  Check(FloatToHalf(1.0e-10f) == 0x0000, "FloatToHalf(1e-10) underflows to 0");
+  Half nan = FloatToHalf(numeric_limits<float>::quiet_NaN());
+  Check((nan & 0x7C00) == 0x7C00 && (nan & 0x03FF) != 0, "FloatToHalf keeps NaNs");
+}
+
+// packed types
+
+struct PackedCase {
+  PixelFormat format;
+  PixelType type;
+  // plain type the words are unpacked to without loss
+  PixelType plainType;
+  const char *name;
+};
+
+static const PackedCase PackedCases[] = {
+  {PF_RGB, PT_INT_3_3_2, PT_INT_8, "3_3_2"},
+  {PF_RGB, PT_INT_5_6_5, PT_INT_8, "5_6_5"},
+  {PF_RGBA, PT_INT_4_4_4_4, PT_INT_8, "4_4_4_4"},
+  {PF_RGBA, PT_INT_5_5_5_1, PT_INT_8, "5_5_5_1"},
+  {PF_RGBA, PT_INT_8_8_8_8, PT_INT_8, "8_8_8_8"},
+  {PF_RGBA, PT_INT_10_10_10_2, PT_INT_16, "10_10_10_2"}
+};
+
+static void TestPacked() {
+  for (size_t i=0; i<sizeof(PackedCases)/sizeof(PackedCase); ++i) {
+    const PackedCase &pc = PackedCases[i];
+    PixelDesc packed(pc.format, pc.type);
+    PixelDesc plain(pc.format, pc.plainType);
+    string name = string("packed ") + pc.name;
+
+    Check(packed.isValid() && packed.isPacked(), name + " is a valid packed type");
+
+    // all words of 8 and 16 bits types, a sample of 32 bits ones
+    size_t wordSize = packed.getBytesPerPixel();
+    size_t count = (wordSize == 1 ? 256 : 65536);
+
+    vector<unsigned char> words(count * wordSize);
+    for (size_t j=0; j<count; ++j) {
+      if (wordSize == 1) {
+        words[j] = (unsigned char) j;
+      } else if (wordSize == 2) {
+        unsigned short w = (unsigned short) j;
+        memcpy(&words[j * 2], &w, 2);
+      } else {
+        unsigned int w = (Random() << 8) ^ Random();
+        memcpy(&words[j * 4], &w, 4);
+      }
+    }
+
+    vector<unsigned char> values(count * plain.getBytesPerPixel());
+    vector<unsigned char> back(words.size());
+
+    bool ok = (ConvertPixels(&words[0], packed, &values[0], plain, count) &&
+               ConvertPixels(&values[0], plain, &back[0], packed, count));
+
+    Check(ok && back == words, name + " words round trip through " + TypeString[pc.plainType]);
+  }
+
+  // first channel in the most significant bits
+  unsigned short w565[3] = {0xF800, 0x07E0, 0x001F};
+  unsigned char rgb[9];
+  ConvertPixels(w565, PixelDesc(PF_RGB, PT_INT_5_6_5), rgb, PixelDesc(PF_RGB, PT_INT_8), 3);
+  unsigned char rgbExpected[9] = {255, 0, 0, 0, 255, 0, 0, 0, 255};
+  Check(memcmp(rgb, rgbExpected, 9) == 0, "packed 5_6_5 channel order");
+
+  unsigned int w1010102 = (1023U << 22) | (512U << 12) | (0U << 2) | 3U;
+  unsigned short rgba16[4];
+  ConvertPixels(&w1010102, PixelDesc(PF_RGBA, PT_INT_10_10_10_2), rgba16, PixelDesc(PF_RGBA, PT_INT_16), 1);
+  Check(rgba16[0] == 65535 && rgba16[1] == (512 * 65535 + 511) / 1023 && rgba16[2] == 0 && rgba16[3] == 65535,
+        "packed 10_10_10_2 channel order and scaling");
+}
+
+// block compression
+
+static int BlockRoundTripError(const vector<unsigned char> &rgba, int w, int h,
+                               PixelFormat format, PixelType type, int flags, int numChannels) {
+  PixelDesc rgba8(PF_RGBA, PT_INT_8);
+  PixelDesc blocks(format, type);
+
+  vector<unsigned char> data(blocks.getBytesSizeFor(w, h, 1, 0, 1));
+  vector<unsigned char> decoded(rgba.size());
+
+  if (!CompressBlocks(&rgba[0], rgba8, w, h, &data[0], blocks, flags) ||
+      !DecompressBlocks(&data[0], blocks, w, h, &decoded[0], rgba8)) {
+    return 256;
+  }
+
+  int maxErr = 0;
+  for (size_t i=0; i<rgba.size(); i+=4) {
+    for (int c=0; c<numChannels; ++c) {
+      maxErr = max(maxErr, abs(int(decoded[i + c]) - int(rgba[i + c])));
+    }
+  }
+  return maxErr;
+}
+
+struct BlockCase {
+  PixelFormat format;
+  PixelType type;
+  int numChannels;
+  // max error on the smooth test image
+  int bound;
+  const char *name;
+};
+
+static void TestBlocks() {
+  static const BlockCase cases[] = {
+    {PF_RGB, PT_DXT1, 3, 16, "DXT1"},
+    {PF_RGBA, PT_DXT3, 4, 16, "DXT3"},
+    {PF_RGBA, PT_DXT5, 4, 16, "DXT5"},
+    {PF_RG, PT_3DC, 2, 4, "3DC"}
+  };
+
+  // smooth gradients, ragged edges (partial blocks)
+  int w = 61;
+  int h = 45;
+  vector<unsigned char> rgba(w * h * 4);
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      unsigned char *p = &rgba[(y * w + x) * 4];
+      p[0] = (unsigned char) (x * 255 / (w - 1));
+      p[1] = (unsigned char) (y * 255 / (h - 1));
+      p[2] = (unsigned char) ((x + y) * 255 / (w + h - 2));
+      p[3] = (unsigned char) (255 - (x * y) * 255 / ((w - 1) * (h - 1)));
+    }
+  }
+
+  for (size_t i=0; i<sizeof(cases)/sizeof(BlockCase); ++i) {
+    const BlockCase &bc = cases[i];
+    for (int q=0; q<2; ++q) {
+      int flags = (q ? CONVERT_HIGH_QUALITY : CONVERT_DEFAULT);
+      int err = BlockRoundTripError(rgba, w, h, bc.format, bc.type, flags, bc.numChannels);
+      cout << bc.name << (q ? " high quality" : "") << " max error " << err << endl;
+      Check(err <= bc.bound, string(bc.name) + " round trip error is bounded");
+    }
+  }
+
+  // single color blocks use the best endpoints pair
+  int maxErr = 0;
+  for (int v=0; v<256; ++v) {
+    vector<unsigned char> solid(16 * 4);
+    for (int j=0; j<16; ++j) {
+      solid[j * 4] = (unsigned char) v;
+      solid[j * 4 + 1] = (unsigned char) (255 - v);
+      solid[j * 4 + 2] = (unsigned char) ((v * 7) & 0xFF);
+      solid[j * 4 + 3] = 255;
+    }
+    maxErr = max(maxErr, BlockRoundTripError(solid, 4, 4, PF_RGB, PT_DXT1, CONVERT_HIGH_QUALITY, 3));
+  }
+  cout << "DXT1 single color max error " << maxErr << endl;
+  Check(maxErr <= 1, "DXT1 single color blocks are within 1 of the source");
+}
+
+// orientation
+
+// pixel index stored in red and green
+static Image* IndexImage(int w, int h) {
+  Image *img = new Image(PixelDesc(PF_RGBA, PT_INT_8), w, h);
+  unsigned char *p = (unsigned char*) img->getPixels();
+  for (int i=0; i<w*h; ++i, p+=4) {
+    p[0] = (unsigned char) (i & 0xFF);
+    p[1] = (unsigned char) (i >> 8);
+    p[2] = 7;
+    p[3] = 255;
+  }
+  return img;
+}
+
+static int PixelIndex(Image &img, int x, int y) {
+  const unsigned char *p = (const unsigned char*) img.getPixels() + (y * img.getWidth() + x) * 4;
+  return (p[2] == 7 ? p[0] | (p[1] << 8) : -1);
+}
+
+enum OrientOp {
+  OP_FLIP_X = 0,
+  OP_FLIP_Y,
+  OP_TRANSPOSE,
+  OP_ROTATE_CW,
+  OP_ROTATE_CCW
+};
+
+// index of the source pixel shown at x, y after op (w, h source dimensions)
+static int SourceIndex(int op, int x, int y, int w, int h) {
+  switch (op) {
+  case OP_FLIP_X:
+    return y * w + (w - 1 - x);
+  case OP_FLIP_Y:
+    return (h - 1 - y) * w + x;
+  case OP_TRANSPOSE:
+    return x * w + y;
+  case OP_ROTATE_CW:
+    return (h - 1 - x) * w + y;
+  default:
+    return x * w + (w - 1 - y);
+  }
+}
+
+static bool CheckOp(Image &img, int op, int w, int h) {
+  bool swap = (op >= OP_TRANSPOSE);
+  if (img.getWidth() != (swap ? h : w) || img.getHeight() != (swap ? w : h)) {
+    return false;
+  }
+  for (int y=0; y<img.getHeight(); ++y) {
+    for (int x=0; x<img.getWidth(); ++x) {
+      if (PixelIndex(img, x, y) != SourceIndex(op, x, y, w, h)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void TestOrientation() {
+  static const char *names[] = {"flipHorizontally", "flipVertically", "transpose", "rotateCW", "rotateCCW"};
+
+  // large enough for the cache blocked passes, with partial tiles
+  int w = 83;
+  int h = 57;
+
+  for (int op=OP_FLIP_X; op<=OP_ROTATE_CCW; ++op) {
+    Image *img = IndexImage(w, h);
+    switch (op) {
+    case OP_FLIP_X:
+      img->flipHorizontally();
+      break;
+    case OP_FLIP_Y:
+      img->flipVertically();
+      break;
+    case OP_TRANSPOSE:
+      img->transpose();
+      break;
+    case OP_ROTATE_CW:
+      img->rotateCW();
+      break;
+    default:
+      img->rotateCCW();
+    }
+    Check(CheckOp(*img, op, w, h), string(names[op]) + " moves pixels as expected");
+    delete img;
+  }
+
+  Image *img = IndexImage(w, h);
+  img->rotateCW();
+  img->rotateCCW();
+  bool identity = (img->getWidth() == w && img->getHeight() == h);
+  for (int y=0; y<h && identity; ++y) {
+    for (int x=0; x<w && identity; ++x) {
+      identity = (PixelIndex(*img, x, y) == y * w + x);
+    }
+  }
+  Check(identity, "rotateCW then rotateCCW is the identity");
+  delete img;
+
+  // stored pixels are transposed first, then flipped
+  for (int orient=0; orient<8; ++orient) {
+    img = IndexImage(w, h);
+    img->setOrientation(orient);
+    img->normalizeOrientation();
+
+    bool transposed = ((orient & Image::ORIENT_TRANSPOSE) != 0);
+    int dw = (transposed ? h : w);
+    int dh = (transposed ? w : h);
+    bool ok = (img->getOrientation() == Image::ORIENT_NORMAL &&
+               img->getWidth() == dw && img->getHeight() == dh);
+
+    for (int y=0; y<dh && ok; ++y) {
+      for (int x=0; x<dw && ok; ++x) {
+        int tx = ((orient & Image::ORIENT_FLIP_X) != 0 ? dw - 1 - x : x);
+        int ty = ((orient & Image::ORIENT_FLIP_Y) != 0 ? dh - 1 - y : y);
+        int sx = (transposed ? ty : tx);
+        int sy = (transposed ? tx : ty);
+        ok = (PixelIndex(*img, x, y) == sy * w + sx);
+      }
+    }
+    char what[64];
+    sprintf(what, "normalizeOrientation of orientation %d", orient);
+    Check(ok, what);
+    delete img;
+  }
+}
+
+// 3D scaling
+
+static bool CheckVolumeLevels(Image &img, int w, int h, int d, int numMipmaps, unsigned char value) {
+  if (img.getNumMipmaps() != numMipmaps) {
+    return false;
+  }
+  for (int l=0; l<=numMipmaps; ++l) {
+    int lw = max(1, w >> l);
+    int lh = max(1, h >> l);
+    int ld = max(1, d >> l);
+    const unsigned char *p = (const unsigned char*) img.getPixels(l);
+    if (!p || img.getWidth(l) != lw || img.getHeight(l) != lh || img.getDepth(l) != ld) {
+      return false;
+    }
+    // a constant volume stays constant
+    for (int i=0; i<lw*lh*ld*4; ++i) {
+      if (p[i] != value) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void TestScale3D() {
+  for (int planar=0; planar<2; ++planar) {
+    string kind = (planar ? "planar " : "");
+    
+    Image img(PixelDesc(PF_RGBA, PT_INT_8), 16, 16, 16, 4);
+    img.setPlanar(planar != 0);
+    for (int l=0; l<=img.getNumMipmaps(); ++l) {
+      memset(img.getPixels(l), 100, img.getWidth(l) * img.getHeight(l) * img.getDepth(l) * 4);
+    }
+    
+    img.scale(8, 8, 8, Image::LINEAR);
+    Check(CheckVolumeLevels(img, 8, 8, 8, 3, 100), kind + "3D scale(w, h, d) rebuilds the mipmap levels");
+    
+    img.scale(8, 4, Image::NEAREST);
+    Check(CheckVolumeLevels(img, 8, 4, 8, 3, 100), kind + "3D scale(w, h) keeps the depth and mipmap levels");
+  }
+}
+
+// integer ratio scaling
+
+struct RatioCase {
+  int w;
+  int h;
+  Image::ScaleMethod method;
+  const char *name;
+};
+
+// scale picks dedicated kernels for integer ratios, scaleRegion always
+// uses separable filtering: both agree within rounding
+static void TestScaleRatios() {
+  static const RatioCase cases[] = {
+    {24, 16, Image::NEAREST, "2x NEAREST reduce"},
+    {12, 8, Image::NEAREST, "4x NEAREST reduce"},
+    {96, 64, Image::LINEAR, "2x LINEAR enlarge"},
+    {144, 96, Image::NEAREST, "3x NEAREST enlarge"},
+    {144, 32, Image::LINEAR, "3x1 LINEAR enlarge"}
+  };
+  
+  int w = 48;
+  int h = 32;
+  
+  for (size_t i=0; i<sizeof(cases)/sizeof(RatioCase); ++i) {
+    const RatioCase &rc = cases[i];
+    
+    Image img(PixelDesc(PF_RGBA, PT_INT_8), w, h);
+    unsigned char *p = (unsigned char*) img.getPixels();
+    for (int j=0; j<w*h*4; ++j) {
+      p[j] = (unsigned char) (Random() & 0xFF);
+    }
+    
+    Image *region = img.scaleRegion(0.0, 0.0, w, h, rc.w, rc.h, rc.method);
+    img.scale(rc.w, rc.h, rc.method);
+    
+    bool ok = (region != 0 && img.getWidth() == rc.w && img.getHeight() == rc.h &&
+               region->getWidth() == rc.w && region->getHeight() == rc.h);
+    
+    if (ok) {
+      const unsigned char *p0 = (const unsigned char*) img.getPixels();
+      const unsigned char *p1 = (const unsigned char*) region->getPixels();
+      for (int j=0; j<rc.w*rc.h*4 && ok; ++j) {
+        ok = (abs(int(p0[j]) - int(p1[j])) <= 1);
+      }
+    }
+    Check(ok, string(rc.name) + " matches scaleRegion within 1");
+    
+    delete region;
+  }
+}
+
+// alpha premultiplication
+
+static void TestPremult() {
+  // every (color, alpha) pair
+  Image img(PixelDesc(PF_RGBA, PT_INT_8), 256, 256);
+  vector<unsigned char> la(256 * 256 * 2);
+  unsigned char *p = (unsigned char*) img.getPixels();
+  for (int a=0; a<256; ++a) {
+    for (int c=0; c<256; ++c, p+=4) {
+      p[0] = p[1] = p[2] = (unsigned char) c;
+      p[3] = (unsigned char) a;
+      la[(a * 256 + c) * 2] = (unsigned char) c;
+      la[(a * 256 + c) * 2 + 1] = (unsigned char) a;
+    }
+  }
+
+  vector<unsigned char> premult(256 * 256 * 4);
+  Premultiply(img.getPixels(), &premult[0], img.getPixelDesc(), 256 * 256);
+  img.unpremultiply();
+  Unpremultiply(&la[0], &la[0], PixelDesc(PF_LUMINANCE_ALPHA, PT_INT_8), 256 * 256);
+
+  int badPremult = 0;
+  int badUnpremult = 0;
+  int badLA = 0;
+  p = (unsigned char*) img.getPixels();
+  for (int a=0; a<256; ++a) {
+    for (int c=0; c<256; ++c, p+=4) {
+      int i = a * 256 + c;
+      int pm = (2 * c * a + 255) / 510;
+      int um = (a == 0 ? c : min(255, (2 * c * 255 + a) / (2 * a)));
+      badPremult += (premult[i * 4] != pm || premult[i * 4 + 3] != a ? 1 : 0);
+      badUnpremult += (p[0] != um || p[1] != um || p[2] != um || p[3] != a ? 1 : 0);
+      badLA += (la[i * 2] != um || la[i * 2 + 1] != a ? 1 : 0);
+    }
+  }
+
+  Check(badPremult == 0, "8 bits premultiply rounds to nearest");
+  Check(badUnpremult == 0, "8 bits RGBA unpremultiply rounds to nearest");
+  Check(badLA == 0, "8 bits luminance alpha unpremultiply rounds to nearest");
+}
+
+// statistics
+
+static void TestStats() {
+  int w = 67;
+  int h = 29;
+  int n = w * h;
+
+  Image img(PixelDesc(PF_RGBA, PT_FLOAT_32), w, h);
+  float *p = (float*) img.getPixels();
+  for (int i=0; i<n*4; ++i) {
+    p[i] = float(Random() % 20001) / 10000.0f - 0.5f;
+  }
+
+  double mn[4], mx[4], mean[4], var[4];
+  for (int c=0; c<4; ++c) {
+    mn[c] = mx[c] = p[c];
+    double sum = 0.0;
+    for (int i=0; i<n; ++i) {
+      mn[c] = min(mn[c], double(p[i * 4 + c]));
+      mx[c] = max(mx[c], double(p[i * 4 + c]));
+      sum += p[i * 4 + c];
+    }
+    mean[c] = sum / n;
+    double sq = 0.0;
+    for (int i=0; i<n; ++i) {
+      double d = p[i * 4 + c] - mean[c];
+      sq += d * d;
+    }
+    var[c] = sq / n;
+  }
+
+  for (int planar=0; planar<2; ++planar) {
+    img.setPlanar(planar != 0);
+    ImageStats stats;
+    bool ok = (img.computeStats(stats) && stats.numChannels == 4 && stats.count == size_t(n));
+    for (int c=0; c<4 && ok; ++c) {
+      ok = (stats.min[c] == float(mn[c]) && stats.max[c] == float(mx[c]) &&
+            fabs(stats.mean[c] - mean[c]) < 1.0e-6 && fabs(stats.variance[c] - var[c]) < 1.0e-6);
+    }
+    Check(ok, (planar ? "planar image statistics" : "image statistics"));
+  }
+  img.setPlanar(false);
+
+  // red values at bin centers, 10 bins over [0, 1]
+  p = (float*) img.getPixels();
+  vector<size_t> counts(10, 0);
+  vector<float> reds(n);
+  for (int i=0; i<n; ++i) {
+    int k = (i * 37) % 100;
+    p[i * 4] = (float(k) + 0.5f) / 100.0f;
+    reds[i] = p[i * 4];
+    ++counts[k / 10];
+  }
+
+  Histogram hist(10, 0.0f, 1.0f);
+  bool ok = (img.computeHistogram(hist, 0) && hist.getTotal() == size_t(n));
+  for (int b=0; b<10 && ok; ++b) {
+    ok = (hist.getCount(b) == counts[b]);
+  }
+  Check(ok, "histogram counts");
+
+  sort(reds.begin(), reds.end());
+  for (int i=1; i<10; ++i) {
+    float pc = float(i) / 10.0f;
+    float exact = reds[size_t(pc * (n - 1))];
+    char what[64];
+    sprintf(what, "histogram percentile %.1f within a bin of %f", pc, exact);
+    Check(fabs(hist.percentile(pc) - exact) <= 0.1f, what);
+  }
+
+  Histogram lum(16, 0.0f, 1.0f);
+  Check(img.computeHistogram(lum, -1) && lum.getTotal() == size_t(n), "luminance histogram counts all pixels");
+}
+
+// sRGB transfer
+
+static double RefSrgbToLinear(double v) {
+  return (v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4));
+}
+
+static void TestSrgb() {
+  PixelDesc rgba8(PF_RGBA, PT_INT_8);
+  PixelDesc rgba16(PF_RGBA, PT_INT_16);
+  PixelDesc rgbaf(PF_RGBA, PT_FLOAT_32);
+
+  vector<unsigned char> v8(256 * 4);
+  for (int i=0; i<256; ++i) {
+    v8[i * 4] = v8[i * 4 + 1] = v8[i * 4 + 2] = v8[i * 4 + 3] = (unsigned char) i;
+  }
+
+  vector<float> f(256 * 4);
+  vector<unsigned char> back8(v8.size());
+  ConvertPixels(&v8[0], rgba8, &f[0], rgbaf, 256, 0, CONVERT_SRGB);
+  ConvertPixels(&f[0], rgbaf, &back8[0], rgba8, 256, 0, CONVERT_SRGB);
+
+  int badDecode = 0;
+  for (int i=0; i<256; ++i) {
+    badDecode += (f[i * 4] != float(RefSrgbToLinear(i / 255.0)) ? 1 : 0);
+    // alpha stays linear
+    badDecode += (fabs(f[i * 4 + 3] - i / 255.0f) > 1.0e-7f ? 1 : 0);
+  }
+  Check(badDecode == 0, "sRGB 8 bits decoding");
+  Check(back8 == v8, "sRGB 8 bits values round trip");
+
+  vector<unsigned short> v16(65536 * 4);
+  for (int i=0; i<65536; ++i) {
+    v16[i * 4] = v16[i * 4 + 1] = v16[i * 4 + 2] = v16[i * 4 + 3] = (unsigned short) i;
+  }
+  vector<float> f16(v16.size());
+  vector<unsigned short> back16(v16.size());
+  ConvertPixels(&v16[0], rgba16, &f16[0], rgbaf, 65536, 0, CONVERT_SRGB);
+  ConvertPixels(&f16[0], rgbaf, &back16[0], rgba16, 65536, 0, CONVERT_SRGB);
+
+  int bad16 = 0;
+  for (size_t i=0; i<v16.size(); ++i) {
+    bad16 += (abs(int(back16[i]) - int(v16[i])) > ((i & 3) == 3 ? 0 : 1) ? 1 : 0);
+  }
+  Check(bad16 == 0, "sRGB 16 bits values round trip (ties within 1)");
+}
+
+// pixel pipelines
+
+static float RandomValue(float minValue, float maxValue) {
+  return minValue + (maxValue - minValue) * float(Random() % 100001) / 100000.0f;
+}
+
+static bool CloseTo(double value, double expected, double relError) {
+  return (fabs(value - expected) <= relError * max(fabs(expected), 1.0e-30));
+}
+
+// pipeline on a single channel value
+static float ApplyValue(const PixelPipeline &pp, float v) {
+  float rgb[3] = {v, v, v};
+  pp.apply(rgb, rgb, PixelDesc(PF_RGB, PT_FLOAT_32), 1);
+  return rgb[0];
+}
+
+static double RefEncode(TransferFunction tf, double v) {
+  if (tf == TRANSFER_SRGB) {
+    return (v <= 0.0031308 ? 12.92 * v : 1.055 * pow(v, 1.0 / 2.4) - 0.055);
+  }
+  return (v < 0.018054 ? 4.5 * v : 1.099297 * pow(v, 0.45) - 0.099297);
+}
+
+static double RefDecode(TransferFunction tf, double v) {
+  if (tf == TRANSFER_SRGB) {
+    return (v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4));
+  }
+  return (v < 0.081243 ? v / 4.5 : pow((v + 0.099297) / 1.099297, 1.0 / 0.45));
+}
+
+static void TestPipeline() {
+  static const float m[9] = {
+     0.8f, 0.15f, 0.05f,
+     0.1f, 0.85f, 0.05f,
+    -0.02f, 0.1f, 0.92f
+  };
+  Color black(0.02f, 0.01f, 0.03f);
+  Color white(0.9f, 1.1f, 0.95f);
+  Color lift(0.05f, 0.0f, -0.02f);
+  Color gain(1.2f, 0.9f, 1.05f);
+  
+  PixelPipeline pp;
+  pp.decode(TRANSFER_SRGB);
+  pp.exposure(0.5f);
+  pp.grade(black, white, lift, gain);
+  pp.saturation(1.3f);
+  pp.matrix(m);
+  pp.gamma(1.8f);
+  pp.clamp(-0.5f, 4.0f);
+  pp.encode(TRANSFER_BT709);
+  
+  // more than a block, not a multiple of 4
+  size_t n = 1003;
+  vector<float> pixels(n * 4);
+  for (size_t i=0; i<pixels.size(); ++i) {
+    pixels[i] = RandomValue(-0.2f, 1.5f);
+  }
+  vector<float> out(pixels.size());
+  bool ok = pp.apply(&pixels[0], &out[0], PixelDesc(PF_RGBA, PT_FLOAT_32), n);
+  
+  for (size_t i=0; i<n && ok; ++i) {
+    const float *p = &pixels[i * 4];
+    Color c = pp.apply(Color(p[0], p[1], p[2], p[3]));
+    ok = (c.r == out[i * 4] && c.g == out[i * 4 + 1] && c.b == out[i * 4 + 2] &&
+          c.a == p[3] && out[i * 4 + 3] == p[3]);
+  }
+  Check(ok, "pipeline apply(Color) matches the pixel version");
+  
+  // gamma against pow over a wide range, other values untouched
+  PixelPipeline gamma;
+  gamma.gamma(2.2f);
+  ok = true;
+  for (int e=-40; e<=40 && ok; ++e) {
+    for (int k=0; k<16 && ok; ++k) {
+      float v = float(ldexp(1.0 + k / 16.0, e));
+      ok = CloseTo(ApplyValue(gamma, v), pow(double(v), 1.0 / double(2.2f)), 2.0e-6);
+    }
+  }
+  Check(ok, "pipeline gamma relative error below 2e-6");
+  Check(ApplyValue(gamma, -0.5f) == -0.5f && ApplyValue(gamma, 0.0f) == 0.0f, "pipeline gamma leaves values <= 0 unchanged");
+  
+  // transfer functions against their definitions
+  static const TransferFunction transfers[2] = {TRANSFER_SRGB, TRANSFER_BT709};
+  static const char *transferNames[2] = {"sRGB", "BT.709"};
+  for (int t=0; t<2; ++t) {
+    PixelPipeline decode;
+    PixelPipeline encode;
+    decode.decode(transfers[t]);
+    encode.encode(transfers[t]);
+    bool okDecode = true;
+    bool okEncode = true;
+    for (int i=0; i<=1000; ++i) {
+      float v = i / 1000.0f;
+      okDecode = (okDecode && CloseTo(ApplyValue(decode, v), RefDecode(transfers[t], v), 4.0e-6));
+      okEncode = (okEncode && CloseTo(ApplyValue(encode, v), RefEncode(transfers[t], v), 4.0e-6));
+    }
+    Check(okDecode, string("pipeline ") + transferNames[t] + " decode");
+    Check(okEncode, string("pipeline ") + transferNames[t] + " encode");
+  }
+  
+  // exposure and grade fold into one multiply-add
+  PixelPipeline folded;
+  folded.exposure(-1.5f);
+  folded.grade(black, white, lift, gain);
+  ok = (folded.size() == 1);
+  for (size_t i=0; i<n && ok; ++i) {
+    const float *p = &pixels[i * 4];
+    Color c(p[0], p[1], p[2], p[3]);
+    float scale = float(pow(2.0, -1.5));
+    Color exposed(c.r * scale, c.g * scale, c.b * scale, c.a);
+    Color expected = exposed.grade(black, white, lift, gain);
+    Color value = folded.apply(c);
+    ok = (fabs(value.r - expected.r) <= 1.0e-5f && fabs(value.g - expected.g) <= 1.0e-5f &&
+          fabs(value.b - expected.b) <= 1.0e-5f);
+  }
+  Check(ok, "pipeline exposure and grade fold as Color::grade");
+  
+  // in place image paths give the same results as interleaved buffers
+  static const PixelType types[3] = {PT_FLOAT_32, PT_INT_8, PT_INT_16};
+  for (int t=0; t<3; ++t) {
+    PixelDesc desc(PF_RGBA, types[t]);
+    int w = 37;
+    int h = 21;
+    size_t size = desc.getBytesSizeFor(w, h, 1, 0, 1);
+    
+    vector<float> values(w * h * 4);
+    for (size_t i=0; i<values.size(); ++i) {
+      values[i] = RandomValue(0.0f, 1.0f);
+    }
+    
+    Image interleaved(desc, w, h);
+    Image planar(desc, w, h);
+    ConvertPixels(&values[0], PixelDesc(PF_RGBA, PT_FLOAT_32), interleaved.getPixels(), desc, w * h);
+    
+    vector<unsigned char> expected(size);
+    pp.apply(interleaved.getPixels(), &expected[0], desc, w * h);
+    
+    memcpy(planar.getPixels(), interleaved.getPixels(), size);
+    planar.setPlanar(true);
+    
+    interleaved.applyPipeline(pp);
+    planar.applyPipeline(pp);
+    planar.setPlanar(false);
+    
+    Check(memcmp(interleaved.getPixels(), &expected[0], size) == 0,
+          string("pipeline on a ") + TypeString[types[t]] + " image");
+    Check(memcmp(planar.getPixels(), &expected[0], size) == 0,
+          string("pipeline on a planar ") + TypeString[types[t]] + " image");
+  }
+  
+  // packed pixels: unpacked, processed and packed again
+  PixelDesc packed(PF_RGB, PT_INT_5_6_5);
+  PixelDesc rgbf(PF_RGB, PT_FLOAT_32);
+  vector<unsigned short> words(65536);
+  for (size_t i=0; i<words.size(); ++i) {
+    words[i] = (unsigned short) i;
+  }
+  vector<float> unpacked(words.size() * 3);
+  vector<unsigned short> expectedWords(words.size());
+  ConvertPixels(&words[0], packed, &unpacked[0], rgbf, words.size());
+  pp.apply(&unpacked[0], &unpacked[0], rgbf, words.size());
+  for (size_t i=0; i<unpacked.size(); ++i) {
+    unpacked[i] = min(1.0f, max(0.0f, unpacked[i]));
+  }
+  ConvertPixels(&unpacked[0], rgbf, &expectedWords[0], packed, words.size());
+  pp.apply(&words[0], &words[0], packed, words.size());
+  Check(words == expectedWords, "pipeline on packed 5_6_5 pixels");
+}
+
+// 3D LUTs
+
+class IdentityTransform : public ColorTransform {
+  public:
+    virtual Color apply(const Color &c) const {
+      return c;
+    }
+};
+
+// tetrahedral interpolation is exact for affine transforms
+class AffineTransform : public ColorTransform {
+  public:
+    virtual Color apply(const Color &c) const {
+      return Color(0.7f * c.r + 0.2f * c.g - 0.1f * c.b + 0.05f,
+                   -0.3f * c.r + 0.9f * c.g + 0.25f * c.b,
+                   0.1f * c.r - 0.4f * c.g + 1.2f * c.b - 0.1f,
+                   c.a);
+    }
+};
+
+static bool SameColor(const Color &c0, const Color &c1, float tolerance) {
+  return (fabs(c0.r - c1.r) <= tolerance && fabs(c0.g - c1.g) <= tolerance &&
+          fabs(c0.b - c1.b) <= tolerance && c0.a == c1.a);
+}
+
+static void TestLut() {
+  IdentityTransform identity;
+  AffineTransform affine;
+  
+  Lut3D lut(17);
+  lut.setDomain(Color(-0.5f, 0.0f, 0.0f), Color(1.5f, 1.0f, 2.0f));
+  lut.sample(identity);
+  
+  // grid points and random points in the domain
+  size_t n = 1003;
+  vector<Color> colors;
+  for (int i=0; i<17; ++i) {
+    colors.push_back(Color(-0.5f + i * 2.0f / 16.0f, i / 16.0f, i * 2.0f / 16.0f, 0.5f));
+  }
+  while (colors.size() < n) {
+    colors.push_back(Color(RandomValue(-0.5f, 1.5f), RandomValue(0.0f, 1.0f), RandomValue(0.0f, 2.0f), 0.25f));
+  }
+  
+  bool ok = true;
+  for (size_t i=0; i<n && ok; ++i) {
+    ok = SameColor(lut.lookup(colors[i]), colors[i], 1.0e-6f);
+  }
+  Check(ok, "identity LUT lookup returns its input");
+  
+  lut.sample(affine);
+  
+  vector<float> r(n), g(n), b(n);
+  for (size_t i=0; i<n; ++i) {
+    r[i] = colors[i].r;
+    g[i] = colors[i].g;
+    b[i] = colors[i].b;
+  }
+  lut.lookup(&r[0], &g[0], &b[0], n);
+  
+  vector<float> rgba(n * 4);
+  for (size_t i=0; i<n; ++i) {
+    rgba[i * 4] = colors[i].r;
+    rgba[i * 4 + 1] = colors[i].g;
+    rgba[i * 4 + 2] = colors[i].b;
+    rgba[i * 4 + 3] = colors[i].a;
+  }
+  lut.apply(&rgba[0], &rgba[0], PixelDesc(PF_RGBA, PT_FLOAT_32), n);
+  
+  bool okLookup = true;
+  bool okArrays = true;
+  bool okApply = true;
+  for (size_t i=0; i<n; ++i) {
+    Color expected = affine.apply(colors[i]);
+    okLookup = (okLookup && SameColor(lut.lookup(colors[i]), expected, 2.0e-6f));
+    okArrays = (okArrays && SameColor(Color(r[i], g[i], b[i], colors[i].a), expected, 2.0e-6f));
+    okApply = (okApply && SameColor(Color(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2], rgba[i * 4 + 3]), expected, 2.0e-6f));
+  }
+  Check(okLookup, "sampled affine LUT lookup is exact");
+  Check(okArrays, "sampled affine LUT array lookup is exact");
+  Check(okApply, "sampled affine LUT apply is exact");
+  
+  // .cube files keep the lattice and domain
+  const char *path = "test_gimg_tmp.cube";
+  Lut3D back(2);
+  ok = (lut.write(path, "test") && back.read(path));
+  remove(path);
+  
+  ok = (ok && back.getSize() == lut.getSize() &&
+        SameColor(back.getDomainMin(), lut.getDomainMin(), 0.0f) &&
+        SameColor(back.getDomainMax(), lut.getDomainMax(), 0.0f));
+  for (int i=0; i<17*17*17 && ok; ++i) {
+    for (int c=0; c<3; ++c) {
+      ok = (ok && back.getTable()[i * 4 + c] == lut.getTable()[i * 4 + c]);
+    }
+  }
+  Check(ok, "LUT .cube write and read round trip");
+}
+
+// HDR files, through the plugins
+
+static bool SameDisplayed(Image &a, Image &b) {
+  a.normalizeOrientation();
+  b.normalizeOrientation();
+  if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight()) {
+    return false;
+  }
+  const float *pa = (const float*) a.getPixels();
+  const float *pb = (const float*) b.getPixels();
+  for (int i=0; i<a.getWidth()*a.getHeight()*3; i+=3) {
+    // RGBE keeps 8 bits mantissas with an exponent shared by the 3 channels
+    float tolerance = max(pa[i], max(pa[i + 1], pa[i + 2])) / 64.0f;
+    for (int c=0; c<3; ++c) {
+      if (fabs(pa[i + c] - pb[i + c]) > tolerance) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void TestHdr() {
+  const char *path = "test_gimg_tmp.hdr";
+
+  // rcw is TRANSPOSE | FLIP_X, rccw TRANSPOSE | FLIP_Y
+  for (int orient=0; orient<8; ++orient) {
+    Image img(PixelDesc(PF_RGB, PT_FLOAT_32), 5, 3);
+    float *p = (float*) img.getPixels();
+    for (int i=0; i<15; ++i) {
+      p[i * 3] = float(i + 1);
+      p[i * 3 + 1] = 0.5f;
+      p[i * 3 + 2] = 2.0f;
+    }
+    img.setOrientation(orient);
+
+    if (!Image::Write(&img, path)) {
+      cout << "HDR plugin not available, skipping HDR checks" << endl;
+      return;
+    }
+
+    Image *read = Image::Read(path);
+    int readOrient = (read ? read->getOrientation() : -1);
+    char what[64];
+    sprintf(what, "HDR orientation %d round trip", orient);
+    Check(read != 0 && readOrient == orient && SameDisplayed(img, *read), what);
+    delete read;
+  }
+
+  // XYZE pixels are decoded to linear Rec.709
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    Check(false, "write XYZE test file");
+    return;
+  }
+  fprintf(file, "#?RADIANCE\nFORMAT=32-bit_rle_xyze\n\n-Y 1 +X 2\n");
+  unsigned char xyze[8] = {243, 255, 139, 128, 0, 0, 0, 0};
+  fwrite(xyze, 1, 8, file);
+  fclose(file);
+
+  Image *img = Image::Read(path);
+  remove(path);
+
+  bool ok = (img != 0 && img->getWidth() == 2 && img->getHeight() == 1 &&
+             img->getPixelDesc() == PixelDesc(PF_RGB, PT_FLOAT_32));
+  if (ok) {
+    static const double xyzToRGB[9] = {
+       3.2404542, -1.5371385, -0.4985314,
+      -0.9692660,  1.8760108,  0.0415560,
+       0.0556434, -0.2040259,  1.0572252
+    };
+    double xyz[3];
+    for (int c=0; c<3; ++c) {
+      xyz[c] = (xyze[c] + 0.5) / 256.0;
+    }
+    const float *p = (const float*) img->getPixels();
+    for (int c=0; c<3 && ok; ++c) {
+      double v = xyzToRGB[c * 3] * xyz[0] + xyzToRGB[c * 3 + 1] * xyz[1] + xyzToRGB[c * 3 + 2] * xyz[2];
+      ok = (fabs(p[c] - v) < 1.0e-3 && p[3 + c] == 0.0f);
+    }
+  }
+  Check(ok, "HDR XYZE decoding");
+  delete img;
+}
+
+// ---
+
 /*
 void decodeDXT1(unsigned char *src, unsigned char *dst, int w, int h, int x, int y) {
   // DXT1 --> 8 bytes block
@@ -147,7 +1147,7 @@ void decodeDXT1(unsigned char *src, unsigned char *dst, int w, int h, int x, int
 }
 */
 
-int main(int, char**) {
+int main(int argc, char **argv) {
   
   RGBA c0(128, 0, 57);
   RGBA c1(78, 67, 6);
@@ -216,6 +1216,35 @@ int main(int, char**) {
     cout << "    d = " << desc.getMipmappedDim(d, l) << endl;
   }
   
+  MipLayout layout(PixelDesc(PF_RGBA, PT_DXT5), w, h, 0);
+  cout << "Cube DXT5 layout: " << layout.getNumLevels() << " levels, "
+       << layout.getNumFaces() << " faces, " << layout.getTotalBytesSize() << " bytes" << endl;
+  for (int l=0; l<layout.getNumLevels(); ++l) {
+    cout << "  Level " << l << ": " << layout.getWidth(l) << "x" << layout.getHeight(l)
+         << ", " << layout.getBytesSize(l) << " bytes @ " << layout.getOffset(l)
+         << " (face 5 @ " << layout.getOffset(l, 5) << ")" << endl;
+  }
+  
+  TestHalf();
+  TestPacked();
+  TestBlocks();
+  TestOrientation();
+  TestScale3D();
+  TestScaleRatios();
+  TestPremult();
+  TestStats();
+  TestSrgb();
+  TestPipeline();
+  TestLut();
+  
+  Image::LoadPlugins(argc > 1 ? argv[1] : "./share/plugins/gimg");
+  TestHdr();
+  
+  if (NumFailures > 0) {
+    cout << NumFailures << " check(s) FAILED" << endl;
+    return 1;
+  }
+  cout << "All checks passed" << endl;
   return 0;
 }
 